@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "lightconf/lightconf.hpp"
+#include "lightconf/config_format.hpp"
+#include "lightconf/file_loader.hpp"
+#include "lightconf/json_format.hpp"
+#include "lightconf/transcode.hpp"
+
+/*
+   Micro-benchmarks for the lightconf parsers. Run with no arguments to run all of
+   them, or with the names of the benchmarks to run.
+
+        lightconf_bench [benchmark...]
+
+   Each benchmark prints its best time over a few runs and the resulting throughput.
+*/
+
+//
+// One entry of make_users()
+struct user {
+    int                 uid;
+    std::string         first_name;
+    std::string         last_name;
+    std::vector<std::string> permissions;
+    std::vector<int>    join_date;
+};
+
+//
+//
+struct user_list {
+    std::vector<user>   users;
+};
+
+namespace lightconf {
+
+LIGHTCONF_BEGIN_TYPE(user)
+    LIGHTCONF_TYPE_MEMBER_REQ(int,                      uid,            "uid")
+    LIGHTCONF_TYPE_MEMBER_OPT(std::string,              first_name,     "first_name",   "")
+    LIGHTCONF_TYPE_MEMBER_OPT(std::string,              last_name,      "last_name",    "")
+    LIGHTCONF_TYPE_MEMBER_REQ(std::vector<std::string>, permissions,    "permissions")
+    LIGHTCONF_TYPE_MEMBER_REQ(std::vector<int>,         join_date,      "join_date")
+LIGHTCONF_END_TYPE()
+
+LIGHTCONF_BEGIN_TYPE(user_list)
+    LIGHTCONF_TYPE_MEMBER_REQ(std::vector<user>,        users,          "users")
+LIGHTCONF_END_TYPE()
+
+}
+
+//
+//
+struct benchmark {
+    std::string         name;
+    size_t              bytes;
+    std::function<void ()> run;
+};
+
+//
+//
+volatile double sink;
+
+//
+// Best wall time over a few runs, in seconds
+double time_best(const std::function<void ()>& fn, int runs = 5) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration<double>(end - start).count();
+        if (secs < best) {
+            best = secs;
+        }
+    }
+    return best;
+}
+
+//
+// A .config document holding one big array of numbers in assorted notations
+std::string make_number_array(int count) {
+    std::string src = "numbers = [\n";
+    char buf[64];
+    unsigned int seed = 12345;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        switch (i % 4) {
+        case 0: snprintf(buf, sizeof(buf), "%u", seed % 100000); break;
+        case 1: snprintf(buf, sizeof(buf), "%.17g", seed / 4294967296.0); break;
+        case 2: snprintf(buf, sizeof(buf), "%.6f", (seed % 1000000) / 7.0); break;
+        default: snprintf(buf, sizeof(buf), "%.10e", (seed % 1000) * 1.5e-20); break;
+        }
+        src += "    ";
+        src += buf;
+        src += ",\n";
+    }
+    src += "]\n";
+    return src;
+}
+
+//
+// Every number token of the document, as the scanner would see it
+std::vector<std::string> split_numbers(const std::string& src) {
+    std::vector<std::string> out;
+    size_t pos = src.find('[') + 1;
+    while (true) {
+        size_t start = src.find_first_not_of(" \n,", pos);
+        if (start == std::string::npos || src[start] == ']') break;
+        size_t end = src.find_first_of(" \n,", start);
+        out.push_back(src.substr(start, end - start));
+        pos = end;
+    }
+    return out;
+}
+
+//
+// A JSON telemetry dump: one array of flat-ish event records
+std::string make_telemetry(int count) {
+    std::string src = "{\n  \"events\": [\n";
+    char buf[512];
+    unsigned int seed = 54321;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        snprintf(buf, sizeof(buf),
+            "    { \"id\": %d, \"host\": \"web-%02u.example.com\", \"service\": \"checkout\", "
+            "\"latency_ms\": %.3f, \"status\": %u, \"ok\": %s, \"tags\": [ \"prod\", \"eu-west-%u\" ], "
+            "\"message\": \"request completed in \\\"%u\\\" steps\" }%s\n",
+            i, seed % 64, (seed % 100000) / 7.0, 200 + seed % 4 * 100, seed % 7 ? "true" : "false",
+            seed % 3, seed % 50, i + 1 < count ? "," : "");
+        src += buf;
+    }
+    src += "  ]\n}\n";
+    return src;
+}
+
+//
+// Newline-delimited JSON: one small document per line
+std::string make_ndjson(int count) {
+    std::string src;
+    char buf[256];
+    for (int i = 0; i < count; i++) {
+        snprintf(buf, sizeof(buf),
+            "{ \"request\": %d, \"route\": \"/api/v%d/items\", \"timeout_ms\": %d, \"retry\": %s, "
+            "\"headers\": [ \"accept\", \"x-trace-%d\" ] }\n",
+            i, 1 + i % 3, 100 * (1 + i % 20), i % 2 ? "true" : "false", i % 97);
+        src += buf;
+    }
+    return src;
+}
+
+//
+// A .config document shaped like sample/users.config, with many more users
+std::string make_users(int count) {
+    std::string src = "users = [\n";
+    char buf[512];
+    for (int i = 0; i < count; i++) {
+        snprintf(buf, sizeof(buf),
+            "    {\n        uid = %d\n        first_name = \"First%d\"\n        last_name = \"Last%d\"\n"
+            "        permissions = [ \"READ\", \"CREATE\", \"UPDATE\" ]\n        join_date = [ %d, %d, %d ]\n    }\n",
+            i, i, i, 1 + i % 28, 1 + i % 12, 2000 + i % 20);
+        src += buf;
+    }
+    src += "]\nglobal = { maintainer = \"user\" }\n";
+    return src;
+}
+
+//
+// A directory of small .config fragments, as a service might read at boot. Returns the
+// directory and adds up the size of the files in *bytes.
+std::string make_fragments(int count, size_t *bytes) {
+    std::string dir = "/tmp/lightconf_bench_fragments";
+    std::string mkdir = "mkdir -p " + dir;
+    if (system(mkdir.c_str()) != 0) {
+        return dir;
+    }
+    *bytes = 0;
+    char name[64];
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "/%03d-fragment.config", i);
+        std::string src = "service" + std::to_string(i) + " = {\n" + make_users(20) + "}\n";
+        std::ofstream(dir + name) << src;
+        *bytes += src.size();
+    }
+    return dir;
+}
+
+//
+//
+std::vector<benchmark> make_benchmarks() {
+    std::vector<benchmark> benches;
+
+    static const std::string numbers_src = make_number_array(200000);
+    static const std::vector<std::string> numbers = split_numbers(numbers_src);
+
+    benches.push_back({ "numbers_strtod", numbers_src.size(), [] {
+        double sum = 0;
+        for (const auto& n : numbers) {
+            sum += strtod(n.c_str(), nullptr);
+        }
+        sink = sum;
+    } });
+    benches.push_back({ "numbers_parse_number", numbers_src.size(), [] {
+        double sum = 0;
+        for (const auto& n : numbers) {
+            double val = 0;
+            lightconf::parse_number(n.data(), n.data() + n.size(), &val);
+            sum += val;
+        }
+        sink = sum;
+    } });
+    benches.push_back({ "numbers_config_read", numbers_src.size(), [] {
+        lightconf::group grp = lightconf::config_format::read(numbers_src);
+        sink = grp.size();
+    } });
+    benches.push_back({ "numbers_config_parse", numbers_src.size(), [] {
+        struct sum_handler : lightconf::handler {
+            double sum = 0;
+            void on_number(double val) override { sum += val; }
+        } handler;
+        lightconf::config_format::parse(numbers_src, handler);
+        sink = handler.sum;
+    } });
+    benches.push_back({ "numbers_config_push", numbers_src.size(), [] {
+        lightconf::config_format::push_parser parser;
+        for (size_t i = 0; i < numbers_src.size(); i += 65536) {
+            parser.feed(numbers_src.data() + i, std::min<size_t>(65536, numbers_src.size() - i));
+        }
+        sink = parser.finish().size();
+    } });
+
+    static const std::string users_src = make_users(100000);
+
+    benches.push_back({ "users_config_read", users_src.size(), [] {
+        lightconf::group grp = lightconf::config_format::read(users_src);
+        sink = grp.size();
+    } });
+    benches.push_back({ "users_config_read_arena", users_src.size(), [] {
+        lightconf::arena mem;
+        lightconf::group grp = lightconf::config_format::read(users_src, mem);
+        sink = grp.size();
+    } });
+    benches.push_back({ "users_config_read_parallel", users_src.size(), [] {
+        lightconf::group grp = lightconf::config_format::read_parallel(users_src);
+        sink = grp.size();
+    } });
+    benches.push_back({ "users_config_read_lazy", users_src.size(), [] {
+        lightconf::group grp = lightconf::config_format::read_lazy(users_src);
+        sink = grp.get<std::string>("global.maintainer").size();
+    } });
+    benches.push_back({ "users_config_read_projected", users_src.size(), [] {
+        lightconf::group grp = lightconf::config_format::read(users_src, { "global.maintainer" });
+        sink = grp.get<std::string>("global.maintainer").size();
+    } });
+
+    benches.push_back({ "users_config_read_get", users_src.size(), [] {
+        lightconf::group grp = lightconf::config_format::read(users_src);
+        sink = grp.get<std::vector<user>>("users").size();
+    } });
+    benches.push_back({ "users_config_read_as", users_src.size(), [] {
+        user_list list = lightconf::config_format::read_as<user_list>(users_src);
+        sink = list.users.size();
+    } });
+
+    benches.push_back({ "users_config_elements", users_src.size(), [] {
+        auto users = lightconf::config_format::read_elements(users_src, "users");
+        size_t count = 0;
+        for (const lightconf::value& user : users) {
+            count += user.get<lightconf::group>().size();
+        }
+        sink = count;
+    } });
+
+    benches.push_back({ "users_config_to_json_dom", users_src.size(), [] {
+        std::string json = lightconf::json_format::write(lightconf::config_format::read(users_src));
+        sink = json.size();
+    } });
+    benches.push_back({ "users_config_to_json", users_src.size(), [] {
+        std::ostringstream out;
+        lightconf::config_to_json(users_src, out);
+        sink = out.tellp();
+    } });
+
+    static size_t fragment_bytes = 0;
+    static const std::string fragment_dir = make_fragments(400, &fragment_bytes);
+
+    benches.push_back({ "fragments_read_file", fragment_bytes, [] {
+        size_t count = 0;
+        for (const auto& filename : lightconf::find_files(fragment_dir)) {
+            count += lightconf::config_format::read_file(filename).size();
+        }
+        sink = count;
+    } });
+    benches.push_back({ "fragments_load_files", fragment_bytes, [] {
+        lightconf::thread_pool pool;
+        sink = lightconf::load_files(fragment_dir, pool).size();
+    } });
+
+    static const std::string telemetry_src = make_telemetry(50000);
+
+    benches.push_back({ "json_index", telemetry_src.size(), [] {
+        lightconf::structural_index index;
+        index.build(telemetry_src.data(), telemetry_src.size());
+        sink = index.size();
+    } });
+    benches.push_back({ "json_parse", telemetry_src.size(), [] {
+        lightconf::handler handler;
+        lightconf::json_format::parse(telemetry_src, handler);
+    } });
+    benches.push_back({ "json_parse_tokens", telemetry_src.size(), [] {
+        lightconf::handler handler;
+        lightconf::scanner sc;
+        sc.scan(telemetry_src.data(), telemetry_src.size(), lightconf::read_scanner_params);
+        lightconf::json_format::token_parser<lightconf::handler> parser(handler);
+        lightconf::parse_tokens(sc, parser);
+    } });
+    benches.push_back({ "json_read", telemetry_src.size(), [] {
+        lightconf::group grp = lightconf::json_format::read(telemetry_src);
+        sink = grp.size();
+    } });
+    benches.push_back({ "json_read_arena", telemetry_src.size(), [] {
+        lightconf::arena mem;
+        lightconf::group grp = lightconf::json_format::read(telemetry_src, mem);
+        sink = grp.size();
+    } });
+    benches.push_back({ "json_to_config_dom", telemetry_src.size(), [] {
+        std::string config = lightconf::config_format::write(lightconf::json_format::read(telemetry_src), "", 120);
+        sink = config.size();
+    } });
+    benches.push_back({ "json_to_config", telemetry_src.size(), [] {
+        std::ostringstream out;
+        lightconf::json_to_config(telemetry_src, out);
+        sink = out.tellp();
+    } });
+    static const std::string ndjson_src = make_ndjson(200000);
+
+    benches.push_back({ "ndjson_read_each", ndjson_src.size(), [] {
+        size_t count = 0;
+        for (size_t pos = 0, end; pos < ndjson_src.size(); pos = end + 1) {
+            end = ndjson_src.find('\n', pos);
+            count += lightconf::json_format::read(ndjson_src.data() + pos, end - pos).size();
+        }
+        sink = count;
+    } });
+    benches.push_back({ "ndjson_documents", ndjson_src.size(), [] {
+        lightconf::json_format::document_reader reader(ndjson_src.data(), ndjson_src.size());
+        lightconf::group doc;
+        size_t count = 0;
+        while (reader.next(&doc)) {
+            count += doc.size();
+        }
+        sink = count;
+    } });
+    benches.push_back({ "ndjson_documents_parallel", ndjson_src.size(), [] {
+        lightconf::thread_pool pool;
+        sink = lightconf::json_format::read_documents(ndjson_src, pool).size();
+    } });
+    benches.push_back({ "json_read_tokens", telemetry_src.size(), [] {
+        lightconf::scanner sc;
+        sc.scan(telemetry_src.data(), telemetry_src.size(), lightconf::read_scanner_params);
+        lightconf::group grp = lightconf::json_format::read_group(sc, false);
+        sink = grp.size();
+    } });
+
+    return benches;
+}
+
+//
+//
+int main(int argc, char *argv[]) {
+    std::vector<benchmark> benches = make_benchmarks();
+    for (const auto& b : benches) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++) {
+            selected |= b.name == argv[i];
+        }
+        if (!selected) continue;
+
+        double secs = time_best(b.run);
+        printf("%-32s %10.3f ms %10.1f MB/s\n", b.name.c_str(), secs * 1e3, b.bytes / secs / 1e6);
+    }
+}
@@ -0,0 +1,6 @@
+#ifndef _LIGHTCONF_OUTER_FILE_LOADER_H_
+#define _LIGHTCONF_OUTER_FILE_LOADER_H_
+
+#include "internal/file_loader.hpp"
+
+#endif // _LIGHTCONF_OUTER_FILE_LOADER_H_
@@ -0,0 +1,197 @@
+#ifndef _LIGHTCONF_ARENA_H_
+#define _LIGHTCONF_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lightconf {
+////////////////////
+
+// The size of the blocks an arena takes from the heap; anything bigger than a quarter of
+// one gets a block to itself
+const size_t arena_block_size = 64 * 1024;
+
+//
+// Memory for a whole document, handed out in order from large blocks and given back all
+// at once when the arena is destroyed, instead of one allocation at a time:
+//
+//     arena mem;
+//     group config = config_format::read(src, mem);
+//     ...
+//
+// Only the few objects that hold memory from the heap of their own, such as a string too
+// long to keep its characters inside itself, are destroyed with the arena, and only if
+// own() was called for them. Anything else made in it is simply forgotten.
+//
+// An arena has to outlive everything made in it, and can't be used from more than one
+// thread at once.
+class arena {
+public:
+    void *              allocate(size_t size, size_t align);
+    template <typename T, typename... Args>
+    T *                 make(Args&&... args);
+    template <typename T>
+    void                own(T *obj);
+    size_t              used() const { return used_; }
+
+    arena();
+    ~arena();
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+private:
+    struct block {
+        block *         next;
+    };
+    struct cleanup {
+        cleanup *       next;
+        void            (*destroy)(void *obj);
+        void *          obj;
+    };
+
+    template <typename T>
+    static void         destroy(void *obj) { static_cast<T *>(obj)->~T(); }
+
+    char *              ptr_;               // the free part of the current block
+    char *              end_;
+    block *             blocks_;
+    cleanup *           cleanups_;          // most recently owned first
+    size_t              used_;              // bytes handed out
+};
+
+//
+// A standard allocator over an arena, or over the heap if it has none. Deallocating from
+// an arena does nothing. A container copied from one in an arena gets the heap, so that
+// the copy doesn't depend on the arena; assigning or swapping containers never moves
+// their allocators.
+template <typename T>
+class arena_allocator {
+public:
+    typedef T               value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+
+    T *                 allocate(size_t n);
+    void                deallocate(T *p, size_t n);
+    arena_allocator     select_on_container_copy_construction() const { return arena_allocator(); }
+    arena *             mem() const { return mem_; }
+
+    bool                operator==(const arena_allocator& rhs) const { return mem_ == rhs.mem_; }
+    bool                operator!=(const arena_allocator& rhs) const { return mem_ != rhs.mem_; }
+
+    explicit arena_allocator(arena *mem) : mem_(mem) { }
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& rhs) : mem_(rhs.mem()) { }
+    arena_allocator() : mem_(nullptr) { }
+private:
+    arena *             mem_;
+};
+
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+void                    own_string(arena& mem, std::string *str);
+
+//
+//
+inline arena::arena() : ptr_(nullptr), end_(nullptr), blocks_(nullptr), cleanups_(nullptr), used_(0)
+{ }
+
+//
+//
+inline arena::~arena() {
+    for (cleanup *c = cleanups_; c; c = c->next) {
+        c->destroy(c->obj);
+    }
+    while (blocks_) {
+        block *next = blocks_->next;
+        ::operator delete(blocks_);
+        blocks_ = next;
+    }
+}
+
+//
+// align has to be a power of two
+inline void *arena::allocate(size_t size, size_t align) {
+    uintptr_t p = ((uintptr_t)ptr_ + align - 1) & ~(uintptr_t)(align - 1);
+    if (ptr_ && p + size <= (uintptr_t)end_) {
+        ptr_ = (char *)(p + size);
+        used_ += size;
+        return (void *)p;
+    }
+
+    if (size + align > arena_block_size / 4) {
+        // behind the current block, which still has room for smaller things
+        block *b = (block *)::operator new(sizeof(block) + size + align);
+        if (blocks_) {
+            b->next = blocks_->next;
+            blocks_->next = b;
+        } else {
+            b->next = nullptr;
+            blocks_ = b;
+        }
+        used_ += size;
+        return (void *)(((uintptr_t)(b + 1) + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    block *b = (block *)::operator new(arena_block_size);
+    b->next = blocks_;
+    blocks_ = b;
+    ptr_ = (char *)(b + 1);
+    end_ = (char *)b + arena_block_size;
+    return allocate(size, align);
+}
+
+//
+// Constructs a T in the arena. It isn't destroyed unless it is given to own().
+template <typename T, typename... Args>
+inline T *arena::make(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+//
+// Has obj, which was made in the arena, destroyed when the arena is. Objects are
+// destroyed in the reverse of the order they were given.
+template <typename T>
+inline void arena::own(T *obj) {
+    cleanups_ = make<cleanup>(cleanup{ cleanups_, &arena::destroy<T>, obj });
+}
+
+//
+//
+template <typename T>
+inline T *arena_allocator<T>::allocate(size_t n) {
+    if (mem_) {
+        return static_cast<T *>(mem_->allocate(n * sizeof(T), alignof(T)));
+    }
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+}
+
+//
+//
+template <typename T>
+inline void arena_allocator<T>::deallocate(T *p, size_t n) {
+    if (!mem_) {
+        ::operator delete(p);
+    }
+}
+
+//
+// Owns str, made in mem, if it keeps its characters on the heap. One short enough to
+// keep them inside itself doesn't need destroying.
+inline void own_string(arena& mem, std::string *str) {
+    static const size_t local_capacity = std::string().capacity();
+    if (str->capacity() > local_capacity) {
+        mem.own(str);
+    }
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_ARENA_H_
@@ -0,0 +1,322 @@
+#ifndef _LIGHTCONF_ATOM_H_
+#define _LIGHTCONF_ATOM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+#include "string_ref.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// The text of an atom and its hash. An interned one is shared by every atom with the
+// same text and lives as long as the process; a borrowed one lives in an arena; any
+// other belongs to a single atom.
+struct atom_data {
+    std::string         str;
+    size_t              hash;
+    bool                interned;
+    bool                borrowed;
+};
+
+//
+// A key, as the parts of a path and the keys of a group hold it. Text is interned the
+// first time it is made into an atom, in a table shared by the whole process, and every
+// atom for the same text after that points to the one copy of it. Interned atoms are
+// copied by copying a pointer and compared by comparing pointers, and each carries its
+// hash, so a key that turns up in every record of a document is stored once and found
+// without looking at its characters.
+//
+// Interning is safe from any number of threads at once; looking up text that is already
+// interned takes no lock. Once the table holds atom_table_limit() texts, or if the
+// limit is set to 0, atoms for new text keep a copy of their own instead, and are
+// copied and compared as strings would be. The limit keeps documents that aren't
+// trusted from growing the table without bound. A group in an arena keeps the copies of
+// such keys in the arena too; copying one of those atoms gives one with a copy of its
+// own again.
+class atom {
+public:
+    const std::string&  str() const;
+    size_t              hash() const                        { return data_ ? data_->hash : 0; }
+    size_t              size() const                        { return str().size(); }
+    bool                empty() const                       { return !data_; }
+    bool                interned() const                    { return data_ && data_->interned; }
+    operator const std::string&() const                     { return str(); }
+
+    bool                operator==(const atom& rhs) const;
+    bool                operator!=(const atom& rhs) const   { return !(*this == rhs); }
+    bool                operator<(const atom& rhs) const    { return str() < rhs.str(); }
+    bool                operator<=(const atom& rhs) const   { return str() <= rhs.str(); }
+    bool                operator>(const atom& rhs) const    { return str() > rhs.str(); }
+    bool                operator>=(const atom& rhs) const   { return str() >= rhs.str(); }
+
+    atom&               operator=(const atom& rhs);
+    atom&               operator=(atom&& rhs) noexcept;
+    void                swap(atom& rhs)                     { std::swap(data_, rhs.data_); }
+
+    explicit atom(string_ref text);
+    atom(const std::string& text);
+    atom(const char *text);
+    atom(const atom& rhs);
+    atom(const atom& rhs, arena& mem);
+    atom(atom&& rhs) noexcept;
+    atom();
+    ~atom();
+
+private:
+    const atom_data *   data_;              // null for the empty atom
+};
+
+bool                    operator==(const atom& lhs, const std::string& rhs);
+bool                    operator==(const std::string& lhs, const atom& rhs);
+bool                    operator==(const atom& lhs, const char *rhs);
+bool                    operator==(const char *lhs, const atom& rhs);
+bool                    operator!=(const atom& lhs, const std::string& rhs);
+bool                    operator!=(const std::string& lhs, const atom& rhs);
+bool                    operator!=(const atom& lhs, const char *rhs);
+bool                    operator!=(const char *lhs, const atom& rhs);
+
+const size_t default_atom_table_limit = 65536;
+
+size_t                  atom_table_limit();
+void                    set_atom_table_limit(size_t limit);
+size_t                  atom_table_size();
+size_t                  hash_key(string_ref text);
+const atom_data *       intern_atom(string_ref text, size_t hash);
+
+//
+// An open-addressing table of the interned atoms, with slots that can be read while
+// another thread is adding to it. It is only ever added to, and a full one is replaced
+// by a bigger copy rather than grown in place.
+struct atom_table {
+    std::unique_ptr<std::atomic<const atom_data *>[]> slots;
+    size_t              mask;
+
+    explicit atom_table(size_t capacity) :
+        slots(new std::atomic<const atom_data *>[capacity]()),
+        mask(capacity - 1)
+    { }
+};
+
+//
+// The interned atoms of the process. The tables it replaced are kept, since another
+// thread may still be looking through one.
+struct atom_registry {
+    std::atomic<atom_table *> table;
+    std::atomic<size_t> limit;
+    std::mutex          mutex;              // held while adding
+    size_t              size;
+    std::vector<std::unique_ptr<atom_table>> tables;
+
+    static atom_registry& get();
+
+    atom_registry() : table(nullptr), limit(default_atom_table_limit), mutex(), size(0), tables() { }
+};
+
+//
+// Never destroyed, so that atoms in objects destroyed at exit can still be used
+inline atom_registry& atom_registry::get() {
+    static atom_registry *registry = new atom_registry();
+    return *registry;
+}
+
+//
+//
+inline size_t atom_table_limit() {
+    return atom_registry::get().limit.load(std::memory_order_relaxed);
+}
+
+//
+// Atoms already interned stay that way
+inline void set_atom_table_limit(size_t limit) {
+    atom_registry::get().limit.store(limit, std::memory_order_relaxed);
+}
+
+//
+// The number of texts interned so far
+inline size_t atom_table_size() {
+    atom_registry& registry = atom_registry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return registry.size;
+}
+
+//
+// FNV-1a, with the high bits folded in so that the low ones can index a table
+inline size_t hash_key(string_ref text) {
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : text) {
+        h = (h ^ (unsigned char)c) * 1099511628211ULL;
+    }
+    return (size_t)(h ^ (h >> 32));
+}
+
+//
+// The interned data for text, or null if it isn't interned and the table is full
+inline const atom_data *intern_atom(string_ref text, size_t hash) {
+    atom_registry& registry = atom_registry::get();
+    atom_table *table = registry.table.load(std::memory_order_acquire);
+    size_t slot = 0;
+    if (table) {
+        for (slot = hash & table->mask; const atom_data *data = table->slots[slot].load(std::memory_order_acquire);
+                slot = (slot + 1) & table->mask) {
+            if (data->hash == hash && text == string_ref(data->str)) {
+                return data;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (table != registry.table.load(std::memory_order_relaxed)) {
+        table = registry.table.load(std::memory_order_relaxed);
+        slot = hash & table->mask;
+    }
+    if (table) {
+        // carry on from the empty slot, which another thread may have filled since
+        for (; const atom_data *data = table->slots[slot].load(std::memory_order_relaxed);
+                slot = (slot + 1) & table->mask) {
+            if (data->hash == hash && text == string_ref(data->str)) {
+                return data;
+            }
+        }
+    }
+    if (registry.size >= registry.limit.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    if (!table || (registry.size + 1) * 2 > table->mask + 1) {
+        std::unique_ptr<atom_table> bigger(new atom_table(table ? (table->mask + 1) * 2 : 1024));
+        for (size_t i = 0; table && i <= table->mask; i++) {
+            if (const atom_data *data = table->slots[i].load(std::memory_order_relaxed)) {
+                size_t j = data->hash & bigger->mask;
+                while (bigger->slots[j].load(std::memory_order_relaxed)) {
+                    j = (j + 1) & bigger->mask;
+                }
+                bigger->slots[j].store(data, std::memory_order_relaxed);
+            }
+        }
+        table = bigger.get();
+        registry.tables.push_back(std::move(bigger));
+        registry.table.store(table, std::memory_order_release);
+        for (slot = hash & table->mask; table->slots[slot].load(std::memory_order_relaxed); slot = (slot + 1) & table->mask) { }
+    }
+
+    const atom_data *data = new atom_data{ text.str(), hash, true, false };
+    table->slots[slot].store(data, std::memory_order_release);
+    registry.size++;
+    return data;
+}
+
+//
+//
+inline atom::atom(string_ref text) : data_(nullptr) {
+    if (text.empty()) {
+        return;
+    }
+    size_t hash = hash_key(text);
+    data_ = intern_atom(text, hash);
+    if (!data_) {
+        data_ = new atom_data{ text.str(), hash, false, false };
+    }
+}
+
+//
+//
+inline atom::atom(const std::string& text) : atom(string_ref(text))
+{ }
+
+//
+//
+inline atom::atom(const char *text) : atom(string_ref(text))
+{ }
+
+//
+//
+inline atom::atom(const atom& rhs) :
+    data_(rhs.data_ && !rhs.data_->interned ? new atom_data{ rhs.data_->str, rhs.data_->hash, false, false } : rhs.data_)
+{ }
+
+//
+// An interned atom is shared as ever; any other is copied into mem
+inline atom::atom(const atom& rhs, arena& mem) : data_(rhs.data_) {
+    if (data_ && !data_->interned) {
+        atom_data *data = mem.make<atom_data>(atom_data{ data_->str, data_->hash, false, true });
+        own_string(mem, &data->str);
+        data_ = data;
+    }
+}
+
+//
+//
+inline atom::atom(atom&& rhs) noexcept : data_(rhs.data_) {
+    rhs.data_ = nullptr;
+}
+
+//
+//
+inline atom::atom() : data_(nullptr)
+{ }
+
+//
+//
+inline atom::~atom() {
+    if (data_ && !data_->interned && !data_->borrowed) {
+        delete data_;
+    }
+}
+
+//
+//
+inline atom& atom::operator=(const atom& rhs) {
+    atom copy(rhs);
+    swap(copy);
+    return *this;
+}
+
+//
+//
+inline atom& atom::operator=(atom&& rhs) noexcept {
+    atom moved(std::move(rhs));
+    swap(moved);
+    return *this;
+}
+
+//
+//
+inline const std::string& atom::str() const {
+    static const std::string empty;
+    return data_ ? data_->str : empty;
+}
+
+//
+// Two interned atoms are the same text only if they are the same atom
+inline bool atom::operator==(const atom& rhs) const {
+    if (data_ == rhs.data_) {
+        return true;
+    }
+    if (!data_ || !rhs.data_ || (data_->interned && rhs.data_->interned)) {
+        return false;
+    }
+    return data_->hash == rhs.data_->hash && data_->str == rhs.data_->str;
+}
+
+//
+// An atom compared with text compares its text
+inline bool operator==(const atom& lhs, const std::string& rhs)    { return lhs.str() == rhs; }
+inline bool operator==(const std::string& lhs, const atom& rhs)    { return lhs == rhs.str(); }
+inline bool operator==(const atom& lhs, const char *rhs)           { return lhs.str() == rhs; }
+inline bool operator==(const char *lhs, const atom& rhs)           { return lhs == rhs.str(); }
+inline bool operator!=(const atom& lhs, const std::string& rhs)    { return !(lhs == rhs); }
+inline bool operator!=(const std::string& lhs, const atom& rhs)    { return !(lhs == rhs); }
+inline bool operator!=(const atom& lhs, const char *rhs)           { return !(lhs == rhs); }
+inline bool operator!=(const char *lhs, const atom& rhs)           { return !(lhs == rhs); }
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_ATOM_H_
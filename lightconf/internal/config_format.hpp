@@ -2,335 +2,1060 @@
 #define _LIGHTCONF_CONFIG_FORMAT_H_
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
+#include "element_reader.hpp"
 #include "group.hpp"
+#include "group_builder.hpp"
+#include "handler.hpp"
+#include "lazy_value.hpp"
+#include "mapped_file.hpp"
+#include "projection.hpp"
+#include "push_parser.hpp"
+#include "read_limits.hpp"
 #include "scanner.hpp"
+#include "thread_pool.hpp"
 #include "util.hpp"
+#include "value_source.hpp"
 #include "writer.hpp"
 
 namespace lightconf { namespace config_format {
 ////////////////////
 
+//
+// The .config grammar as a state machine that is handed one significant token at a
+// time, so it can run on input that arrives in pieces. What it parses is reported to
+// the handler as events (see handler; group_builder is the one that builds a group).
+// It accepts exactly what read_group(sc, false) accepts and fails with the same errors.
+template <typename Handler>
+class token_parser {
+public:
+    typedef Handler     handler_type;
+
+    void                feed(const scanner& sc, const token& tok);
+    bool                done() const        { return state_ == state::done; }
+
+    explicit token_parser(Handler& handler, const read_limits& limits = default_read_limits);
+private:
+    enum class state { start, key, equals, value, group_comma, group_close, vector_entry, vector_comma, done };
+    enum class frame { root, group, vector };
+
+    void                end_container();
+    void                read_scalar(const scanner& sc, const token& tok);
+
+    Handler&            handler_;
+    state               state_;
+    std::vector<frame>  stack_;
+    limit_checker       check_;
+};
+
+typedef basic_group_push_parser<token_parser> push_parser;
+typedef basic_push_parser<token_parser<handler>> event_push_parser;
+
+//
+// The .config syntax for basic_element_reader
+struct element_syntax {
+    static bool         seek(scanner& sc, const path& p, size_t index, bool braces);
+    static bool         next(scanner& sc, value *out);
+};
+
+typedef basic_element_reader<element_syntax> element_reader;
+
+//
+// Reads one level of a document, turning each bracketed value in it into a lazy value
+// that is read the same way, one more level, when something first looks at it. The
+// end of a bracketed value is found with skip_brackets(); one that it can't find the
+// end of is read there and then. See read_lazy().
+class lazy_reader {
+public:
+    group               read_group(bool braces);
+    value_vector_type   read_vector();
+    value               read_value();
+    void                expect_end();
+
+    lazy_reader(const std::shared_ptr<const lazy_document>& doc, size_t first, size_t last, int line, int col);
+private:
+    void                locate(unsigned int pos);
+
+    std::shared_ptr<const lazy_document> doc_;
+    scanner             sc_;
+    size_t              first_;
+    size_t              last_;
+    unsigned int        located_;           // where line_ and col_ were last worked out
+    int                 line_;
+    int                 col_;
+};
+
+//
+// Writes the document that a parser reports to it as .config text, the way write() lays
+// out a group, without building one. Output goes to the stream as it is written, apart
+// from the values whose layout isn't known yet: whether a group or vector goes on one
+// line depends on how long it is, so its events are held until either it has passed
+// wrap_length or it has ended. That is never much more than wrap_length characters.
+//
+// The keys are written as they come, so a key that appears more than once is written
+// each time, where a group would keep only the last value. A key that isn't a .config
+// identifier, such as a JSON key with a '.' in it, is a value_error.
+class event_writer : public handler {
+public:
+    void                begin_group() override;
+    void                end_group() override;
+    void                begin_vector() override;
+    void                end_vector() override;
+    void                on_key(string_ref key) override;
+    void                on_number(double val) override;
+    void                on_string(string_ref val) override;
+    void                on_bool(bool val) override;
+
+    void                flush();
+
+    explicit event_writer(std::ostream& out, int wrap_length = 120);
+private:
+    enum class event_type { begin_group, end_group, begin_vector, end_vector, key, scalar };
+    enum class layout { undecided, one_line, wrapped };
+
+    struct event {
+        event_type      type;
+        std::string     text;               // of a key or scalar, as it is written
+        layout          wrap;               // of a group or vector that begins here
+    };
+
+    // A group or vector that the parser is in
+    struct open_frame {
+        bool            is_vector;
+        size_t          begin;              // its begin event, counting every event so far
+        size_t          start;              // length_ as it began
+    };
+
+    // A group or vector that the output is in
+    struct output_frame {
+        bool            is_vector;
+        bool            braces;
+        bool            wrap;
+        size_t          count;              // entries written
+    };
+
+    void                add(event_type type, std::string text);
+    void                decide();
+    void                write(const event& ev);
+    void                separate();
+
+    std::ostream&       out_;
+    writer              wr_;
+    std::deque<event>   held_;
+    size_t              held_first_;        // the number of the first held event
+    size_t              events_;
+    size_t              length_;            // as group_length() counts it, of all events so far
+    size_t              undecided_;         // the outermost open_ frame whose layout isn't known yet
+    std::vector<open_frame> open_;
+    std::vector<output_frame> output_;
+};
+
+//
+// The .config syntax as a value_source over a scanner, for read_as(). It accepts what
+// read_group(sc, false) does, starting with the document's own group, which has no
+// braces.
+class scanner_source : public value_source {
+public:
+    value_type          peek_type() override;
+    double              read_number() override;
+    void                read_string(std::string *out) override;
+    bool                read_bool() override;
+    void                read_group(group *out) override;
+    void                read_vector(value_vector_type *out) override;
+    void                read_value(value *out) override;
+    void                skip_value() override;
+
+    void                begin_group() override;
+    bool                next_key(std::string *key) override;
+    void                begin_vector() override;
+    bool                next_element() override;
+
+    explicit scanner_source(scanner& sc, const read_limits& limits = default_read_limits);
+private:
+    struct frame {
+        bool            braces;
+        bool            first;              // nothing read in it yet
+    };
+
+    void                enter();
+
+    scanner&            sc_;
+    limit_checker       check_;
+    std::vector<frame>  stack_;
+    bool                root_;              // whether the document's group is next
+};
+
+// The smallest range read_parallel() hands to a thread on its own
+const size_t parallel_chunk_size = 64 * 1024;
+
+//
+// Reads one document on a thread_pool. A quick pass over the text matches brackets to
+// cut it into ranges of whole entries, without parsing what is inside them; an entry
+// whose value is big enough is cut up in turn, into ranges of its own entries or
+// elements. The ranges are parsed on the pool and the results put back together in
+// document order. See read_parallel().
+class parallel_reader {
+public:
+    group               read(const char *input, size_t size);
+
+    parallel_reader(thread_pool& pool, size_t chunk_size);
+private:
+    // Either a range of whole entries of a group or vector, parsed as one job, or an
+    // entry whose value is split into ranges (and maybe split entries) of its own.
+    // Pieces are listed in document order, each split entry before its contents.
+    struct piece {
+        const char *    first;
+        const char *    last;
+        bool            split;
+        bool            is_vector;          // of the range's entries, or the split value
+        int             parent;             // split entry it belongs to, or -1
+        std::string     key;                // of a split entry in a group
+        group           grp;
+        value_vector_type vec;
+        group *         dst_grp;            // where a split entry's contents go
+        value_vector_type *dst_vec;
+    };
+
+    bool                split(const char *first, const char *last, bool is_vector, int parent, int depth);
+    void                add_piece(const char *first, const char *last, bool split, bool is_vector, int parent);
+    void                parse(piece& p);
+    group               stitch();
+
+    thread_pool&        pool_;
+    size_t              chunk_size_;
+    std::vector<piece>  pieces_;
+    std::atomic<bool>   failed_;
+};
+
+
+enum class read_step { value, entry, element, close };
+enum class write_step { open, source, source_done, rest, rest_done, close };
+
+//
+// A group or vector that write_nested() is in the middle of. sc is where it is in the
+// old document, or nullptr if it is being written from scratch.
+struct write_frame {
+    write_step          step;
+    scanner *           sc;
+    const group *       grp;
+    const value_vector_type *vec;
+    bool                braces;
+    bool                wrap;
+    bool                written;            // whether the last entry from the old document was kept
+    std::vector<std::string> keys;          // keys of grp not yet written
+    size_t              index;              // the next element of vec
+    size_t              rest_index;         // the next of keys, once the old document is done
+
+    write_frame(scanner *sc, const group *grp, const value_vector_type *vec) :
+        step(write_step::open), sc(sc), grp(grp), vec(vec), braces(true), wrap(false), written(false),
+        keys(), index(0), rest_index(0)
+    { }
+};
 
 group                   read_group(scanner& sc, bool braces);
 value_vector_type       read_vector(scanner& sc);
 value                   read_value(scanner& sc);
+group                   read_group(scanner& sc, bool braces, limit_checker& check, arena *mem = nullptr);
+value_vector_type       read_vector(scanner& sc, limit_checker& check);
+value                   read_value(scanner& sc, limit_checker& check);
+void                    read_nested(scanner& sc, std::vector<build_frame>& stack, read_step step, limit_checker& check,
+                            arena *mem = nullptr);
+read_step               add_value(scanner& sc, build_frame& top, value&& val);
+value                   read_scalar(scanner& sc, limit_checker& check, arena *mem = nullptr);
+group                   read_group(scanner& sc, bool braces, const projection& proj);
+void                    skip_value(scanner& sc);
 
 void                    write_group(scanner& sc, writer& wr, bool braces, const group& gr);
 void                    write_vector(scanner& sc, writer& wr, const value_vector_type& vec);
 void                    write_value(scanner& sc, writer& wr, const value& val);
+void                    write_nested(writer& wr, std::vector<write_frame>& stack);
+void                    begin_value(scanner *sc, writer& wr, const value& val, std::vector<write_frame>& stack);
 
 int                     value_length(const value& val, int wrap_length = 120);
 int                     group_length(const group& gr, int wrap_length = 120);
 int                     vector_length(const value_vector_type& vec, int wrap_length = 120);
+bool                    fits_in(const group& gr, int wrap_length);
+bool                    fits_in(const value_vector_type& vec, int wrap_length);
+int                     outer_length(const group& gr, std::vector<const value *>& pending);
+int                     outer_length(const value_vector_type& vec, std::vector<const value *>& pending);
+int                     nested_length(std::vector<const value *>& pending, int sum, int limit);
 
 scanner                 make_scanner(const std::string& input);
+void                    parse_lazy(const lazy_span& span, value *out);
 
 group                   read(const std::string& src);
+group                   read(const std::string& src, const std::vector<path>& paths);
+element_reader          read_elements(const std::string& src, const path& p);
+element_reader          read_file_elements(const std::string& filename, const path& p);
+group                   read(std::istream& in);
+group                   read_fd(int fd);
+group                   read_file(const std::string& filename);
+group                   read(const std::string& src, arena& mem);
+group                   read_file(const std::string& filename, arena& mem);
+group                   read_limited(const char *src, size_t size, const read_limits& limits);
+group                   read_limited(const std::string& src, const read_limits& limits);
+group                   read_file_limited(const std::string& filename, const read_limits& limits);
+group                   read_parallel(const std::string& src, unsigned int threads = 0);
+group                   read_parallel(const std::string& src, thread_pool& pool, size_t chunk_size = 0);
+group                   read_file_parallel(const std::string& filename, unsigned int threads = 0);
+group                   read_lazy(const std::string& src);
+group                   read_file_lazy(const std::string& filename);
+template <typename T>
+T                       read_as(const std::string& src);
+template <typename T>
+T                       read_file_as(const std::string& filename);
+template <typename T>
+T                       read_as(scanner& sc);
+void                    parse(const std::string& src, handler& h);
+void                    parse(std::istream& in, handler& h);
+void                    parse_file(const std::string& filename, handler& h);
 std::string             write(const group& grp, const std::string& src, int wrap_length = 120);
 
 //
 //
-inline group read_group(scanner& sc, bool braces) {
-    group grp;
-    if (braces) {
-        sc.expect('{');
-    }
-    while (sc.peek_token().type != token_type::eof_token && !(braces && sc.peek_token().is_char('}'))) {
-        std::string key = sc.expect_identifier();
-        sc.expect('=');
-        value val = read_value(sc);
-        grp.set(key, val);
+template <typename Handler>
+inline token_parser<Handler>::token_parser(Handler& handler, const read_limits& limits) :
+    handler_(handler),
+    state_(state::start),
+    stack_(),
+    check_(limits)
+{ }
 
-        sc.expect(',', true);
-        if (braces && sc.peek_token().is_char('}')) {
-            sc.expect('}');
-            break;
+//
+// Each pass round the loop either consumes the token or moves to the state that will,
+// mirroring the points where read_group and read_vector peek without consuming
+template <typename Handler>
+inline void token_parser<Handler>::feed(const scanner& sc, const token& tok) {
+    while (true) {
+        switch (state_) {
+        case state::start:
+            check_.enter(sc, tok.pos, 1);
+            check_.node(sc, tok.pos);
+            handler_.begin_group();
+            stack_.push_back(frame::root);
+            state_ = state::key;
+            continue;
+
+        case state::key:
+            if (tok.type == token_type::eof_token || (stack_.back() == frame::group && tok.is_char('}'))) {
+                // the closing brace is left for the enclosing group to consume
+                handler_.end_group();
+                end_container();
+                continue;
+            }
+            if (tok.type != token_type::identifier_token) {
+                sc.fail("expected identifier but found " + token_name(tok), tok.pos);
+            }
+            check_.string(sc, tok.pos, sc.token_text(tok).size());
+            handler_.on_key(sc.token_text(tok));
+            state_ = state::equals;
+            return;
+
+        case state::equals:
+            if (!tok.is_char('=')) {
+                sc.fail("expected '=' but found " + token_name(tok), tok.pos);
+            }
+            state_ = state::value;
+            return;
+
+        case state::value:
+            check_.node(sc, tok.pos);
+            if (tok.is_char('{') || tok.is_char('[')) {
+                check_.enter(sc, tok.pos, stack_.size() + 1);
+            }
+            if (tok.is_char('{')) {
+                handler_.begin_group();
+                stack_.push_back(frame::group);
+                state_ = state::key;
+            } else if (tok.is_char('[')) {
+                handler_.begin_vector();
+                stack_.push_back(frame::vector);
+                state_ = state::vector_entry;
+            } else {
+                read_scalar(sc, tok);
+                state_ = stack_.back() == frame::vector ? state::vector_comma : state::group_comma;
+            }
+            return;
+
+        case state::group_comma:
+            state_ = state::group_close;
+            if (tok.is_char(',')) {
+                return;
+            }
+            continue;
+
+        case state::group_close:
+            if (stack_.back() == frame::group && tok.is_char('}')) {
+                handler_.end_group();
+                end_container();
+                return;
+            }
+            state_ = state::key;
+            continue;
+
+        case state::vector_entry:
+            if (tok.is_char(']')) {
+                handler_.end_vector();
+                end_container();
+                return;
+            }
+            state_ = state::value;
+            continue;
+
+        case state::vector_comma:
+            state_ = state::vector_entry;
+            if (tok.is_char(',')) {
+                return;
+            }
+            continue;
+
+        case state::done:
+            return;
         }
     }
-
-    return grp;
 }
 
 //
 //
-inline value_vector_type read_vector(scanner& sc) {
-    sc.expect('[');
-    value_vector_type vec;
-    while (!sc.peek_token().is_char(']')) {
-        vec.push_back(read_value(sc));
-        sc.expect(',', true);
+template <typename Handler>
+inline void token_parser<Handler>::end_container() {
+    stack_.pop_back();
+    if (stack_.empty()) {
+        state_ = state::done;
+    } else {
+        state_ = stack_.back() == frame::vector ? state::vector_comma : state::group_comma;
     }
-    sc.expect(']');
-    return vec;
 }
 
 //
 //
-inline value read_value(scanner& sc) {
-    if (sc.peek_token().is_char('{')) {
-        return value(read_group(sc, true));
-    } else if (sc.peek_token().is_char('[')) {
-        return value(read_vector(sc));
-    } else {
-        switch (sc.peek_token().type) {
-        case token_type::identifier_token: {
-            std::string ident = sc.expect_identifier();
-            if (ident == "true") {
-                return value(true);
-            } else if (ident == "false") {
-                return value(false);
-            } else {
-                sc.fail("unexpected identifier", sc.peek_token().line, sc.peek_token().col);
-            }
-            break;
-        }
-        case token_type::string_token: {
-            std::string str = sc.expect_string();
-            return value(str);
-        }
-        case token_type::number_token: {
-            double dbl = sc.expect_number();
-            return value(dbl);
-        }
-        case token_type::char_token: {
-            sc.fail("unexpected '" + std::string(1, sc.peek_token().char_value) + "'",
-                sc.peek_token().line, sc.peek_token().col);
-            break;
-        }
-        default: {
-            sc.fail("unexpected token", sc.peek_token().line, sc.peek_token().col);
-            break;
-        }
-
+template <typename Handler>
+inline void token_parser<Handler>::read_scalar(const scanner& sc, const token& tok) {
+    switch (tok.type) {
+    case token_type::identifier_token: {
+        string_ref ident = sc.token_text(tok);
+        if (ident == "true") {
+            handler_.on_bool(true);
+        } else if (ident == "false") {
+            handler_.on_bool(false);
+        } else {
+            sc.fail("unexpected identifier", tok.pos);
         }
+        break;
+    }
+    case token_type::string_token:
+        check_.string(sc, tok.pos, sc.token_text(tok).size());
+        handler_.on_string(sc.token_text(tok));
+        break;
+    case token_type::number_token:
+        handler_.on_number(tok.number_value);
+        break;
+    case token_type::char_token:
+        sc.fail("unexpected '" + std::string(1, tok.char_value) + "'", tok.pos);
+        break;
+    default:
+        sc.fail("unexpected token", tok.pos);
+        break;
     }
-    return value();
 }
 
 //
 //
-inline void write_group(scanner& sc, writer& wr, bool braces, const group& gr) {
-    bool wrap = !braces || group_length(gr) > wr.wrap_length;
+inline group read_group(scanner& sc, bool braces) {
+    limit_checker check;
+    return read_group(sc, braces, check);
+}
+
+//
+//
+inline value_vector_type read_vector(scanner& sc) {
+    limit_checker check;
+    return read_vector(sc, check);
+}
+
+//
+//
+inline value read_value(scanner& sc) {
+    limit_checker check;
+    return read_value(sc, check);
+}
 
+//
+//
+inline group read_group(scanner& sc, bool braces, limit_checker& check, arena *mem) {
+    std::vector<build_frame> stack;
+    stack.push_back(build_frame(mem));
+    stack[0].braces = braces;
+    check.enter(sc, sc.peek_token().pos, 1);
+    check.node(sc, sc.peek_token().pos);
     if (braces) {
-        wr.append("{ ");
-        wr.indent();
-        if (wrap) {
-            wr.newline();
-        }
         sc.expect('{');
     }
+    read_nested(sc, stack, read_step::entry, check, mem);
+    return std::move(stack[0].grp);
+}
 
-    std::vector<std::string> keys;
-    for (const auto& key : gr) {
-        keys.push_back(key);
-    }
+//
+//
+inline value_vector_type read_vector(scanner& sc, limit_checker& check) {
+    std::vector<build_frame> stack(1);
+    stack[0].is_vector = true;
+    check.enter(sc, sc.peek_token().pos, 1);
+    check.node(sc, sc.peek_token().pos);
+    sc.expect('[');
+    read_nested(sc, stack, read_step::element, check);
+    return std::move(stack[0].vec);
+}
 
-    while (sc.peek_token().type != token_type::eof_token && !(braces && sc.peek_token().is_char('}'))) {
-        std::string key = sc.expect_identifier();
-        sc.expect('=');
+//
+//
+inline value read_value(scanner& sc, limit_checker& check) {
+    const token& tok = sc.peek_token();
+    if (!tok.is_char('{') && !tok.is_char('[')) {
+        return read_scalar(sc, check);
+    }
+    std::vector<build_frame> stack;
+    read_nested(sc, stack, read_step::value, check);
+    return stack[0].is_vector ? value(std::move(stack[0].vec)) : value(std::move(stack[0].grp));
+}
 
-        auto key_it = std::find(std::begin(keys), std::end(keys), key);
-        if (key_it != keys.end()) {
-            wr.append(key);
-            wr.append(" = ");
-            write_value(sc, wr, gr.get<value>(*key_it));
-            keys.erase(key_it);
-            bool terminate = sc.peek_token().is_char('}') && keys.empty();
-            if (!terminate) {
-                if (wrap) {
-                    wr.newline();
-                } else {
-                    wr.append(", ");
-                }
-            } else if (!wrap) {
-                wr.append(" ");
+//
+// The loop behind read_group(), read_vector() and read_value(). The groups and vectors
+// being read are kept on an explicit stack rather than the C++ stack, so that however
+// deeply a document nests, only max_depth limits it. It starts at step with the stack
+// as the caller left it, and stops once the frame at the bottom is finished, leaving it
+// there. What is read is made in mem, if there is one.
+inline void read_nested(scanner& sc, std::vector<build_frame>& stack, read_step step, limit_checker& check,
+        arena *mem) {
+    while (true) {
+        switch (step) {
+        case read_step::value: {
+            const token& tok = sc.peek_token();
+            if (tok.is_char('{') || tok.is_char('[')) {
+                check.enter(sc, tok.pos, stack.size() + 1);
+                check.node(sc, tok.pos);
+                stack.push_back(build_frame(mem));
+                stack.back().is_vector = tok.is_char('[');
+                step = tok.is_char('[') ? read_step::element : read_step::entry;
+                sc.expect(stack.back().is_vector ? '[' : '{');
+            } else {
+                step = add_value(sc, stack.back(), read_scalar(sc, check, mem));
             }
-        } else {
-            read_value(sc);
+            break;
         }
 
-        sc.expect(',', true);
-        if (braces && sc.peek_token().is_char('}')) {
+        case read_step::entry: {
+            build_frame& top = stack.back();
+            const token& tok = sc.peek_token();
+            if (tok.type == token_type::eof_token || (top.braces && tok.is_char('}'))) {
+                // the closing brace of an empty group is left for the enclosing group
+                step = read_step::close;
+                break;
+            }
+            unsigned int pos = tok.pos;
+            top.key = sc.expect_identifier();
+            check.string(sc, pos, top.key.size());
+            sc.expect('=');
+            step = read_step::value;
             break;
         }
-    }
 
-    unsigned int i = 0;
-    for (const auto& key : keys) {
-        wr.append(key);
-        wr.append(" = ");
-        scanner dummy_scanner = make_scanner("0");
-        write_value(dummy_scanner, wr, gr.get<value>(key));
-        if (i < keys.size() - 1) {
-            if (wrap) {
-                wr.newline();
+        case read_step::element:
+            if (sc.peek_token().is_char(']')) {
+                sc.expect(']');
+                step = read_step::close;
             } else {
-                wr.append(", ");
+                step = read_step::value;
+            }
+            break;
+
+        case read_step::close: {
+            if (stack.size() == 1) {
+                return;
             }
-        } else if (!wrap) {
-            wr.append(" ");
+            value val(stack.back().take());
+            stack.pop_back();
+            step = add_value(sc, stack.back(), std::move(val));
+            break;
+        }
         }
-        i++;
     }
+}
 
-    if (braces) {
-        wr.unindent();
-        if (wrap) {
-            wr.newline();
-        }
+//
+// Adds a value that has been read to the group or vector it is in, and goes past what
+// follows it up to the next entry
+inline read_step add_value(scanner& sc, build_frame& top, value&& val) {
+    if (top.is_vector) {
+        top.vec.push_back(std::move(val));
+        sc.expect(',', true);
+        return read_step::element;
+    }
+    top.grp.set(top.key, std::move(val));
+    sc.expect(',', true);
+    if (top.braces && sc.peek_token().is_char('}')) {
         sc.expect('}');
-        wr.append("}");
+        return read_step::close;
     }
+    return read_step::entry;
 }
 
 //
 //
-inline void write_vector(scanner& sc, writer& wr, const value_vector_type& vec) {
-    bool wrap = vector_length(vec) > wr.wrap_length;
+inline value read_scalar(scanner& sc, limit_checker& check, arena *mem) {
+    const token& tok = sc.peek_token();
+    unsigned int pos = tok.pos;
+    check.node(sc, pos);
+    switch (tok.type) {
+    case token_type::identifier_token: {
+        string_ref ident = sc.expect_identifier_ref();
+        if (ident == "true") {
+            return value(true);
+        } else if (ident == "false") {
+            return value(false);
+        } else {
+            sc.fail("unexpected identifier", pos);
+        }
+        break;
+    }
+    case token_type::string_token: {
+        string_ref str = sc.expect_string_ref();
+        check.string(sc, pos, str.size());
+        return read_string_value(str, mem);
+    }
+    case token_type::number_token: {
+        double dbl = sc.expect_number();
+        return value(dbl);
+    }
+    case token_type::char_token: {
+        sc.fail("unexpected '" + std::string(1, tok.char_value) + "'", pos);
+        break;
+    }
+    default: {
+        sc.fail("unexpected token", pos);
+        break;
+    }
+    }
+    return value();
+}
 
-    wr.append("[ ");
-    wr.indent();
-    if (wrap) {
-        wr.newline();
+//
+// read_group(), building only the entries that proj asks for. An entry that is only on
+// the way to something asked for is kept if its value is a group with any of it in;
+// since a later entry with the same key replaces the value, one that isn't drops it.
+inline group read_group(scanner& sc, bool braces, const projection& proj) {
+    group grp;
+    if (braces) {
+        sc.expect('{');
     }
-    sc.expect('[');
+    while (sc.peek_token().type != token_type::eof_token && !(braces && sc.peek_token().is_char('}'))) {
+        std::string key = sc.expect_identifier();
+        sc.expect('=');
 
-    unsigned int vals_read = 0;
-    while (!sc.peek_token().is_char(']')) {
-        if (vals_read < vec.size()) {
-            write_value(sc, wr, vec[vals_read]);
-            vals_read++;
+        const projection *sub = proj.find(key);
+        if (!sub) {
+            skip_value(sc);
+        } else if (sub->whole()) {
+            grp.set(key, read_value(sc));
         } else {
-            read_value(sc);
-        }
-
-        bool terminate = sc.peek_token().is_char(']') && vals_read == vec.size();
-        if (!terminate) {
-            if (wrap) {
-                wr.newline();
+            group sub_grp;
+            if (sc.peek_token().is_char('{')) {
+                sub_grp = read_group(sc, true, *sub);
             } else {
-                wr.append(", ");
+                skip_value(sc);
             }
-        } else if (!wrap) {
-            wr.append(" ");
-        }
-        sc.expect(',', true);
-    }
-
-    for (unsigned int i = vals_read; i < vec.size(); i++) {
-        scanner dummy_scanner = make_scanner("0");
-        write_value(dummy_scanner, wr, vec[i]);
-        if (i < vec.size() - 1) {
-            if (wrap) {
-                wr.newline();
+            if (sub_grp.size()) {
+                grp.set(key, std::move(sub_grp));
             } else {
-                wr.append(", ");
+                grp.unset(key);
             }
-        } else if (!wrap) {
-            wr.append(" ");
         }
-    }
 
-    wr.unindent();
-    if (wrap) {
-        wr.newline();
+        sc.expect(',', true);
+        if (braces && sc.peek_token().is_char('}')) {
+            sc.expect('}');
+            break;
+        }
     }
 
-    sc.expect(']');
-    wr.append("]");
+    return grp;
 }
 
 //
-//
-inline void write_value(scanner& sc, writer& wr, const value& val) {
-    switch (val.type()) {
-    case value_type::number_type: {
-        read_value(sc);
-        wr.append(stringize_number(val.number_value()));
-        break;
-    }
-    case value_type::string_type: {
-        read_value(sc);
-        wr.append("\"");
-        wr.append(escape_string(val.string_value()));
-        wr.append("\"");
-        break;
-    }
-    case value_type::bool_type: {
-        read_value(sc);
-        wr.append(val.bool_value() ? "true" : "false");
-        break;
-    }
-    case value_type::group_type: {
-        if (sc.peek_token().is_char('{')) {
-            write_group(sc, wr, true, val.group_value());
+// Steps over a value without building it. A group or vector is skipped by matching up
+// its brackets, so what is inside it isn't checked.
+inline void skip_value(scanner& sc) {
+    const token& tok = sc.peek_token();
+    if (tok.is_char('{') || tok.is_char('[')) {
+        const char *input = sc.input();
+        const char *last = skip_brackets(input + tok.pos, input + sc.input_size(), false);
+        if (last) {
+            sc.skip_to((unsigned int)(last - input));
         } else {
             read_value(sc);
-            scanner dummy_scanner = make_scanner("{}");
-            write_group(dummy_scanner, wr, true, val.group_value());
         }
-        break;
+    } else if (tok.type == token_type::string_token || tok.type == token_type::number_token) {
+        sc.expect(tok.type);
+    } else {
+        read_value(sc);
     }
-    case value_type::vector_type: {
-        if (sc.peek_token().is_char('[')) {
-            write_vector(sc, wr, val.vector_value());
+}
+
+//
+// Follows read_group(), only going into the groups on the way to the vector
+inline bool element_syntax::seek(scanner& sc, const path& p, size_t index, bool braces) {
+    if (braces) {
+        sc.expect('{');
+    }
+    while (sc.peek_token().type != token_type::eof_token && !(braces && sc.peek_token().is_char('}'))) {
+        std::string key = sc.expect_identifier();
+        sc.expect('=');
+
+        size_t count = match_path_key(key, p, index);
+        if (count && index + count == p.size() && sc.peek_token().is_char('[')) {
+            sc.expect('[');
+            return true;
+        } else if (count && index + count < p.size() && sc.peek_token().is_char('{')) {
+            if (seek(sc, p, index + count, true)) {
+                return true;
+            }
         } else {
-            read_value(sc);
-            scanner dummy_scanner = make_scanner("[]");
-            write_vector(dummy_scanner, wr, val.vector_value());
+            skip_value(sc);
+        }
+
+        sc.expect(',', true);
+        if (braces && sc.peek_token().is_char('}')) {
+            sc.expect('}');
+            break;
         }
-        break;
-    }
-    default: {
-        break;
-    }
     }
+    return false;
 }
 
 //
 //
-inline int value_length(const value& val, int wrap_length) {
-    switch (val.type()) {
-    case value_type::number_type: {
-        return stringize_number(val.number_value()).size();
-    }
-    case value_type::string_type: {
-        return 2 + escape_string(val.string_value()).size();
-    }
-    case value_type::bool_type: {
-        return val.bool_value() ? 4 : 5;
-    }
-    case value_type::group_type: {
-        return group_length(val.group_value());
-    }
-    case value_type::vector_type: {
-        return vector_length(val.vector_value());
-    }
-    default: {
-        return 0;
-    }
+inline bool element_syntax::next(scanner& sc, value *out) {
+    if (sc.peek_token().is_char(']')) {
+        sc.expect(']');
+        return false;
     }
+    *out = read_value(sc);
+    sc.expect(',', true);
+    return true;
 }
 
 //
 //
-inline int group_length(const group& gr, int wrap_length) {
-    int sum = 3; // length of "{ }"
-    for (const auto& key : gr) { 
-        sum += 4 + key.size() + value_length(gr.get<value>(key)); // ", = "
-    }
-    return sum;
+inline void write_group(scanner& sc, writer& wr, bool braces, const group& gr) {
+    std::vector<write_frame> stack(1, write_frame(&sc, &gr, nullptr));
+    stack[0].braces = braces;
+    write_nested(wr, stack);
 }
 
 //
 //
-inline int vector_length(const value_vector_type& vec, int wrap_length) {
-    int sum = 3; // length of "[ ]"
-    for (const auto& val : vec) {
-        sum += 2 + value_length(val); // ", "
+inline void write_vector(scanner& sc, writer& wr, const value_vector_type& vec) {
+    std::vector<write_frame> stack(1, write_frame(&sc, nullptr, &vec));
+    write_nested(wr, stack);
+}
+
+//
+//
+inline void write_value(scanner& sc, writer& wr, const value& val) {
+    std::vector<write_frame> stack;
+    begin_value(&sc, wr, val, stack);
+    write_nested(wr, stack);
+}
+
+//
+// The loop behind write_group(), write_vector() and write_value(), which goes through
+// the old document with the scanner as it writes the new one, keeping what it is in
+// the middle of on an explicit stack rather than recursing. Entries of a group are
+// written in the order of the old document, followed by any new ones; a value that
+// isn't in the old document, or that has changed from a scalar to a group or vector,
+// is written from scratch, with no scanner.
+inline void write_nested(writer& wr, std::vector<write_frame>& stack) {
+    while (!stack.empty()) {
+        write_frame& top = stack.back();
+        scanner *sc = top.sc;
+        char close = top.grp ? '}' : ']';
+
+        switch (top.step) {
+        case write_step::open:
+            if (top.grp) {
+                top.wrap = !top.braces || !fits_in(*top.grp, wr.wrap_length);
+                for (const auto& key : *top.grp) {
+                    top.keys.push_back(key);
+                }
+            } else {
+                top.wrap = !fits_in(*top.vec, wr.wrap_length);
+            }
+            if (top.braces) {
+                wr.append(top.grp ? "{ " : "[ ");
+                wr.indent();
+                if (top.wrap) {
+                    wr.newline();
+                }
+                if (sc) {
+                    sc->expect(top.grp ? '{' : '[');
+                }
+            }
+            top.step = sc ? write_step::source : write_step::rest;
+            break;
+
+        case write_step::source:
+            if (top.grp) {
+                if (sc->peek_token().type == token_type::eof_token || (top.braces && sc->peek_token().is_char('}'))) {
+                    top.step = write_step::rest;
+                    break;
+                }
+                std::string key = sc->expect_identifier();
+                sc->expect('=');
+
+                auto key_it = std::find(std::begin(top.keys), std::end(top.keys), key);
+                top.step = write_step::source_done;
+                top.written = key_it != top.keys.end();
+                if (top.written) {
+                    wr.append(key);
+                    wr.append(" = ");
+                    const value& val = top.grp->get<value>(*key_it);
+                    top.keys.erase(key_it);
+                    begin_value(sc, wr, val, stack);
+                } else {
+                    read_value(*sc);
+                }
+            } else {
+                if (sc->peek_token().is_char(']')) {
+                    top.step = write_step::rest;
+                    break;
+                }
+                top.step = write_step::source_done;
+                top.written = true;
+                if (top.index < top.vec->size()) {
+                    begin_value(sc, wr, (*top.vec)[top.index++], stack);
+                } else {
+                    read_value(*sc);
+                }
+            }
+            break;
+
+        case write_step::source_done:
+            if (top.written) {
+                bool done = top.grp ? top.keys.empty() : top.index == top.vec->size();
+                bool terminate = sc->peek_token().is_char(close) && done;
+                if (!terminate) {
+                    if (top.wrap) {
+                        wr.newline();
+                    } else {
+                        wr.append(", ");
+                    }
+                } else if (!top.wrap) {
+                    wr.append(" ");
+                }
+            }
+            sc->expect(',', true);
+            top.step = top.grp && top.braces && sc->peek_token().is_char('}') ? write_step::rest : write_step::source;
+            break;
+
+        case write_step::rest: {
+            size_t i = top.grp ? top.rest_index : top.index;
+            if (i >= (top.grp ? top.keys.size() : top.vec->size())) {
+                top.step = write_step::close;
+                break;
+            }
+            top.step = write_step::rest_done;
+            if (top.grp) {
+                const std::string& key = top.keys[top.rest_index];
+                wr.append(key);
+                wr.append(" = ");
+                begin_value(nullptr, wr, top.grp->get<value>(key), stack);
+            } else {
+                begin_value(nullptr, wr, (*top.vec)[top.index], stack);
+            }
+            break;
+        }
+
+        case write_step::rest_done: {
+            size_t& i = top.grp ? top.rest_index : top.index;
+            size_t count = top.grp ? top.keys.size() : top.vec->size();
+            if (i < count - 1) {
+                if (top.wrap) {
+                    wr.newline();
+                } else {
+                    wr.append(", ");
+                }
+            } else if (!top.wrap) {
+                wr.append(" ");
+            }
+            i++;
+            top.step = write_step::rest;
+            break;
+        }
+
+        case write_step::close:
+            if (top.braces) {
+                wr.unindent();
+                if (top.wrap) {
+                    wr.newline();
+                }
+                if (sc) {
+                    sc->expect(close);
+                }
+                wr.append(std::string(1, close));
+            }
+            stack.pop_back();
+            break;
+        }
+    }
+}
+
+//
+// Writes a scalar straight away, or pushes a frame for a group or vector. With sc, it
+// goes past the value in the old document at the same time.
+inline void begin_value(scanner *sc, writer& wr, const value& val, std::vector<write_frame>& stack) {
+    switch (val.type()) {
+    case value_type::number_type:
+    case value_type::string_type:
+    case value_type::bool_type:
+        if (sc) {
+            read_value(*sc);
+        }
+        if (val.type() == value_type::number_type) {
+            wr.append(stringize_number(val.number_value()));
+        } else if (val.type() == value_type::string_type) {
+            wr.append("\"");
+            wr.append(escape_string(val.string_value()));
+            wr.append("\"");
+        } else {
+            wr.append(val.bool_value() ? "true" : "false");
+        }
+        break;
+
+    case value_type::group_type:
+    case value_type::vector_type: {
+        bool is_group = val.type() == value_type::group_type;
+        if (sc && !sc->peek_token().is_char(is_group ? '{' : '[')) {
+            read_value(*sc);
+            sc = nullptr;
+        }
+        if (is_group) {
+            stack.push_back(write_frame(sc, &val.group_value(), nullptr));
+        } else {
+            stack.push_back(write_frame(sc, nullptr, &val.vector_value()));
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+// The length of a value written on one line, however long that is
+inline int value_length(const value& val, int wrap_length) {
+    std::vector<const value *> pending(1, &val);
+    return nested_length(pending, 0, std::numeric_limits<int>::max());
+}
+
+//
+//
+inline int group_length(const group& gr, int wrap_length) {
+    std::vector<const value *> pending;
+    int sum = outer_length(gr, pending);
+    return nested_length(pending, sum, std::numeric_limits<int>::max());
+}
+
+//
+//
+inline int vector_length(const value_vector_type& vec, int wrap_length) {
+    std::vector<const value *> pending;
+    int sum = outer_length(vec, pending);
+    return nested_length(pending, sum, std::numeric_limits<int>::max());
+}
+
+//
+// Whether the group fits on one line of wrap_length characters. Only as much of it is
+// counted as it takes to tell, so a large group is no slower to decide on than a
+// small one.
+inline bool fits_in(const group& gr, int wrap_length) {
+    std::vector<const value *> pending;
+    int sum = outer_length(gr, pending);
+    return nested_length(pending, sum, wrap_length) <= wrap_length;
+}
+
+//
+//
+inline bool fits_in(const value_vector_type& vec, int wrap_length) {
+    std::vector<const value *> pending;
+    int sum = outer_length(vec, pending);
+    return nested_length(pending, sum, wrap_length) <= wrap_length;
+}
+
+//
+// The length of the group's brackets and keys, leaving its values in pending
+inline int outer_length(const group& gr, std::vector<const value *>& pending) {
+    int sum = 3; // length of "{ }"
+    for (const auto& key : gr) {
+        sum += 4 + key.size(); // ", = "
+        pending.push_back(&gr.get<value>(key));
+    }
+    return sum;
+}
+
+//
+//
+inline int outer_length(const value_vector_type& vec, std::vector<const value *>& pending) {
+    int sum = 3; // length of "[ ]"
+    for (const auto& val : vec) {
+        sum += 2; // ", "
+        pending.push_back(&val);
+    }
+    return sum;
+}
+
+//
+// Adds the lengths of the pending values, and of everything in them, to sum, stopping
+// once sum is past limit
+inline int nested_length(std::vector<const value *>& pending, int sum, int limit) {
+    while (!pending.empty() && sum <= limit) {
+        const value& val = *pending.back();
+        pending.pop_back();
+        switch (val.type()) {
+        case value_type::number_type:
+            sum += stringize_number(val.number_value()).size();
+            break;
+        case value_type::string_type:
+            sum += 2 + escape_string(val.string_value()).size();
+            break;
+        case value_type::bool_type:
+            sum += val.bool_value() ? 4 : 5;
+            break;
+        case value_type::group_type:
+            sum += 3;
+            for (const auto& key : val.group_value()) {
+                sum += 4 + key.size();
+                pending.push_back(&val.group_value().get<value>(key));
+            }
+            break;
+        case value_type::vector_type:
+            sum += 3;
+            for (const auto& elem : val.vector_value()) {
+                sum += 2;
+                pending.push_back(&elem);
+            }
+            break;
+        default:
+            break;
+        }
     }
     return sum;
 }
@@ -343,14 +1068,940 @@ inline scanner make_scanner(const std::string& input) {
     return sc;
 }
 
+//
+//
+inline parallel_reader::parallel_reader(thread_pool& pool, size_t chunk_size) :
+    pool_(pool),
+    chunk_size_(chunk_size),
+    pieces_(),
+    failed_(false)
+{ }
+
+//
+// Anything the bracket matching can't make sense of, and any range that fails to
+// parse, sends the whole document through the sequential reader instead. The result
+// is always the same as read() gives, and so is the error for a bad document.
+inline group parallel_reader::read(const char *input, size_t size) {
+    pieces_.clear();
+    failed_ = false;
+    try {
+        failed_ = !split(input, input + size, false, -1, 0);
+    } catch (const lightconf_error&) {
+        failed_ = true;
+    }
+
+    if (!failed_) {
+        std::vector<size_t> ranges;
+        for (size_t i = 0; i < pieces_.size(); i++) {
+            if (!pieces_[i].split) {
+                ranges.push_back(i);
+            }
+        }
+        pool_.run(ranges.size(), [&](size_t i) {
+            parse(pieces_[ranges[i]]);
+        });
+    }
+
+    if (failed_) {
+        pieces_.clear();
+        scanner sc;
+        sc.scan(input, size, read_scanner_params);
+        return read_group(sc, false);
+    }
+    group grp = stitch();
+    pieces_.clear();
+    return grp;
+}
+
+//
+// Walks the entries of a group body or the elements of a vector body with the scanner,
+// skipping over each bracketed value with skip_brackets(). The entries are gathered
+// into ranges of about chunk_size_ bytes; a value bigger than that is split itself.
+inline bool parallel_reader::split(const char *first, const char *last, bool is_vector, int parent, int depth) {
+    const int max_depth = 4;
+
+    scanner sc;
+    sc.scan(first, last - first, read_scanner_params);
+    const char *range = nullptr;
+    size_t entries = 0;
+
+    while (sc.peek_token().type != token_type::eof_token) {
+        const char *entry = first + sc.peek_token().pos;
+        if (range && (size_t)(entry - range) >= chunk_size_) {
+            add_piece(range, entry, false, is_vector, parent);
+            range = nullptr;
+        }
+
+        std::string key;
+        if (!is_vector) {
+            key = sc.expect_identifier();
+            sc.expect('=');
+        }
+        entries++;
+
+        const token& tok = sc.peek_token();
+        if (tok.is_char('{') || tok.is_char('[')) {
+            bool value_is_vector = tok.is_char('[');
+            const char *value_first = first + tok.pos;
+            const char *value_last = skip_brackets(value_first, last, false);
+            if (!value_last) {
+                return false;
+            }
+            sc.skip_to((unsigned int)(value_last - first));
+            sc.expect(',', true);
+
+            if ((size_t)(value_last - value_first) >= chunk_size_ && depth < max_depth) {
+                if (range) {
+                    add_piece(range, entry, false, is_vector, parent);
+                    range = nullptr;
+                }
+                add_piece(value_first + 1, value_last - 1, true, value_is_vector, parent);
+                pieces_.back().key = key;
+                if (!split(value_first + 1, value_last - 1, value_is_vector, (int)pieces_.size() - 1, depth + 1)) {
+                    return false;
+                }
+                continue;
+            }
+        } else {
+            sc.next_token();
+            sc.expect(',', true);
+        }
+
+        if (!range) {
+            range = entry;
+        }
+    }
+
+    if (range) {
+        add_piece(range, last, false, is_vector, parent);
+    }
+
+    // read_group() doesn't accept a group with nothing in it
+    return is_vector || parent < 0 || entries > 0;
+}
+
+//
+//
+inline void parallel_reader::add_piece(const char *first, const char *last, bool split, bool is_vector, int parent) {
+    pieces_.push_back(piece());
+    piece& p = pieces_.back();
+    p.first = first;
+    p.last = last;
+    p.split = split;
+    p.is_vector = is_vector;
+    p.parent = parent;
+    p.dst_grp = nullptr;
+    p.dst_vec = nullptr;
+}
+
+//
+// Runs on the pool. Each thread keeps its own scanner, so its token buffer is reused
+// from one range to the next.
+inline void parallel_reader::parse(piece& p) {
+    if (failed_) {
+        return;
+    }
+    static thread_local scanner sc;
+    try {
+        sc.scan(p.first, p.last - p.first, read_scanner_params);
+        if (p.is_vector) {
+            while (sc.peek_token().type != token_type::eof_token) {
+                p.vec.push_back(read_value(sc));
+                sc.expect(',', true);
+            }
+        } else {
+            p.grp = read_group(sc, false);
+        }
+    } catch (const lightconf_error&) {
+        failed_ = true;
+    }
+}
+
+//
+// Each value is moved into place rather than copied. Setting the keys in document
+// order leaves the group as read_group() would have: a repeated key keeps the position
+// of its first appearance and the value of its last.
+inline group parallel_reader::stitch() {
+    group result;
+    for (auto& p : pieces_) {
+        bool in_vector = p.parent >= 0 && pieces_[p.parent].is_vector;
+        group *grp = p.parent >= 0 ? pieces_[p.parent].dst_grp : &result;
+        value_vector_type *vec = p.parent >= 0 ? pieces_[p.parent].dst_vec : nullptr;
+
+        if (p.split) {
+            value val = p.is_vector ? value(value_vector_type()) : value(group());
+            if (in_vector) {
+                vec->push_back(std::move(val));
+            } else {
+                grp->set(p.key, std::move(val));
+            }
+            // we can safely strip constness because the values are our own
+            const value& dst = in_vector ? vec->back() : grp->get<value>(p.key);
+            if (p.is_vector) {
+                p.dst_vec = const_cast<value_vector_type *>(&dst.vector_value());
+            } else {
+                p.dst_grp = const_cast<group *>(&dst.group_value());
+            }
+        } else if (in_vector) {
+            if (vec->empty()) {
+                vec->swap(p.vec);
+            } else {
+                for (auto& val : p.vec) {
+                    vec->push_back(std::move(val));
+                }
+            }
+        } else if (grp->size() == 0) {
+            std::swap(*grp, p.grp);
+        } else {
+            for (const auto& key : p.grp) {
+                grp->set(key, std::move(const_cast<value&>(p.grp.get<value>(key))));
+            }
+        }
+    }
+    return result;
+}
+
+//
+//
+inline lazy_reader::lazy_reader(const std::shared_ptr<const lazy_document>& doc, size_t first, size_t last,
+        int line, int col) :
+    doc_(doc),
+    sc_(),
+    first_(first),
+    last_(last),
+    located_(0),
+    line_(line),
+    col_(col)
+{
+    sc_.set_origin(line, col);
+    sc_.scan(doc_->text + first_, last_ - first_, read_scanner_params);
+}
+
+//
+// Moves line_ and col_ on to byte pos of the scanner's input. The values are found in
+// document order, so the text is only counted through once.
+inline void lazy_reader::locate(unsigned int pos) {
+    const char *first = doc_->text + first_ + located_;
+    const char *end = doc_->text + first_ + pos;
+    while (const void *newline = std::memchr(first, '\n', end - first)) {
+        first = (const char *)newline + 1;
+        line_++;
+        col_ = 1;
+    }
+    col_ += (int)(end - first);
+    located_ = pos;
+}
+
+//
+//
+inline group lazy_reader::read_group(bool braces) {
+    group grp;
+    if (braces) {
+        sc_.expect('{');
+    }
+    while (sc_.peek_token().type != token_type::eof_token && !(braces && sc_.peek_token().is_char('}'))) {
+        std::string key = sc_.expect_identifier();
+        sc_.expect('=');
+        grp.set(key, read_value());
+
+        sc_.expect(',', true);
+        if (braces && sc_.peek_token().is_char('}')) {
+            sc_.expect('}');
+            break;
+        }
+    }
+
+    return grp;
+}
+
+//
+//
+inline value_vector_type lazy_reader::read_vector() {
+    sc_.expect('[');
+    value_vector_type vec;
+    while (!sc_.peek_token().is_char(']')) {
+        vec.push_back(read_value());
+        sc_.expect(',', true);
+    }
+    sc_.expect(']');
+    return vec;
+}
+
+//
+//
+inline value lazy_reader::read_value() {
+    const token& tok = sc_.peek_token();
+    if (tok.is_char('{') || tok.is_char('[')) {
+        const char *first = doc_->text + first_ + tok.pos;
+        const char *last = skip_brackets(first, doc_->text + last_, false);
+        if (!last) {
+            return config_format::read_value(sc_);
+        }
+        lazy_span span;
+        span.doc = doc_;
+        span.first = first - doc_->text;
+        span.last = last - doc_->text;
+        locate(tok.pos);
+        span.line = line_;
+        span.col = col_;
+        sc_.skip_to((unsigned int)(span.last - first_));
+        return value(span);
+    }
+    return config_format::read_value(sc_);
+}
+
+//
+// Checks that nothing follows the value that was read
+inline void lazy_reader::expect_end() {
+    const token& tok = sc_.peek_token();
+    if (tok.type != token_type::eof_token) {
+        sc_.fail("unexpected " + token_name(tok), tok.pos);
+    }
+}
+
+//
+// The lazy_document parse function for .config documents
+inline void parse_lazy(const lazy_span& span, value *out) {
+    lazy_reader reader(span.doc, span.first, span.last, span.line, span.col);
+    value val = span.doc->text[span.first] == '{' ? value(reader.read_group(true)) : value(reader.read_vector());
+    reader.expect_end();
+    out->swap(val);
+}
+
 //
 //
 inline group read(const std::string& src) {
     scanner sc;
-    sc.scan(src);
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    return read_group(sc, false);
+}
+
+//
+// The stream is parsed a chunk at a time as it is read
+inline group read(std::istream& in) {
+    push_parser parser;
+    parser.feed(in);
+    return parser.finish();
+}
+
+//
+// Parses from a pipe, socket or file descriptor a chunk at a time as data arrives
+inline group read_fd(int fd) {
+    push_parser parser;
+    parser.feed_fd(fd);
+    return parser.finish();
+}
+
+//
+// Regular files are memory-mapped and scanned in place
+inline group read_file(const std::string& filename) {
+    mapped_file file(filename);
+    scanner sc;
+    sc.scan(file.data(), file.size(), read_scanner_params);
     return read_group(sc, false);
 }
 
+//
+// Reads the whole document into mem, for one that is read, used and thrown away as a
+// whole, such as a configuration that is reloaded every so often. Its groups, vectors
+// and strings are allocated from a few large blocks rather than one at a time, and all
+// freed together by destroying the arena, which has to outlive the group returned:
+//
+//     arena mem;
+//     group config = config_format::read(src, mem);
+//     ...
+//
+// A copy of the group, or of anything in it, is on the heap and doesn't need the arena.
+inline group read(const std::string& src, arena& mem) {
+    limit_checker check;
+    scanner sc;
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    return read_group(sc, false, check, &mem);
+}
+
+//
+//
+inline group read_file(const std::string& filename, arena& mem) {
+    limit_checker check;
+    mapped_file file(filename);
+    scanner sc;
+    sc.scan(file.data(), file.size(), read_scanner_params);
+    return read_group(sc, false, check, &mem);
+}
+
+//
+// read() with tighter read_limits than the defaults, for documents that aren't trusted.
+// A document over max_input_size fails before any of it is parsed.
+//
+//     read_limits limits = default_read_limits;
+//     limits.max_nodes = 100000;
+//     group grp = config_format::read_limited(src, limits);
+inline group read_limited(const char *src, size_t size, const read_limits& limits) {
+    limit_checker check(limits);
+    scanner sc;
+    sc.scan(src, size, read_scanner_params);
+    check.input(sc, size);
+    return read_group(sc, false, check);
+}
+
+//
+//
+inline group read_limited(const std::string& src, const read_limits& limits) {
+    return read_limited(src.data(), src.size(), limits);
+}
+
+//
+//
+inline group read_file_limited(const std::string& filename, const read_limits& limits) {
+    mapped_file file(filename);
+    return read_limited(file.data(), file.size(), limits);
+}
+
+//
+// Parses a large document on several threads (one per hardware thread with threads 0).
+// The result, or the parse_error, is the same as read() gives. Documents too small to
+// be worth splitting up are read on the calling thread.
+inline group read_parallel(const std::string& src, unsigned int threads) {
+    if (src.size() < 2 * parallel_chunk_size) {
+        return read(src);
+    }
+    thread_pool pool(threads);
+    return read_parallel(src, pool);
+}
+
+//
+// Parses on an existing pool, in ranges of about chunk_size bytes. With chunk_size 0
+// the document is divided into a few ranges per thread.
+inline group read_parallel(const std::string& src, thread_pool& pool, size_t chunk_size) {
+    if (chunk_size == 0) {
+        chunk_size = std::max(src.size() / (4 * pool.size()), parallel_chunk_size);
+    }
+    parallel_reader reader(pool, chunk_size);
+    return reader.read(src.data(), src.size());
+}
+
+//
+//
+inline group read_file_parallel(const std::string& filename, unsigned int threads) {
+    mapped_file file(filename);
+    if (file.size() < 2 * parallel_chunk_size) {
+        scanner sc;
+        sc.scan(file.data(), file.size(), read_scanner_params);
+        return read_group(sc, false);
+    }
+    thread_pool pool(threads);
+    parallel_reader reader(pool, std::max(file.size() / (4 * pool.size()), parallel_chunk_size));
+    return reader.read(file.data(), file.size());
+}
+
+//
+// Parses only the top level of the document straight away. Each group or vector in it
+// is parsed the first time it is reached through get(), has(), iteration or write(),
+// and the groups and vectors inside that the same way in turn, so the parts of the
+// document that are never looked at are only ever skipped over. Reading the same
+// lazy values from several threads at once is safe.
+//
+// A document that read() accepts gives the same values. A parse_error inside a nested
+// group or vector, though, is only thrown once something reaches it.
+inline group read_lazy(const std::string& src) {
+    std::shared_ptr<std::string> text = std::make_shared<std::string>(src);
+    std::shared_ptr<lazy_document> doc = std::make_shared<lazy_document>();
+    doc->owner = text;
+    doc->text = text->data();
+    doc->size = text->size();
+    doc->parse = parse_lazy;
+
+    lazy_reader reader(doc, 0, doc->size, 1, 1);
+    return reader.read_group(false);
+}
+
+//
+// The file stays mapped until none of its lazy values are left
+inline group read_file_lazy(const std::string& filename) {
+    std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>(filename);
+    std::shared_ptr<lazy_document> doc = std::make_shared<lazy_document>();
+    doc->owner = file;
+    doc->text = file->data();
+    doc->size = file->size();
+    doc->parse = parse_lazy;
+
+    lazy_reader reader(doc, 0, doc->size, 1, 1);
+    return reader.read_group(false);
+}
+
+//
+// Builds only the values at the given paths, and the groups they are in. The rest of
+// the document is skipped over without building anything, and isn't checked for errors
+// inside its groups and vectors. A path to a group takes everything in it.
+//
+//     group grp = config_format::read(src, { "global.maintainer" });
+inline group read(const std::string& src, const std::vector<path>& paths) {
+    scanner sc;
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    return read_group(sc, false, projection(paths));
+}
+
+//
+// The elements of the vector at p, read one at a time. The reader keeps its own copy
+// of src.
+//
+//     auto users = config_format::read_elements(src, "users");
+//     for (const user& u : users.as<user>()) {
+//         ...
+//     }
+inline element_reader read_elements(const std::string& src, const path& p) {
+    std::shared_ptr<std::string> text = std::make_shared<std::string>(src);
+    return element_reader(text, text->data(), text->size(), p);
+}
+
+//
+// The file stays mapped for as long as the reader is around
+inline element_reader read_file_elements(const std::string& filename, const path& p) {
+    std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>(filename);
+    return element_reader(file, file->data(), file->size(), p);
+}
+
+//
+// Reads the document straight into a T, which value_type_info<T>::read_value() pulls
+// from the scanner a token at a time, so no group is built for it. The document's own
+// group is read into T as any group in it would be, so T is usually a
+// LIGHTCONF_BEGIN_TYPE type.
+//
+//     struct settings { std::vector<person> users; };
+//     settings s = config_format::read_as<settings>(src);
+//
+// The document only has to be valid as far as T looks into it; entries T has no member
+// for are skipped without checking inside their groups and vectors. A value of the
+// wrong type is a value_error, even for an optional member.
+template <typename T>
+inline T read_as(const std::string& src) {
+    scanner sc;
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    return read_as<T>(sc);
+}
+
+//
+//
+template <typename T>
+inline T read_file_as(const std::string& filename) {
+    mapped_file file(filename);
+    scanner sc;
+    sc.scan(file.data(), file.size(), read_scanner_params);
+    return read_as<T>(sc);
+}
+
+//
+//
+template <typename T>
+inline T read_as(scanner& sc) {
+    scanner_source source(sc);
+    T out;
+    read_typed(source, &out);
+    return out;
+}
+
+//
+//
+inline scanner_source::scanner_source(scanner& sc, const read_limits& limits) :
+    sc_(sc),
+    check_(limits),
+    stack_(),
+    root_(true)
+{ }
+
+//
+//
+inline value_type scanner_source::peek_type() {
+    if (root_) {
+        return value_type::group_type;
+    }
+    const token& tok = sc_.peek_token();
+    switch (tok.type) {
+    case token_type::number_token:
+        return value_type::number_type;
+    case token_type::string_token:
+        return value_type::string_type;
+    case token_type::identifier_token: {
+        string_ref ident = sc_.token_text(tok);
+        return ident == "true" || ident == "false" ? value_type::bool_type : value_type::invalid_type;
+    }
+    case token_type::char_token:
+        return tok.is_char('{') ? value_type::group_type
+            : tok.is_char('[') ? value_type::vector_type : value_type::invalid_type;
+    default:
+        return value_type::invalid_type;
+    }
+}
+
+//
+//
+inline double scanner_source::read_number() {
+    expect_type(value_type::number_type);
+    check_.node(sc_, sc_.peek_token().pos);
+    return sc_.expect_number();
+}
+
+//
+//
+inline void scanner_source::read_string(std::string *out) {
+    expect_type(value_type::string_type);
+    unsigned int pos = sc_.peek_token().pos;
+    check_.node(sc_, pos);
+    string_ref str = sc_.expect_string_ref();
+    check_.string(sc_, pos, str.size());
+    out->assign(str.data(), str.size());
+}
+
+//
+//
+inline bool scanner_source::read_bool() {
+    expect_type(value_type::bool_type);
+    check_.node(sc_, sc_.peek_token().pos);
+    return sc_.expect_identifier_ref() == "true";
+}
+
+//
+//
+inline void scanner_source::read_group(group *out) {
+    expect_type(value_type::group_type);
+    *out = config_format::read_group(sc_, !root_, check_);
+    root_ = false;
+}
+
+//
+//
+inline void scanner_source::read_vector(value_vector_type *out) {
+    expect_type(value_type::vector_type);
+    *out = config_format::read_vector(sc_, check_);
+}
+
+//
+//
+inline void scanner_source::read_value(value *out) {
+    if (root_) {
+        value val(config_format::read_group(sc_, false, check_));
+        root_ = false;
+        out->swap(val);
+    } else {
+        value val = config_format::read_value(sc_, check_);
+        out->swap(val);
+    }
+}
+
+//
+//
+inline void scanner_source::skip_value() {
+    config_format::skip_value(sc_);
+}
+
+//
+// For the group or vector about to be read
+inline void scanner_source::enter() {
+    unsigned int pos = sc_.peek_token().pos;
+    check_.enter(sc_, pos, stack_.size() + 1);
+    check_.node(sc_, pos);
+}
+
+//
+//
+inline void scanner_source::begin_group() {
+    expect_type(value_type::group_type);
+    enter();
+    stack_.push_back({ !root_, true });
+    if (!root_) {
+        sc_.expect('{');
+    }
+    root_ = false;
+}
+
+//
+// Follows read_nested(): the brace closing an empty group is left for the group around
+// it, and the document's group ends at the end of the input
+inline bool scanner_source::next_key(std::string *key) {
+    frame& top = stack_.back();
+    if (!top.first) {
+        sc_.expect(',', true);
+        if (top.braces && sc_.peek_token().is_char('}')) {
+            sc_.expect('}');
+            stack_.pop_back();
+            return false;
+        }
+    }
+    top.first = false;
+
+    const token& tok = sc_.peek_token();
+    if (tok.type == token_type::eof_token || (top.braces && tok.is_char('}'))) {
+        stack_.pop_back();
+        return false;
+    }
+    unsigned int pos = tok.pos;
+    string_ref ident = sc_.expect_identifier_ref();
+    check_.string(sc_, pos, ident.size());
+    key->assign(ident.data(), ident.size());
+    sc_.expect('=');
+    return true;
+}
+
+//
+//
+inline void scanner_source::begin_vector() {
+    expect_type(value_type::vector_type);
+    enter();
+    stack_.push_back({ false, true });
+    sc_.expect('[');
+}
+
+//
+//
+inline bool scanner_source::next_element() {
+    frame& top = stack_.back();
+    if (!top.first) {
+        sc_.expect(',', true);
+    }
+    top.first = false;
+    if (sc_.peek_token().is_char(']')) {
+        sc_.expect(']');
+        stack_.pop_back();
+        return false;
+    }
+    return true;
+}
+
+//
+//
+inline event_writer::event_writer(std::ostream& out, int wrap_length) :
+    out_(out),
+    wr_(),
+    held_(),
+    held_first_(0),
+    events_(0),
+    length_(0),
+    undecided_(SIZE_MAX),
+    open_(),
+    output_()
+{
+    wr_.wrap_length = wrap_length;
+}
+
+//
+//
+inline void event_writer::begin_group() {
+    add(event_type::begin_group, std::string());
+}
+
+//
+//
+inline void event_writer::end_group() {
+    add(event_type::end_group, std::string());
+}
+
+//
+//
+inline void event_writer::begin_vector() {
+    add(event_type::begin_vector, std::string());
+}
+
+//
+//
+inline void event_writer::end_vector() {
+    add(event_type::end_vector, std::string());
+}
+
+//
+//
+inline void event_writer::on_key(string_ref key) {
+    bool valid = !key.empty() && ((key[0] >= 'A' && key[0] <= 'Z') || (key[0] >= 'a' && key[0] <= 'z'));
+    for (char c : key) {
+        valid = valid && kernels::is_identifier_char(c);
+    }
+    if (!valid) {
+        throw value_error("key can't be written as a .config identifier: " + key.str());
+    }
+    add(event_type::key, key.str());
+}
+
+//
+//
+inline void event_writer::on_number(double val) {
+    add(event_type::scalar, stringize_number(val));
+}
+
+//
+//
+inline void event_writer::on_string(string_ref val) {
+    add(event_type::scalar, "\"" + escape_string(val.str()) + "\"");
+}
+
+//
+//
+inline void event_writer::on_bool(bool val) {
+    add(event_type::scalar, val ? "true" : "false");
+}
+
+//
+// Counts the event towards the length of the groups and vectors it is in, then writes
+// it, or holds it while any of them is undecided
+inline void event_writer::add(event_type type, std::string text) {
+    bool in_vector = !open_.empty() && open_.back().is_vector;
+    event ev = { type, std::move(text), layout::undecided };
+    switch (type) {
+    case event_type::begin_group:
+    case event_type::begin_vector:
+        length_ += in_vector ? 2 : 0;       // ", "
+        if (open_.empty()) {
+            ev.wrap = layout::wrapped;
+        } else if (undecided_ == SIZE_MAX) {
+            undecided_ = open_.size();
+        }
+        open_.push_back({ type == event_type::begin_vector, events_, length_ });
+        length_ += 3;                       // "{ }"
+        break;
+    case event_type::end_group:
+    case event_type::end_vector:
+        if (undecided_ != SIZE_MAX) {
+            // it fitted on one line
+            held_[open_.back().begin - held_first_].wrap = layout::one_line;
+            if (undecided_ == open_.size() - 1) {
+                undecided_ = SIZE_MAX;
+            }
+        }
+        open_.pop_back();
+        break;
+    case event_type::key:
+        length_ += 4 + ev.text.size();      // ", " and " = "
+        break;
+    case event_type::scalar:
+        length_ += (in_vector ? 2 : 0) + ev.text.size();
+        break;
+    }
+    events_++;
+
+    held_.push_back(std::move(ev));
+    decide();
+    if (output_.empty() || wr_.buf.size() >= 65536) {
+        flush();
+    }
+}
+
+//
+// Wraps the groups and vectors that have got too long for one line, and writes the
+// held events up to the first group or vector that is still undecided
+inline void event_writer::decide() {
+    while (undecided_ != SIZE_MAX && length_ - open_[undecided_].start > (size_t)wr_.wrap_length) {
+        held_[open_[undecided_].begin - held_first_].wrap = layout::wrapped;
+        undecided_ = undecided_ + 1 < open_.size() ? undecided_ + 1 : SIZE_MAX;
+    }
+    while (!held_.empty()) {
+        const event& ev = held_.front();
+        bool begins = ev.type == event_type::begin_group || ev.type == event_type::begin_vector;
+        if (begins && ev.wrap == layout::undecided) {
+            break;
+        }
+        write(ev);
+        held_.pop_front();
+        held_first_++;
+    }
+}
+
+//
+// Lays out the event as write_nested() would
+inline void event_writer::write(const event& ev) {
+    switch (ev.type) {
+    case event_type::begin_group:
+    case event_type::begin_vector: {
+        bool is_vector = ev.type == event_type::begin_vector;
+        if (output_.empty()) {
+            output_.push_back({ false, false, true, 0 });
+            break;
+        }
+        if (output_.back().is_vector) {
+            separate();
+        }
+        output_.push_back({ is_vector, true, ev.wrap == layout::wrapped, 0 });
+        wr_.append(is_vector ? "[ " : "{ ");
+        wr_.indent();
+        if (output_.back().wrap) {
+            wr_.newline();
+        }
+        break;
+    }
+    case event_type::end_group:
+    case event_type::end_vector: {
+        output_frame& top = output_.back();
+        if (top.braces) {
+            if (top.count && !top.wrap) {
+                wr_.append(" ");
+            }
+            wr_.unindent();
+            if (top.wrap) {
+                wr_.newline();
+            }
+            wr_.append(top.is_vector ? "]" : "}");
+        }
+        output_.pop_back();
+        break;
+    }
+    case event_type::key:
+        separate();
+        wr_.append(ev.text);
+        wr_.append(" = ");
+        break;
+    case event_type::scalar:
+        if (output_.back().is_vector) {
+            separate();
+        }
+        wr_.append(ev.text);
+        break;
+    }
+}
+
+//
+// Starts the next entry of the group or vector being written
+inline void event_writer::separate() {
+    output_frame& top = output_.back();
+    if (top.count++) {
+        if (top.wrap) {
+            wr_.newline();
+        } else {
+            wr_.append(", ");
+        }
+    }
+}
+
+//
+// Hands what has been written so far to the stream
+inline void event_writer::flush() {
+    out_.write(wr_.buf.data(), wr_.buf.size());
+    wr_.buf.clear();
+}
+
+//
+// Reports the document to the handler without building a group
+inline void parse(const std::string& src, handler& h) {
+    scanner sc;
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    token_parser<handler> parser(h);
+    parse_tokens(sc, parser);
+}
+
+//
+// The stream is parsed a chunk at a time as it is read
+inline void parse(std::istream& in, handler& h) {
+    event_push_parser parser(h);
+    parser.feed(in);
+    parser.finish();
+}
+
+//
+//
+inline void parse_file(const std::string& filename, handler& h) {
+    mapped_file file(filename);
+    scanner sc;
+    sc.scan(file.data(), file.size(), read_scanner_params);
+    token_parser<handler> parser(h);
+    parse_tokens(sc, parser);
+}
+
 //
 //
 inline std::string write(const group& grp, const std::string& src, int wrap_length) {
@@ -367,10 +2018,14 @@ inline std::string write(const group& grp, const std::string& src, int wrap_leng
     sc.scan(src, params);
     try {
         write_group(sc, wr, false, grp);
-    } catch (parse_error e) {
-        // if we fail to parse the source file to update, just write as if writing a brand new file
+    } catch (const parse_error&) {
+        // if we fail to parse the source file to update, just write as if writing a brand new
+        // file, leaving out whatever was written before the error
+        writer fresh;
+        fresh.wrap_length = wrap_length;
         scanner dummy_scanner = make_scanner("");
-        write_group(dummy_scanner, wr, false, grp);
+        write_group(dummy_scanner, fresh, false, grp);
+        return fresh.buf;
     }
     return wr.buf;
 }
@@ -0,0 +1,172 @@
+#ifndef _LIGHTCONF_ELEMENT_READER_H_
+#define _LIGHTCONF_ELEMENT_READER_H_
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include "exceptions.hpp"
+#include "path.hpp"
+#include "scanner.hpp"
+#include "value.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// Reads the elements of the vector at one path in a document one at a time, so that
+// only the current element is ever built. Everything before the vector is skipped over
+// without building it, and nothing after it is looked at.
+//
+//     auto users = config_format::read_file_elements("users.config", "users");
+//     for (const value& user : users) {
+//         ...
+//     }
+//
+// Syntax is the format's element_syntax, with
+//
+//     static bool seek(scanner& sc, const path& p, size_t index, bool braces);
+//     static bool next(scanner& sc, value *out);
+//
+// seek() steps through the group it is in until it finds the vector at the rest of the
+// path and leaves sc at its '['; next() reads one element, or returns false at the ']'.
+// If a key appears more than once, the first vector with it is read.
+template <typename Syntax>
+class basic_element_reader {
+public:
+    template <typename T> class basic_iterator;
+    template <typename T> class basic_range;
+    typedef basic_iterator<value> iterator;
+
+    bool                next(value *out);
+    template <typename T>
+    bool                next(T *out);
+
+    iterator            begin()             { return iterator(this); }
+    iterator            end()               { return iterator(); }
+    template <typename T>
+    basic_range<T>      as()                { return basic_range<T>(this); }
+
+    basic_element_reader(const std::shared_ptr<const void>& owner, const char *text, size_t size,
+        const path& p);
+
+private:
+    std::shared_ptr<const void> owner_;     // keeps text alive
+    scanner             sc_;
+    bool                done_;
+};
+
+//
+// An input iterator over the elements left in a reader, each one converted to T as
+// with value::get<T>(). Any number of iterators can be taken from a reader, but they
+// all advance the same reader.
+template <typename Syntax>
+template <typename T>
+class basic_element_reader<Syntax>::basic_iterator {
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef T                   value_type;
+    typedef std::ptrdiff_t      difference_type;
+    typedef const T *           pointer;
+    typedef const T&            reference;
+
+    const T&            operator*() const   { return cur_; }
+    const T *           operator->() const  { return &cur_; }
+    basic_iterator&     operator++()        { advance(); return *this; }
+    void                operator++(int)     { advance(); }
+    bool                operator==(const basic_iterator& rhs) const { return reader_ == rhs.reader_; }
+    bool                operator!=(const basic_iterator& rhs) const { return reader_ != rhs.reader_; }
+
+    explicit basic_iterator(basic_element_reader *reader) : reader_(reader), cur_() { advance(); }
+    basic_iterator() : reader_(nullptr), cur_() { }
+
+private:
+    void                advance()           { if (reader_ && !reader_->next(&cur_)) reader_ = nullptr; }
+
+    basic_element_reader *reader_;
+    T                   cur_;
+};
+
+//
+// The elements left in a reader as T, for range-based for loops
+template <typename Syntax>
+template <typename T>
+class basic_element_reader<Syntax>::basic_range {
+public:
+    basic_iterator<T>   begin()             { return basic_iterator<T>(reader_); }
+    basic_iterator<T>   end()               { return basic_iterator<T>(); }
+
+    explicit basic_range(basic_element_reader *reader) : reader_(reader) { }
+
+private:
+    basic_element_reader *reader_;
+};
+
+//
+// Finds the vector straight away, so a missing path or an error before the vector is
+// thrown from here
+template <typename Syntax>
+inline basic_element_reader<Syntax>::basic_element_reader(const std::shared_ptr<const void>& owner,
+        const char *text, size_t size, const path& p) :
+    owner_(owner),
+    sc_(),
+    done_(false)
+{
+    if (p.size() == 0) {
+        throw path_error("value at empty path requested");
+    }
+    sc_.scan(text, size, read_scanner_params);
+    if (!Syntax::seek(sc_, p, 0, false)) {
+        throw path_error("no vector at path: " + p.fullpath());
+    }
+}
+
+//
+//
+template <typename Syntax>
+inline bool basic_element_reader<Syntax>::next(value *out) {
+    if (done_) {
+        return false;
+    }
+    done_ = !Syntax::next(sc_, out);
+    return !done_;
+}
+
+//
+// Throws a value_error, and leaves the reader at the next element, if the element
+// isn't a T
+template <typename Syntax>
+template <typename T>
+inline bool basic_element_reader<Syntax>::next(T *out) {
+    value val;
+    if (!next(&val)) {
+        return false;
+    }
+    *out = val.get<T>();
+    return true;
+}
+
+//
+// How many parts of p from index on the key stands for, or 0 if it isn't on the path.
+// A key with dots in it is several parts, since that is how group::set() stores it.
+inline size_t match_path_key(const std::string& key, const path& p, size_t index) {
+    size_t start = 0;
+    size_t count = 0;
+    while (index + count < p.size()) {
+        size_t end = key.find('.', start);
+        size_t length = end == std::string::npos ? key.size() - start : end - start;
+        if (key.compare(start, length, p[index + count]) != 0) {
+            return 0;
+        }
+        count++;
+        if (end == std::string::npos) {
+            return count;
+        }
+        start = end + 1;
+    }
+    return 0;
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_ELEMENT_READER_H_
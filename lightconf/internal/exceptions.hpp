@@ -52,6 +52,15 @@ private:
     int                 col_;
 };
 
+//
+//
+class io_error : public lightconf_error {
+public:
+    explicit io_error(const std::string& what) :
+        lightconf_error(what)
+    { }
+};
+
 //
 //
 class utf8_error : public parse_error {
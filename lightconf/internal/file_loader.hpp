@@ -0,0 +1,170 @@
+#ifndef _LIGHTCONF_FILE_LOADER_H_
+#define _LIGHTCONF_FILE_LOADER_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "config_format.hpp"
+#include "exceptions.hpp"
+#include "group.hpp"
+#include "thread_pool.hpp"
+#include "value.hpp"
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#endif
+
+namespace lightconf {
+////////////////////
+
+//
+// What load_files() made of one file: the group read from it, or the error that reading
+// it failed with
+struct loaded_file {
+    group               grp;
+    bool                failed;
+    std::string         error;              // what() of the error
+    int                 line;               // of a parse_error, 0 for any other error
+    int                 col;
+
+    loaded_file() : grp(), failed(false), error(), line(0), col(0) { }
+};
+
+typedef std::map<std::string, loaded_file> loaded_files;
+typedef group (*file_read_function)(const std::string& filename);
+
+//
+// Reading a set of files at once, such as a directory of .config fragments:
+//
+//     thread_pool pool(8);
+//     loaded_files files = load_files("/etc/service/conf.d", pool);
+//     for (const auto& file : files) {
+//         if (file.second.failed) {
+//             ...
+//         }
+//     }
+//     group config = merge_files(files);
+//
+// The files are read on the pool, one file to a job, and the results are keyed by file
+// name. A file that can't be read or parsed doesn't stop the others.
+
+std::vector<std::string> find_files(const std::string& pattern);
+loaded_files            load_files(const std::vector<std::string>& filenames, thread_pool& pool,
+                            file_read_function read = config_format::read_file);
+loaded_files            load_files(const std::string& pattern, thread_pool& pool,
+                            file_read_function read = config_format::read_file);
+group                   merge_files(const loaded_files& files);
+void                    merge_group(group& dst, const group& src);
+
+//
+// The regular files in a directory, leaving out hidden ones, or else the files matching
+// a glob pattern, in sorted order. A pattern that matches nothing gives no files.
+inline std::vector<std::string> find_files(const std::string& pattern) {
+    std::vector<std::string> filenames;
+#if !defined(_WIN32)
+    struct stat st;
+    if (::stat(pattern.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR *dir = ::opendir(pattern.c_str());
+        if (!dir) {
+            throw io_error("could not open " + pattern + ": " + std::strerror(errno));
+        }
+        std::string prefix = pattern.back() == '/' ? pattern : pattern + "/";
+        while (struct dirent *entry = ::readdir(dir)) {
+            std::string filename = prefix + entry->d_name;
+            if (entry->d_name[0] != '.' && ::stat(filename.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                filenames.push_back(filename);
+            }
+        }
+        ::closedir(dir);
+    } else {
+        glob_t matches;
+        int result = ::glob(pattern.c_str(), 0, nullptr, &matches);
+        if (result != 0 && result != GLOB_NOMATCH) {
+            throw io_error("could not list " + pattern);
+        }
+        for (size_t i = 0; result == 0 && i < matches.gl_pathc; i++) {
+            filenames.push_back(matches.gl_pathv[i]);
+        }
+        ::globfree(&matches);
+    }
+#else
+    throw io_error("could not list " + pattern + ": not supported on this platform");
+#endif
+    std::sort(filenames.begin(), filenames.end());
+    return filenames;
+}
+
+//
+// Each file is read with read, config_format::read_file unless given, which maps it and
+// parses it in place
+inline loaded_files load_files(const std::vector<std::string>& filenames, thread_pool& pool,
+        file_read_function read) {
+    std::vector<loaded_file> results(filenames.size());
+    pool.run(filenames.size(), [&](size_t i) {
+        loaded_file& result = results[i];
+        try {
+            result.grp = read(filenames[i]);
+        } catch (const parse_error& e) {
+            result.failed = true;
+            result.error = e.what();
+            result.line = e.line();
+            result.col = e.col();
+        } catch (const lightconf_error& e) {
+            result.failed = true;
+            result.error = e.what();
+        }
+    });
+
+    loaded_files files;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        std::swap(files[filenames[i]], results[i]);
+    }
+    return files;
+}
+
+//
+//
+inline loaded_files load_files(const std::string& pattern, thread_pool& pool, file_read_function read) {
+    return load_files(find_files(pattern), pool, read);
+}
+
+//
+// The groups of the files that were read, merged in file name order with merge_group().
+// Files that failed are left out.
+inline group merge_files(const loaded_files& files) {
+    group merged;
+    for (const auto& file : files) {
+        if (!file.second.failed) {
+            merge_group(merged, file.second.grp);
+        }
+    }
+    return merged;
+}
+
+//
+// Sets each entry of src in dst, merging a group into a group already at the same key,
+// so that a later file can add to a group from an earlier one. Anything else replaces
+// what was there, keeping the key where it was first set.
+inline void merge_group(group& dst, const group& src) {
+    for (const auto& key : src) {
+        const value& val = src.get<value>(key);
+        if (val.is<group>() && dst.has<group>(key)) {
+            group sub = dst.get<group>(key);
+            merge_group(sub, val.get<group>());
+            dst.set<group>(key, std::move(sub));
+        } else {
+            dst.set<value>(key, val);
+        }
+    }
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_FILE_LOADER_H_
@@ -1,9 +1,13 @@
 #ifndef _LIGHTCONF_GROUP_H_
 #define _LIGHTCONF_GROUP_H_
 
-#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
 #include <type_traits>
 #include <vector>
+#include "arena.hpp"
 #include "path.hpp"
 
 namespace lightconf {
@@ -12,16 +16,30 @@ namespace lightconf {
 class value;
 template <typename T> struct value_type_info;
 
-typedef std::map<std::string, value> value_map_type;
-
 template <typename T>
 using return_type = decltype(value_type_info<T>::extract_value(std::declval<value>()));
 
+// Groups with no more entries than this are searched in order, without a hash index
+const size_t group_index_min_size = 8;
+
+//
+// The entries of a group are kept in the order their keys were first set, each key
+// stored once as an atom, with an open-addressing hash index over them once there are
+// more than a few. An entry that is unset keeps its place, with its key cleared, until enough of
+// them build up to be worth compacting away, so lookups, sets and unsets all take
+// constant time on average.
 //
+// Setting a new key may move the values of the others, so a reference from
+// get<value>() shouldn't be held on to across it; the string, vector or group in a
+// value stays where it is.
 //
+// A group made with an arena keeps its entries, and everything set in it, in the arena,
+// which has to outlive it; whatever is set in it is moved into the arena first, and
+// what is replaced or unset isn't freed until the arena is. Copying a group gives one
+// on the heap, while moving one keeps it in the arena it was in.
 class group {
 public:
-    typedef std::vector<std::string>::const_iterator const_iterator;
+    class const_iterator;
     typedef std::vector<std::string>::size_type size_type;
 
     template <typename T>
@@ -30,31 +48,91 @@ public:
     return_type<T>      get(const path& key, const T& def) const;
     template <typename T>
     void                set(const path& key, const T& val = T());
+    template <typename T, typename = typename std::enable_if<!std::is_lvalue_reference<T>::value>::type>
+    void                set(const path& key, T&& val);
+    template <typename... Args>
+    value&              emplace(const path& key, Args&&... args);
     template <typename T>
     bool                has(const path& key) const;
     void                unset(const path& key);
 
     bool                operator==(const group& rhs) const;
 
-    const_iterator      begin() const { return order_.begin(); }
-    const_iterator      end() const { return order_.end(); }
+    const_iterator      begin() const;
+    const_iterator      end() const;
 
-    size_type           size() const { return order_.size(); }
+    size_type           size() const { return size_; }
+    arena *             mem() const { return keys_.get_allocator().mem(); }
 
+    group&              operator=(const group& rhs);
+    group&              operator=(group&& rhs);
+
+    explicit group(arena& mem);
+    group(group&& rhs, arena& mem);
+    group(const group& rhs);
+    group(group&& rhs) noexcept;
     group();
 private:
+    static const size_t npos = (size_t)-1;
+
     template <typename InputIterator>
     const value *       find_value(InputIterator first, InputIterator last, const group **parent_group, path *key_rest) const;
-    template <typename InputIterator, typename T>
-    value *             create_value(InputIterator first, InputIterator last, const T& val);
-    void                set_key(const std::string& key, const value& val);    
+    template <typename InputIterator>
+    value *             create_value(InputIterator first, InputIterator last, value&& val);
+    value *             set_key(const atom& key, value&& val);
+    void                adopt(value& val) const;
+    void                clear();
+    void                erase_key(const atom& key);
+    size_t              find_entry(const atom& key) const;
+    size_t              find_slot(const atom& key) const;
+    void                rebuild_index();
+    void                compact();
 
-    value_map_type      values_;
-    std::vector<std::string> order_;
+    arena_vector<atom>  keys_;              // in the order they were set, empty for an unset entry
+    arena_vector<value> values_;            // the value for each of keys_
+    arena_vector<uint32_t> index_;          // a position in keys_ plus one, or 0 for an empty slot
+    size_type           size_;              // keys that are set
 };
 
+//
+// Goes through the keys of a group in the order they were set
+class group::const_iterator {
+public:
+    typedef std::forward_iterator_tag   iterator_category;
+    typedef std::string                 value_type;
+    typedef std::ptrdiff_t              difference_type;
+    typedef const std::string *         pointer;
+    typedef const std::string&          reference;
+
+    reference           operator*() const   { return it_->str(); }
+    pointer             operator->() const  { return &it_->str(); }
+    const_iterator&     operator++()        { ++it_; skip(); return *this; }
+    const_iterator      operator++(int)     { const_iterator it = *this; ++*this; return it; }
+    bool                operator==(const const_iterator& rhs) const { return it_ == rhs.it_; }
+    bool                operator!=(const const_iterator& rhs) const { return it_ != rhs.it_; }
+
+    const_iterator(const atom *it, const atom *end) : it_(it), end_(end) { skip(); }
+    const_iterator() : it_(nullptr), end_(nullptr) { }
+private:
+    void                skip()              { while (it_ != end_ && it_->empty()) ++it_; }
+
+    const atom *        it_;
+    const atom *        end_;
+};
+
+//
+//
+inline group::const_iterator group::begin() const {
+    return const_iterator(keys_.data(), keys_.data() + keys_.size());
+}
+
+//
+//
+inline group::const_iterator group::end() const {
+    return const_iterator(keys_.data() + keys_.size(), keys_.data() + keys_.size());
+}
+
 ////////////////////
 }
 
 #endif // _LIGHTCONF_GROUP_H_
-
@@ -0,0 +1,164 @@
+#ifndef _LIGHTCONF_GROUP_BUILDER_H_
+#define _LIGHTCONF_GROUP_BUILDER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "group.hpp"
+#include "string_ref.hpp"
+#include "value.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// A group or vector that is still being filled in, with the key of the entry being
+// read into it
+struct build_frame {
+    bool                is_vector;
+    bool                braces;             // for a .config group, whether it is in braces
+    group               grp;
+    value_vector_type   vec;
+    std::string         key;
+    arena *             mem;                // what the document is read into, or null for the heap
+
+    value               take();
+
+    explicit build_frame(arena *mem) :
+        is_vector(false), braces(true), grp(mem ? group(*mem) : group()), vec(), key(), mem(mem) { }
+    build_frame() : is_vector(false), braces(true), grp(), vec(), key(), mem(nullptr) { }
+};
+
+value                   read_string_value(string_ref str, arena *mem);
+
+//
+// Builds a group out of the events reported by a format's token_parser. The groups and
+// vectors still being filled in are kept on an explicit stack; each one is added to its
+// parent when it ends, under the key that preceded it. It has the same callbacks as
+// handler, but is used directly rather than through virtual calls.
+class group_builder {
+public:
+    void                begin_group();
+    void                end_group();
+    void                begin_vector();
+    void                end_vector();
+    void                on_key(string_ref key);
+    void                on_number(double val);
+    void                on_string(string_ref val);
+    void                on_bool(bool val);
+
+    group&              result()            { return result_; }
+    void                reset();
+
+    explicit group_builder(arena *mem = nullptr);
+private:
+    void                add(value&& val);
+
+    std::vector<build_frame> stack_;
+    group               result_;
+    arena *             mem_;               // what the result is built in, or null for the heap
+};
+
+//
+// The group or vector the frame has built, moved out of it into a value
+inline value build_frame::take() {
+    if (is_vector) {
+        return mem ? value(std::move(vec), *mem) : value(std::move(vec));
+    }
+    return mem ? value(std::move(grp), *mem) : value(std::move(grp));
+}
+
+//
+// A string that has been read, as a value in mem if there is one
+inline value read_string_value(string_ref str, arena *mem) {
+    return mem ? value(str.str(), *mem) : value(str.str());
+}
+
+//
+//
+inline group_builder::group_builder(arena *mem) :
+    stack_(),
+    result_(mem ? group(*mem) : group()),
+    mem_(mem)
+{ }
+
+//
+// Drops whatever a parse that failed part way left half built, so the builder can be
+// used again
+inline void group_builder::reset() {
+    stack_.clear();
+}
+
+//
+//
+inline void group_builder::begin_group() {
+    stack_.push_back(build_frame(mem_));
+}
+
+//
+// The outermost group is the result
+inline void group_builder::end_group() {
+    if (stack_.size() == 1) {
+        result_ = std::move(stack_.back().grp);
+        stack_.pop_back();
+    } else {
+        value val(stack_.back().take());
+        stack_.pop_back();
+        add(std::move(val));
+    }
+}
+
+//
+//
+inline void group_builder::begin_vector() {
+    stack_.push_back(build_frame(mem_));
+    stack_.back().is_vector = true;
+}
+
+//
+//
+inline void group_builder::end_vector() {
+    value val(stack_.back().take());
+    stack_.pop_back();
+    add(std::move(val));
+}
+
+//
+//
+inline void group_builder::on_key(string_ref key) {
+    stack_.back().key.assign(key.data(), key.size());
+}
+
+//
+//
+inline void group_builder::on_number(double val) {
+    add(value(val));
+}
+
+//
+//
+inline void group_builder::on_string(string_ref val) {
+    add(read_string_value(val, mem_));
+}
+
+//
+//
+inline void group_builder::on_bool(bool val) {
+    add(value(val));
+}
+
+//
+//
+inline void group_builder::add(value&& val) {
+    build_frame& top = stack_.back();
+    if (top.is_vector) {
+        top.vec.push_back(std::move(val));
+    } else {
+        top.grp.set(top.key, std::move(val));
+    }
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_GROUP_BUILDER_H_
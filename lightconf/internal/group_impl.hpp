@@ -1,7 +1,7 @@
 #ifndef _LIGHTCONF_GROUP_IMPL_H_
 #define _LIGHTCONF_GROUP_IMPL_H_
 
-#include <algorithm>
+#include <utility>
 #include "group.hpp"
 #include "value_impl.hpp"
 #include "path.hpp"
@@ -12,34 +12,117 @@ namespace lightconf {
 
 //
 //
-inline group::group() : values_(), order_()
+inline group::group() : keys_(), values_(), index_(), size_(0)
 { }
 
 //
 //
-inline bool group::operator==(const group& rhs) const {
-    if (values_.size() != rhs.values_.size()) {
-        return false;
+inline group::group(arena& mem) :
+    keys_(arena_allocator<atom>(&mem)),
+    values_(arena_allocator<value>(&mem)),
+    index_(arena_allocator<uint32_t>(&mem)),
+    size_(0)
+{ }
+
+//
+// The copy is always on the heap, whatever rhs is in
+inline group::group(const group& rhs) :
+    keys_(rhs.keys_),
+    values_(rhs.values_),
+    index_(rhs.index_),
+    size_(rhs.size_)
+{ }
+
+//
+// Takes the entries of rhs along with its arena, if it has one, leaving it empty
+inline group::group(group&& rhs) noexcept :
+    keys_(std::move(rhs.keys_)),
+    values_(std::move(rhs.values_)),
+    index_(std::move(rhs.index_)),
+    size_(rhs.size_)
+{
+    rhs.clear();
+}
+
+//
+// Takes the entries of rhs if it is in mem already, and otherwise moves them into mem
+// one by one, copying any in another arena
+inline group::group(group&& rhs, arena& mem) : group(mem) {
+    if (rhs.mem() == &mem) {
+        *this = std::move(rhs);
+        return;
     }
+    for (size_t i = 0; i < rhs.keys_.size(); i++) {
+        if (!rhs.keys_[i].empty()) {
+            set_key(rhs.keys_[i], rhs.mem() ? value(rhs.values_[i]) : std::move(rhs.values_[i]));
+        }
+    }
+    rhs.clear();
+}
 
-    auto it1 = std::begin(values_);
-    auto it2 = std::begin(rhs.values_);
-    while (it1 != std::end(values_)) {
-        if (*it1 != *it2) {
-            return false;
+//
+// A group keeps its own arena, or lack of one, when assigned to
+inline group& group::operator=(const group& rhs) {
+    if (&rhs != this) {
+        if (mem()) {
+            *this = group(rhs);
+        } else {
+            keys_ = rhs.keys_;
+            values_ = rhs.values_;
+            index_ = rhs.index_;
+            size_ = rhs.size_;
+        }
+    }
+    return *this;
+}
+
+//
+// The entries of rhs are only taken over as they are if both groups are in the same
+// arena or both on the heap. rhs is set aside before this group is cleared, since it
+// may be part of it.
+inline group& group::operator=(group&& rhs) {
+    if (&rhs == this) {
+        return *this;
+    }
+    if (mem() == rhs.mem()) {
+        keys_ = std::move(rhs.keys_);
+        values_ = std::move(rhs.values_);
+        index_ = std::move(rhs.index_);
+        size_ = rhs.size_;
+        rhs.clear();
+    } else if (rhs.mem()) {
+        *this = static_cast<const group&>(rhs);
+    } else {
+        group src(std::move(rhs));
+        clear();
+        for (size_t i = 0; i < src.keys_.size(); i++) {
+            if (!src.keys_[i].empty()) {
+                set_key(src.keys_[i], std::move(src.values_[i]));
+            }
         }
-        ++it1;
-        ++it2;
+    }
+    return *this;
+}
+
+//
+// Groups are equal if they have the same keys in the same order, with equal values
+inline bool group::operator==(const group& rhs) const {
+    if (size_ != rhs.size_) {
+        return false;
     }
 
-    auto it3 = std::begin(order_);
-    auto it4 = std::begin(rhs.order_);
-    while (it3 != std::end(order_)) {
-        if (*it3 != *it4) {
+    size_t i = 0;
+    size_t j = 0;
+    for (size_type n = 0; n < size_; n++, i++, j++) {
+        while (keys_[i].empty()) {
+            i++;
+        }
+        while (rhs.keys_[j].empty()) {
+            j++;
+        }
+        if (keys_[i] != rhs.keys_[j] || !(values_[i] == rhs.values_[j])) {
             return false;
         }
-        ++it3;
-        ++it4;
     }
     return true;
 }
@@ -78,22 +161,39 @@ inline return_type<T> group::get(const path& key, const T& def) const {
 //
 template <typename T>
 inline void group::set(const path& key, const T& val) {
+    emplace(key, value_type_info<T>::create_value(val));
+}
+
+//
+// For a temporary, or something the caller is done with, so that a string, vector or
+// group is moved into the group rather than copied
+template <typename T, typename>
+inline void group::set(const path& key, T&& val) {
+    emplace(key, value_type_info<typename std::remove_const<T>::type>::create_value(std::move(val)));
+}
+
+//
+// Sets the value at key to value(args...), built before anything in the group is
+// changed, so args may refer to a value in it. Returns the value that was set.
+template <typename... Args>
+inline value& group::emplace(const path& key, Args&&... args) {
     const value *result_const;
     const group *parent_group_const;
-    group *parent_group;
-    value *result;
     path key_rest;
 
     result_const = find_value(std::begin(key), std::end(key), &parent_group_const, &key_rest);
 
-    parent_group = const_cast<group *>(parent_group_const);
-    result = const_cast<value *>(result_const);
+    // we can safely strip constness because we know our child groups are not const
+    group *parent_group = const_cast<group *>(parent_group_const);
+    value *result = const_cast<value *>(result_const);
 
+    value val(std::forward<Args>(args)...);
     if (result) {
-        *result = value_type_info<T>::create_value(val);
-    } else {
-        parent_group->create_value(std::begin(key_rest), std::end(key_rest), val);
+        parent_group->adopt(val);
+        *result = std::move(val);
+        return *result;
     }
+    return *parent_group->create_value(std::begin(key_rest), std::end(key_rest), std::move(val));
 }
 
 //
@@ -114,22 +214,18 @@ inline bool group::has(const path& key) const {
 //
 //
 inline void group::unset(const path& key) {
-    const value *result_const;
+    const value *result;
     const group *parent_group_const;
     group *parent_group;
-    value *result;
     path key_rest;
 
-    result_const = find_value(std::begin(key), std::end(key), &parent_group_const, &key_rest);
+    result = find_value(std::begin(key), std::end(key), &parent_group_const, &key_rest);
 
     parent_group = const_cast<group *>(parent_group_const);
-    result = const_cast<value *>(result_const);
 
     if (result) {
-        parent_group->values_.erase(*(std::end(key) - 1));
-        auto it = std::find(parent_group->order_.begin(), parent_group->order_.end(), *(std::end(key) - 1));
-        parent_group->order_.erase(it);
-    } 
+        parent_group->erase_key(*(std::end(key) - 1));
+    }
 }
 
 //
@@ -142,24 +238,24 @@ inline const value *group::find_value(InputIterator first, InputIterator last,
         throw path_error("value at empty path requested");
     }
 
-    auto it = values_.find(*first);
+    size_t pos = find_entry(*first);
     if (first == last - 1) {
-        if (it == values_.end()) {
+        if (pos == npos) {
             *parent_group = this;
             *key_rest = path(first, last);
             return 0;
         } else {
             *parent_group = this;
             *key_rest = path();
-            return &it->second;
+            return &values_[pos];
         }
     } else {
-        if (it == values_.end() || !it->second.template is<group>()) {
+        if (pos == npos || !values_[pos].template is<group>()) {
             *parent_group = this;
             *key_rest = path(first, last);
             return 0;
         } else {
-            const group& grp = it->second.template get<group>();
+            const group& grp = values_[pos].template get<group>();
             return grp.find_value(first + 1, last, parent_group, key_rest);
         }
     }
@@ -167,18 +263,19 @@ inline const value *group::find_value(InputIterator first, InputIterator last,
 
 //
 //
-template <typename InputIterator, typename T>
-inline value *group::create_value(InputIterator first, InputIterator last, const T& val) {
+template <typename InputIterator>
+inline value *group::create_value(InputIterator first, InputIterator last, value&& val) {
     if (first == last) {
         throw path_error("value at empty path created");
     }
 
-    char c = (*first)[0];
+    const std::string& key = first->str();
+    char c = key[0];
     if ((c < 'A' || c > 'Z') && (c < 'a' || c > 'z')) {
         throw path_error("key starts with an invalid character");
     }
 
-    for (char c : *first) {
+    for (char c : key) {
         if ((c < 'A' || c > 'Z') && (c < 'a' || c > 'z')
             && (c < '0' || c > '9') && c != '_' && c != '-') {
             throw path_error("key contains an invalid character");
@@ -186,25 +283,166 @@ inline value *group::create_value(InputIterator first, InputIterator last, const
     }
 
     if (first == last - 1) {
-        set_key(*first, value_type_info<T>::create_value(val));
-        return &values_.at(*first);
+        return set_key(*first, std::move(val));
     } else {
-        set_key(*first, value(group()));
-        const group& grp_const = values_.at(*first).template get<group>();
+        const group& grp_const = set_key(*first, value(group()))->template get<group>();
 
         // we can safely strip constness because we know our child groups are not const
         group& grp = const_cast<group&>(grp_const);
-        return grp.create_value(first + 1, last, val);
+        return grp.create_value(first + 1, last, std::move(val));
     }
 }
 
 //
+// A new key goes after the others; setting one that is already there keeps its place
+inline value *group::set_key(const atom& key, value&& val) {
+    adopt(val);
+    size_t pos = find_entry(key);
+    if (pos != npos) {
+        values_[pos] = std::move(val);
+        return &values_[pos];
+    }
+
+    if (mem() && !key.interned()) {
+        keys_.push_back(atom(key, *mem()));
+    } else {
+        keys_.push_back(key);
+    }
+    values_.push_back(std::move(val));
+    size_++;
+    // a group that has shrunk back past the threshold may still have its index
+    if (!index_.empty() || keys_.size() > group_index_min_size) {
+        if (keys_.size() * 2 > index_.size()) {
+            rebuild_index();
+        } else {
+            index_[find_slot(key)] = (uint32_t)keys_.size();
+        }
+    }
+    return &values_.back();
+}
+
 //
-inline void group::set_key(const std::string& key, const value& val) {
-    if (values_.find(key) == values_.end()) {
-        order_.push_back(key);
+// The entry is only marked as unset, by clearing its key; the ones at the end are
+// dropped straight away, and the rest once they outnumber the keys that are set.
+// Taking an entry out of the index moves the ones probed past it back into the gap,
+// so a lookup never has to step over a removed one.
+inline void group::erase_key(const atom& key) {
+    size_t pos = find_entry(key);
+    if (pos == npos) {
+        return;
+    }
+
+    if (!index_.empty()) {
+        size_t mask = index_.size() - 1;
+        size_t slot = find_slot(key);
+        for (size_t next = (slot + 1) & mask; index_[next]; next = (next + 1) & mask) {
+            size_t home = keys_[index_[next] - 1].hash() & mask;
+            if (((next - home) & mask) >= ((next - slot) & mask)) {
+                index_[slot] = index_[next];
+                slot = next;
+            }
+        }
+        index_[slot] = 0;
+    }
+
+    keys_[pos] = atom();
+    values_[pos] = value();
+    size_--;
+    while (!keys_.empty() && keys_.back().empty()) {
+        keys_.pop_back();
+        values_.pop_back();
+    }
+    if (keys_.size() > size_ * 2) {
+        compact();
+    }
+}
+
+//
+// The position of key in keys_, or npos
+inline size_t group::find_entry(const atom& key) const {
+    if (key.empty()) {
+        return npos;
+    }
+    if (!index_.empty()) {
+        uint32_t entry = index_[find_slot(key)];
+        return entry ? entry - 1 : npos;
+    }
+    for (size_t i = 0; i < keys_.size(); i++) {
+        if (keys_[i] == key) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+//
+// The slot in index_ that key is in, or else the empty one where it would go
+inline size_t group::find_slot(const atom& key) const {
+    size_t mask = index_.size() - 1;
+    size_t slot = key.hash() & mask;
+    while (index_[slot] && keys_[index_[slot] - 1] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+//
+// Sizes the index to between a quarter and a half full, counting unset entries as
+// full, or drops it for a group small enough to go without
+inline void group::rebuild_index() {
+    index_.clear();
+    if (keys_.size() <= group_index_min_size) {
+        index_.shrink_to_fit();
+        return;
+    }
+    size_t capacity = 16;
+    while (capacity < keys_.size() * 4) {
+        capacity *= 2;
+    }
+    index_.resize(capacity);
+    for (size_t i = 0; i < keys_.size(); i++) {
+        if (!keys_[i].empty()) {
+            index_[find_slot(keys_[i])] = (uint32_t)(i + 1);
+        }
+    }
+}
+
+//
+// Makes val fit to be set in this group: moved into its arena if it has one, or copied
+// out of the arena it is in if it hasn't
+inline void group::adopt(value& val) const {
+    if (mem() && val.on_heap()) {
+        val = value(std::move(val), *mem());
+    } else if (!mem() && val.arena_) {
+        val = value(static_cast<const value&>(val));
+    }
+}
+
+//
+// Empties the group, keeping its arena
+inline void group::clear() {
+    keys_.clear();
+    values_.clear();
+    index_.clear();
+    size_ = 0;
+}
+
+//
+// Closes up the entries that were unset, keeping the others in order
+inline void group::compact() {
+    size_t n = 0;
+    for (size_t i = 0; i < keys_.size(); i++) {
+        if (!keys_[i].empty()) {
+            if (i != n) {
+                keys_[n].swap(keys_[i]);
+                values_[n].swap(values_[i]);
+            }
+            n++;
+        }
     }
-    values_[key] = val;
+    keys_.resize(n);
+    values_.resize(n);
+    rebuild_index();
 }
 
 ////////////////////
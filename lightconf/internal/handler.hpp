@@ -0,0 +1,53 @@
+#ifndef _LIGHTCONF_HANDLER_H_
+#define _LIGHTCONF_HANDLER_H_
+
+#include "scanner.hpp"
+#include "string_ref.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// Receives a document as a stream of events, for callers that want to pick values out
+// as they are parsed rather than building a group. Every callback does nothing by
+// default, so a handler only overrides the ones it cares about.
+//
+// The document itself is reported as the outermost begin_group()/end_group() pair. Each
+// entry of a group is an on_key() followed by its value: one on_number(), on_string()
+// or on_bool(), or a nested begin_group()/end_group() or begin_vector()/end_vector().
+// Keys are passed exactly as written, so a key such as "a.b" is not split into a path.
+//
+// The text passed to on_key() and on_string() is only valid during the call.
+class handler {
+public:
+    virtual void        begin_group()                   { }
+    virtual void        end_group()                     { }
+    virtual void        begin_vector()                  { }
+    virtual void        end_vector()                    { }
+    virtual void        on_key(string_ref key)          { }
+    virtual void        on_number(double val)           { }
+    virtual void        on_string(string_ref val)       { }
+    virtual void        on_bool(bool val)               { }
+
+    virtual ~handler() { }
+};
+
+//
+// Feeds a format's token_parser every significant token from the scanner, up to and
+// including the end of the input or until the parser has seen a whole document
+template <typename Parser>
+inline void parse_tokens(scanner& sc, Parser& parser) {
+    while (!parser.done()) {
+        const token& tok = sc.peek_token();
+        parser.feed(sc, tok);
+        if (tok.type == token_type::eof_token) {
+            break;
+        }
+        sc.next_token();
+    }
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_HANDLER_H_
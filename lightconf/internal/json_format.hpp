@@ -2,199 +2,1883 @@
 #define _LIGHTCONF_JSON_FORMAT_H_
 
 #include <algorithm>
+#include <atomic>
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
+#include "element_reader.hpp"
 #include "group.hpp"
+#include "group_builder.hpp"
+#include "handler.hpp"
+#include "mapped_file.hpp"
+#include "projection.hpp"
+#include "push_parser.hpp"
+#include "read_limits.hpp"
 #include "scanner.hpp"
+#include "structural_index.hpp"
+#include "thread_pool.hpp"
 #include "util.hpp"
+#include "value_source.hpp"
 #include "writer.hpp"
 
 namespace lightconf { namespace json_format {
 ////////////////////
 
+//
+// The JSON grammar as a state machine that is handed one significant token at a time,
+// so it can run on input that arrives in pieces. What it parses is reported to the
+// handler as events (see handler; group_builder is the one that builds a group). It
+// accepts exactly what read_group(sc, false) accepts and fails with the same errors;
+// tokens after the closing brace of the document are ignored.
+template <typename Handler>
+class token_parser {
+public:
+    typedef Handler     handler_type;
+
+    void                feed(const scanner& sc, const token& tok);
+    bool                done() const        { return state_ == state::done; }
+
+    explicit token_parser(Handler& handler, const read_limits& limits = default_read_limits);
+private:
+    enum class state { start, key, colon, value, group_comma, vector_entry, vector_comma, done };
+    enum class frame { group, vector };
+
+    void                end_container();
+    void                read_scalar(const scanner& sc, const token& tok);
+
+    Handler&            handler_;
+    state               state_;
+    std::vector<frame>  stack_;
+    limit_checker       check_;
+};
+
+//
+// Stage two of the JSON reader, which walks the token starts found by structural_index
+// and reports the document to the handler. String literals with escape sequences, and
+// the token after the end of the document that read_group would scan ahead to, are
+// handed to a scanner so they come out exactly as they do from the token-based reader.
+// parse() returns false as soon as it finds something read_group(sc, false) would fail
+// on, a document over the read_limits included, by which time the events before that
+// point have been reported.
+template <typename Handler>
+class structural_parser {
+public:
+    bool                parse(const char *input, size_t size, const structural_index& index);
+    bool                parse(const char *input, size_t size, const uint32_t *first, const uint32_t *last,
+                            const uint32_t **end);
+
+    explicit structural_parser(Handler& handler, const read_limits& limits = default_read_limits);
+private:
+    enum class state { key, colon, value, group_comma, vector_entry, vector_comma };
+    enum class frame { group, vector };
+
+    bool                read_string(unsigned int pos, string_ref *text, unsigned int *end);
+    bool                read_scalar(unsigned int pos);
+    bool                token_ends(const char *p) const;
+    bool                scan_token_at(unsigned int pos);
+
+    Handler&            handler_;
+    const char *        input_;
+    size_t              size_;
+    const scan_kernels *kernels_;
+    scanner             scanner_;
+    std::string         string_buf_;
+    std::vector<frame>  stack_;
+    limit_checker       check_;
+};
+
+typedef basic_group_push_parser<token_parser> push_parser;
+typedef basic_push_parser<token_parser<handler>> event_push_parser;
+
+//
+// The JSON syntax for basic_element_reader
+struct element_syntax {
+    static bool         seek(scanner& sc, const path& p, size_t index, bool braces);
+    static bool         next(scanner& sc, value *out);
+};
+
+typedef basic_element_reader<element_syntax> element_reader;
+
+//
+// The scanner and structural index that a document is read with when document_reader
+// can't read it from the index of the text around it, kept from one document to the
+// next so that their storage is reused
+class document_parser {
+public:
+    size_t              read(const char *text, size_t size, size_t first, size_t last, group *out);
+    void                set_origin(int line, int col);
+
+    explicit document_parser(const read_limits& limits = default_read_limits);
+private:
+    read_limits         limits_;
+    scanner             sc_;
+    structural_index    index_;
+    int                 origin_line_;       // of the first byte of the text
+    int                 origin_col_;
+    size_t              located_;           // the last byte whose line and column were worked out
+    int                 line_;
+    int                 col_;
+};
+
+// How much of the text document_reader indexes at a time, unless a document is longer
+const size_t document_index_window = 1024 * 1024;
+
+//
+// Reads one document after another out of a buffer or a stream, one group at a time:
+// newline-delimited JSON, or any run of documents with only whitespace between them.
+//
+//     json_format::document_reader docs(std::cin);
+//     group doc;
+//     while (docs.next(&doc)) {
+//         ...
+//     }
+//
+// Each document is read as read_limited() reads one on its own, except that whatever
+// follows its closing brace is the next document. A document with an error in it throws
+// from next(), with the location of the error in the whole input, and the reader goes
+// on from the line after the one the document starts on, so the rest of a newline-
+// delimited input can still be read.
+//
+// The structural index is built over document_index_window bytes of the text at a time,
+// or as much as the longest document needs, and each document is parsed from its part
+// of the index. One and the same parser and builder are used for all of them.
+class document_reader {
+public:
+    bool                next(group *out);
+
+    document_reader(const char *text, size_t size, const read_limits& limits = default_read_limits);
+    explicit document_reader(std::istream& in, const read_limits& limits = default_read_limits);
+
+private:
+    document_reader(const document_reader&);
+    document_reader&    operator=(const document_reader&);
+
+    bool                read_indexed(size_t *first, group *out);
+    bool                fill();
+
+    std::istream *      in_;
+    std::string         buffer_;            // what has been read from in_ and not yet parsed
+    const char *        text_;
+    size_t              size_;
+    size_t              pos_;
+    int                 line_;              // of the first byte of text_
+    int                 col_;
+    read_limits         limits_;
+
+    structural_index    index_;             // of text_ from index_first_ to index_last_
+    size_t              index_first_;
+    size_t              index_last_;        // 0 if there is no index of text_
+    bool                indexed_;           // whether the window could be indexed
+    const uint32_t *    cur_;               // the first entry of index_ not yet parsed
+    group_builder       builder_;
+    structural_parser<group_builder> parser_;
+    document_parser     fallback_;
+};
+
+//
+// Writes the document that a parser reports to it as JSON, the way write() lays out a
+// group, without building one. Output goes to the stream as it is written.
+//
+// The keys are written as they come, so a key that appears more than once is written
+// each time, where a group would keep only the last value.
+class event_writer : public handler {
+public:
+    void                begin_group() override  { open('{'); }
+    void                end_group() override    { close('}'); }
+    void                begin_vector() override { open('['); }
+    void                end_vector() override   { close(']'); }
+    void                on_key(string_ref key) override;
+    void                on_number(double val) override;
+    void                on_string(string_ref val) override;
+    void                on_bool(bool val) override;
+
+    void                flush();
+
+    explicit event_writer(std::ostream& out);
+private:
+    void                open(char c);
+    void                close(char c);
+    void                separate();
+
+    std::ostream&       out_;
+    writer              wr_;
+    std::vector<size_t> counts_;            // entries written in each open object and array
+    bool                after_key_;
+};
+
+//
+// The JSON syntax as a value_source over a scanner, for read_as()
+class scanner_source : public value_source {
+public:
+    value_type          peek_type() override;
+    double              read_number() override;
+    void                read_string(std::string *out) override;
+    bool                read_bool() override;
+    void                read_group(group *out) override;
+    void                read_vector(value_vector_type *out) override;
+    void                read_value(value *out) override;
+    void                skip_value() override;
+
+    void                begin_group() override;
+    bool                next_key(std::string *key) override;
+    void                begin_vector() override;
+    bool                next_element() override;
+
+    explicit scanner_source(scanner& sc, const read_limits& limits = default_read_limits);
+private:
+    void                enter();
+    bool                next(char close);
+
+    scanner&            sc_;
+    limit_checker       check_;
+    std::vector<bool>   first_;             // for each open object and array, whether nothing is read in it yet
+};
+
+
+enum class read_step { value, entry, element, close };
 
 group                   read_group(scanner& sc, bool braces);
 value_vector_type       read_vector(scanner& sc);
 value                   read_value(scanner& sc);
+group                   read_group(scanner& sc, bool braces, limit_checker& check, arena *mem = nullptr);
+value_vector_type       read_vector(scanner& sc, limit_checker& check);
+value                   read_value(scanner& sc, limit_checker& check);
+void                    read_nested(scanner& sc, std::vector<build_frame>& stack, read_step step, limit_checker& check,
+                            arena *mem = nullptr);
+read_step               add_value(scanner& sc, build_frame& top, value&& val);
+value                   read_scalar(scanner& sc, limit_checker& check, arena *mem = nullptr);
+group                   read_group(scanner& sc, bool braces, const projection& proj);
+void                    skip_value(scanner& sc);
 
 void                    write_group(writer& wr, const group& gr);
 void                    write_vector(writer& wr, const value_vector_type& vec);
 void                    write_value(writer& wr, const value& val);
+void                    write_nested(writer& wr, const value *val, const group *grp, const value_vector_type *vec);
 
 group                   read(const std::string& src);
+group                   read(const std::string& src, const std::vector<path>& paths);
+element_reader          read_elements(const std::string& src, const path& p);
+element_reader          read_file_elements(const std::string& filename, const path& p);
+group                   read(const char *src, size_t size);
+group                   read_validated(const std::string& src);
+bool                    read_indexed(const char *src, size_t size, const structural_index& index, group *grp,
+                            const read_limits& limits = default_read_limits);
+group                   read(std::istream& in);
+group                   read_fd(int fd);
+group                   read_file(const std::string& filename);
+group                   read(const std::string& src, arena& mem);
+group                   read(const char *src, size_t size, arena& mem);
+group                   read_file(const std::string& filename, arena& mem);
+group                   read_limited(const char *src, size_t size, const read_limits& limits, arena *mem = nullptr);
+group                   read_limited(const std::string& src, const read_limits& limits);
+group                   read_file_limited(const std::string& filename, const read_limits& limits);
+template <typename T>
+T                       read_as(const std::string& src);
+template <typename T>
+T                       read_file_as(const std::string& filename);
+template <typename T>
+T                       read_as(scanner& sc);
+std::vector<group>      read_documents(const std::string& src);
+std::vector<group>      read_documents(const std::string& src, thread_pool& pool);
+std::vector<group>      read_documents(const char *src, size_t size, thread_pool& pool);
+std::vector<group>      read_documents(document_reader& reader);
+std::vector<group>      read_file_documents(const std::string& filename);
+std::vector<group>      read_file_documents(const std::string& filename, thread_pool& pool);
+size_t                  find_document(const char *text, size_t size, size_t pos);
+void                    parse(const std::string& src, handler& h);
+void                    parse(const char *src, size_t size, handler& h);
+void                    parse(std::istream& in, handler& h);
+void                    parse_file(const std::string& filename, handler& h);
 std::string             write(const group& grp);
 
 //
 //
-inline group read_group(scanner& sc, bool braces) {
-    group grp;
-    sc.expect('{');
+template <typename Handler>
+inline token_parser<Handler>::token_parser(Handler& handler, const read_limits& limits) :
+    handler_(handler),
+    state_(state::start),
+    stack_(),
+    check_(limits)
+{ }
 
-    while (!sc.peek_token().is_char('}')) {
-        std::string key = sc.expect_string();
-        sc.expect(':');
-        value val = read_value(sc);
-        grp.set(key, val);
+//
+// Each pass round the loop either consumes the token or moves to the state that will,
+// mirroring the points where read_group and read_vector peek without consuming
+template <typename Handler>
+inline void token_parser<Handler>::feed(const scanner& sc, const token& tok) {
+    while (true) {
+        switch (state_) {
+        case state::start:
+            if (!tok.is_char('{')) {
+                sc.fail("expected '{' but found " + token_name(tok), tok.pos);
+            }
+            check_.enter(sc, tok.pos, 1);
+            check_.node(sc, tok.pos);
+            handler_.begin_group();
+            stack_.push_back(frame::group);
+            state_ = state::key;
+            return;
 
-        if (sc.peek_token().is_char(',')) {
-            sc.expect(',');
-        } else {            
-            break;
+        case state::key:
+            if (tok.is_char('}')) {
+                handler_.end_group();
+                end_container();
+                return;
+            }
+            if (tok.type != token_type::string_token) {
+                sc.fail("expected string but found " + token_name(tok), tok.pos);
+            }
+            check_.string(sc, tok.pos, sc.token_text(tok).size());
+            handler_.on_key(sc.token_text(tok));
+            state_ = state::colon;
+            return;
+
+        case state::colon:
+            if (!tok.is_char(':')) {
+                sc.fail("expected ':' but found " + token_name(tok), tok.pos);
+            }
+            state_ = state::value;
+            return;
+
+        case state::value:
+            check_.node(sc, tok.pos);
+            if (tok.is_char('{') || tok.is_char('[')) {
+                check_.enter(sc, tok.pos, stack_.size() + 1);
+            }
+            if (tok.is_char('{')) {
+                handler_.begin_group();
+                stack_.push_back(frame::group);
+                state_ = state::key;
+            } else if (tok.is_char('[')) {
+                handler_.begin_vector();
+                stack_.push_back(frame::vector);
+                state_ = state::vector_entry;
+            } else {
+                read_scalar(sc, tok);
+                state_ = stack_.back() == frame::vector ? state::vector_comma : state::group_comma;
+            }
+            return;
+
+        case state::group_comma:
+            if (tok.is_char(',')) {
+                state_ = state::key;
+                return;
+            }
+            if (!tok.is_char('}')) {
+                sc.fail("expected '}' but found " + token_name(tok), tok.pos);
+            }
+            handler_.end_group();
+            end_container();
+            return;
+
+        case state::vector_entry:
+            if (tok.is_char(']')) {
+                handler_.end_vector();
+                end_container();
+                return;
+            }
+            state_ = state::value;
+            continue;
+
+        case state::vector_comma:
+            if (tok.is_char(',')) {
+                state_ = state::vector_entry;
+                return;
+            }
+            if (!tok.is_char(']')) {
+                sc.fail("expected ']' but found " + token_name(tok), tok.pos);
+            }
+            handler_.end_vector();
+            end_container();
+            return;
+
+        case state::done:
+            return;
         }
     }
-
-    sc.expect('}');
-    return grp;
 }
 
 //
 //
-inline value_vector_type read_vector(scanner& sc) {
-    sc.expect('[');
+template <typename Handler>
+inline void token_parser<Handler>::end_container() {
+    stack_.pop_back();
+    if (stack_.empty()) {
+        state_ = state::done;
+    } else {
+        state_ = stack_.back() == frame::vector ? state::vector_comma : state::group_comma;
+    }
+}
 
-    value_vector_type vec;
-    while (!sc.peek_token().is_char(']')) {
-        vec.push_back(read_value(sc));
-        if (sc.peek_token().is_char(',')) {
-            sc.expect(',');
+//
+//
+template <typename Handler>
+inline void token_parser<Handler>::read_scalar(const scanner& sc, const token& tok) {
+    switch (tok.type) {
+    case token_type::identifier_token: {
+        string_ref ident = sc.token_text(tok);
+        if (ident == "true") {
+            handler_.on_bool(true);
+        } else if (ident == "false") {
+            handler_.on_bool(false);
+        } else if (ident == "null") {
+            sc.fail("null is not a valid value", tok.pos);
         } else {
-            break;
+            sc.fail("unexpected identifier", tok.pos);
         }
+        break;
+    }
+    case token_type::string_token:
+        check_.string(sc, tok.pos, sc.token_text(tok).size());
+        handler_.on_string(sc.token_text(tok));
+        break;
+    case token_type::number_token:
+        handler_.on_number(tok.number_value);
+        break;
+    case token_type::char_token:
+        sc.fail("unexpected '" + std::string(1, tok.char_value) + "'", tok.pos);
+        break;
+    default:
+        sc.fail("unexpected token", tok.pos);
+        break;
     }
-
-    sc.expect(']');
-    return vec;
 }
 
 //
 //
-inline value read_value(scanner& sc) {
-    if (sc.peek_token().is_char('{')) {
-        return value(read_group(sc, true));
-    } else if (sc.peek_token().is_char('[')) {
-        return value(read_vector(sc));
-    } else {
-        switch (sc.peek_token().type) {
-        case token_type::identifier_token: {
-            std::string ident = sc.expect_identifier();
-            if (ident == "true") {
-                return value(true);
-            } else if (ident == "false") {
-                return value(false);
-            } else if (ident == "null") {
-                sc.fail("null is not a valid value", sc.peek_token().line, sc.peek_token().col);
-            } else {
-                sc.fail("unexpected identifier", sc.peek_token().line, sc.peek_token().col);
+template <typename Handler>
+inline structural_parser<Handler>::structural_parser(Handler& handler, const read_limits& limits) :
+    handler_(handler),
+    input_(nullptr),
+    size_(0),
+    kernels_(&active_scan_kernels()),
+    scanner_(),
+    string_buf_(),
+    stack_(),
+    check_(limits)
+{ }
+
+//
+//
+template <typename Handler>
+inline bool structural_parser<Handler>::parse(const char *input, size_t size, const structural_index& index) {
+    const uint32_t *end;
+    return parse(input, size, index.begin(), index.end(), &end);
+}
+
+//
+// The same grammar as token_parser, with each index entry standing for the token that
+// starts there. The document starts at the entry first, and *end is left after the
+// entry of its closing brace, or at the entry where it fails (last if it runs out).
+// The read_limits count from the start of each document, so a parser can read one
+// document after another.
+template <typename Handler>
+inline bool structural_parser<Handler>::parse(const char *input, size_t size, const uint32_t *first,
+        const uint32_t *last, const uint32_t **end) {
+    input_ = input;
+    size_ = size;
+    stack_.clear();
+    check_ = limit_checker(check_.limits());
+
+    const uint32_t *pos = first;
+    *end = pos;
+    if (pos == last || input[*pos] != '{' || !check_.allows_depth(1) || !check_.allows_node()) {
+        return false;
+    }
+    handler_.begin_group();
+    stack_.push_back(frame::group);
+    state st = state::key;
+
+    for (++pos; pos != last; ++pos) {
+        *end = pos;
+        char c = input[*pos];
+        bool close = false;
+
+        switch (st) {
+        case state::key: {
+            if (c == '}') {
+                close = true;
+                break;
             }
+            string_ref key;
+            unsigned int end;
+            if (c != '"' || !read_string(*pos, &key, &end) || (pos + 1 != last && pos[1] < end)
+                    || !check_.allows_string(key.size())) {
+                return false;
+            }
+            handler_.on_key(key);
+            st = state::colon;
             break;
         }
-        case token_type::string_token: {
-            std::string str = sc.expect_string();
-            return value(str);
-        }
-        case token_type::number_token: {
-            double dbl = sc.expect_number();
-            return value(dbl);
-        }
-        case token_type::char_token: {
-            sc.fail("unexpected '" + std::string(1, sc.peek_token().char_value) + "'",
-                sc.peek_token().line, sc.peek_token().col);
+
+        case state::colon:
+            if (c != ':') {
+                return false;
+            }
+            st = state::value;
             break;
-        }
-        default: {
-            sc.fail("unexpected token", sc.peek_token().line, sc.peek_token().col);
+
+        case state::vector_entry:
+            if (c == ']') {
+                close = true;
+                break;
+            }
+            // fall through
+        case state::value:
+            if (!check_.allows_node() || ((c == '{' || c == '[') && !check_.allows_depth(stack_.size() + 1))) {
+                return false;
+            }
+            if (c == '{') {
+                handler_.begin_group();
+                stack_.push_back(frame::group);
+                st = state::key;
+                break;
+            } else if (c == '[') {
+                handler_.begin_vector();
+                stack_.push_back(frame::vector);
+                st = state::vector_entry;
+                break;
+            } else if (c == '"') {
+                string_ref str;
+                unsigned int end;
+                if (!read_string(*pos, &str, &end) || (pos + 1 != last && pos[1] < end)
+                        || !check_.allows_string(str.size())) {
+                    return false;
+                }
+                handler_.on_string(str);
+            } else if (!read_scalar(*pos)) {
+                return false;
+            }
+            st = stack_.back() == frame::vector ? state::vector_comma : state::group_comma;
+            break;
+
+        case state::group_comma:
+            if (c == ',') {
+                st = state::key;
+            } else if (c == '}') {
+                close = true;
+            } else {
+                return false;
+            }
+            break;
+
+        case state::vector_comma:
+            if (c == ',') {
+                st = state::vector_entry;
+            } else if (c == ']') {
+                close = true;
+            } else {
+                return false;
+            }
             break;
         }
 
+        if (close) {
+            if (stack_.back() == frame::group) {
+                handler_.end_group();
+            } else {
+                handler_.end_vector();
+            }
+            stack_.pop_back();
+            if (stack_.empty()) {
+                // read_group scans one token past the end of the document, which fails
+                // if that token is malformed
+                *end = pos + 1;
+                return scan_token_at(*pos + 1);
+            }
+            st = stack_.back() == frame::vector ? state::vector_comma : state::group_comma;
         }
     }
-    return value();
+    *end = last;
+    return false;
 }
 
 //
 //
-inline void write_group(writer& wr, const group& gr) {
-    wr.append("{");
-    wr.indent();
-    wr.newline();
-
-    unsigned int i = 0;
-    for (const auto& key : gr) {
-        wr.append("\"");
-        wr.append(escape_string(key));
-        wr.append("\": ");
-        write_value(wr, gr.get<value>(key));
-
-        if (i < gr.size() - 1) {
-            wr.append(",");
-            wr.newline();
+template <typename Handler>
+inline bool structural_parser<Handler>::read_string(unsigned int pos, string_ref *text, unsigned int *end) {
+    const char *first = input_ + pos + 1;
+    const char *last = input_ + size_;
+    const char *p = kernels_->find_string_special(first, last);
+    if (p != last && *p == '"') {
+        *text = string_ref(first, p - first);
+        *end = (unsigned int)(p + 1 - input_);
+        return true;
+    }
+
+    // Single-character escapes are resolved here, the same way scan_string does
+    string_buf_.assign(first, p - first);
+    while (p != last && *p == '\\') {
+        if (last - p < 2 || p[1] == 'u') {
+            // leave \u escapes, with their surrogate pairs and replacement characters,
+            // to the scanner
+            if (!scan_token_at(pos)) {
+                return false;
+            }
+            const token& tok = scanner_.peek_token();
+            *text = scanner_.token_text(tok);
+            *end = pos + tok.length;
+            return true;
         }
-        i++;
+        switch (p[1]) {
+        case 'b':  string_buf_ += '\b'; break;
+        case 'f':  string_buf_ += '\f'; break;
+        case 't':  string_buf_ += '\t'; break;
+        case 'r':  string_buf_ += '\r'; break;
+        case 'n':  string_buf_ += '\n'; break;
+        default:   string_buf_ += p[1]; break;
+        }
+        first = p + 2;
+        p = kernels_->find_string_special(first, last);
+        string_buf_.append(first, p - first);
+    }
+    if (p == last || *p != '"') {
+        return false;
     }
+    *text = string_ref(string_buf_);
+    *end = (unsigned int)(p + 1 - input_);
+    return true;
+}
 
-    wr.unindent();
-    wr.newline();
-    wr.append("}");
+//
+//
+template <typename Handler>
+inline bool structural_parser<Handler>::read_scalar(unsigned int pos) {
+    const char *first = input_ + pos;
+    const char *last = input_ + size_;
+    char c = *first;
+    if ((c >= '0' && c <= '9') || c == '-' || c == '.') {
+        double val;
+        const char *p = parse_number(first, last, &val);
+        if (p == first || !token_ends(p)) {
+            return false;
+        }
+        handler_.on_number(val);
+        return true;
+    }
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+        const char *p = kernels_->find_identifier_end(first, last);
+        string_ref ident(first, p - first);
+        if (!token_ends(p)) {
+            return false;
+        }
+        if (ident == "true") {
+            handler_.on_bool(true);
+            return true;
+        } else if (ident == "false") {
+            handler_.on_bool(false);
+            return true;
+        }
+    }
+    return false;
 }
 
 //
+// Whether the scanner would end a number or identifier token at p. If it wouldn't, the
+// next token follows straight on, and no token can follow a value without a ',' or a
+// closing bracket in between.
+template <typename Handler>
+inline bool structural_parser<Handler>::token_ends(const char *p) const {
+    if (p == input_ + size_) {
+        return true;
+    }
+    char c = *p;
+    return c <= 0x20 || c == '"' || c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+}
+
 //
-inline void write_vector(writer& wr, const value_vector_type& vec) {
-    wr.append("[");
-    wr.indent();
-    wr.newline();
+// Scans the first token at or after pos; false if it is malformed
+template <typename Handler>
+inline bool structural_parser<Handler>::scan_token_at(unsigned int pos) {
+    try {
+        scanner_.scan(input_ + pos, size_ - pos, read_scanner_params);
+    } catch (const parse_error&) {
+        return false;
+    }
+    return true;
+}
 
-    unsigned int i = 0;
-    for (const auto& val : vec) {
-        write_value(wr, val);
+//
+//
+inline group read_group(scanner& sc, bool braces) {
+    limit_checker check;
+    return read_group(sc, braces, check);
+}
 
-        if (i < vec.size() - 1) {
-            wr.append(",");
-            wr.newline();
+//
+//
+inline value_vector_type read_vector(scanner& sc) {
+    limit_checker check;
+    return read_vector(sc, check);
+}
+
+//
+//
+inline value read_value(scanner& sc) {
+    limit_checker check;
+    return read_value(sc, check);
+}
+
+//
+//
+inline group read_group(scanner& sc, bool braces, limit_checker& check, arena *mem) {
+    std::vector<build_frame> stack;
+    stack.push_back(build_frame(mem));
+    check.enter(sc, sc.peek_token().pos, 1);
+    check.node(sc, sc.peek_token().pos);
+    sc.expect('{');
+    read_nested(sc, stack, read_step::entry, check, mem);
+    return std::move(stack[0].grp);
+}
+
+//
+//
+inline value_vector_type read_vector(scanner& sc, limit_checker& check) {
+    std::vector<build_frame> stack(1);
+    stack[0].is_vector = true;
+    check.enter(sc, sc.peek_token().pos, 1);
+    check.node(sc, sc.peek_token().pos);
+    sc.expect('[');
+    read_nested(sc, stack, read_step::element, check);
+    return std::move(stack[0].vec);
+}
+
+//
+//
+inline value read_value(scanner& sc, limit_checker& check) {
+    const token& tok = sc.peek_token();
+    if (!tok.is_char('{') && !tok.is_char('[')) {
+        return read_scalar(sc, check);
+    }
+    std::vector<build_frame> stack;
+    read_nested(sc, stack, read_step::value, check);
+    return stack[0].is_vector ? value(std::move(stack[0].vec)) : value(std::move(stack[0].grp));
+}
+
+//
+// The loop behind read_group(), read_vector() and read_value(), keeping the groups and
+// vectors being read on an explicit stack rather than the C++ stack. It starts at step
+// with the stack as the caller left it, and stops once the frame at the bottom is
+// finished, leaving it there. What is read is made in mem, if there is one.
+inline void read_nested(scanner& sc, std::vector<build_frame>& stack, read_step step, limit_checker& check,
+        arena *mem) {
+    while (true) {
+        switch (step) {
+        case read_step::value: {
+            const token& tok = sc.peek_token();
+            if (tok.is_char('{') || tok.is_char('[')) {
+                check.enter(sc, tok.pos, stack.size() + 1);
+                check.node(sc, tok.pos);
+                stack.push_back(build_frame(mem));
+                stack.back().is_vector = tok.is_char('[');
+                step = tok.is_char('[') ? read_step::element : read_step::entry;
+                sc.expect(stack.back().is_vector ? '[' : '{');
+            } else {
+                step = add_value(sc, stack.back(), read_scalar(sc, check, mem));
+            }
+            break;
+        }
+
+        case read_step::entry: {
+            build_frame& top = stack.back();
+            if (sc.peek_token().is_char('}')) {
+                step = read_step::close;
+                break;
+            }
+            unsigned int pos = sc.peek_token().pos;
+            top.key = sc.expect_string();
+            check.string(sc, pos, top.key.size());
+            sc.expect(':');
+            step = read_step::value;
+            break;
+        }
+
+        case read_step::element:
+            step = sc.peek_token().is_char(']') ? read_step::close : read_step::value;
+            break;
+
+        case read_step::close: {
+            build_frame& top = stack.back();
+            sc.expect(top.is_vector ? ']' : '}');
+            if (stack.size() == 1) {
+                return;
+            }
+            value val(top.take());
+            stack.pop_back();
+            step = add_value(sc, stack.back(), std::move(val));
+            break;
+        }
         }
-        i++;
     }
+}
 
-    wr.unindent();
-    wr.newline();
-    wr.append("]");
+//
+// Adds a value that has been read to the group or vector it is in, and goes past the
+// comma after it if there is one
+inline read_step add_value(scanner& sc, build_frame& top, value&& val) {
+    if (top.is_vector) {
+        top.vec.push_back(std::move(val));
+    } else {
+        top.grp.set(top.key, std::move(val));
+    }
+    if (sc.peek_token().is_char(',')) {
+        sc.expect(',');
+        return top.is_vector ? read_step::element : read_step::entry;
+    }
+    return read_step::close;
 }
 
 //
 //
-inline void write_value(writer& wr, const value& val) {
-    switch (val.type()) {
-    case value_type::number_type: {
-        wr.append(stringize_number(val.number_value()));
+inline value read_scalar(scanner& sc, limit_checker& check, arena *mem) {
+    const token& tok = sc.peek_token();
+    unsigned int pos = tok.pos;
+    check.node(sc, pos);
+    switch (tok.type) {
+    case token_type::identifier_token: {
+        string_ref ident = sc.expect_identifier_ref();
+        if (ident == "true") {
+            return value(true);
+        } else if (ident == "false") {
+            return value(false);
+        } else if (ident == "null") {
+            sc.fail("null is not a valid value", pos);
+        } else {
+            sc.fail("unexpected identifier", pos);
+        }
         break;
     }
-    case value_type::string_type: {
-        wr.append("\"");
-        wr.append(escape_string(val.string_value()));
-        wr.append("\"");
-        break;
+    case token_type::string_token: {
+        string_ref str = sc.expect_string_ref();
+        check.string(sc, pos, str.size());
+        return read_string_value(str, mem);
     }
-    case value_type::bool_type: {
-        wr.append(val.bool_value() ? "true" : "false");
-        break;
+    case token_type::number_token: {
+        double dbl = sc.expect_number();
+        return value(dbl);
     }
-    case value_type::group_type: {
-        write_group(wr, val.group_value());
+    case token_type::char_token: {
+        sc.fail("unexpected '" + std::string(1, tok.char_value) + "'", pos);
         break;
     }
-    case value_type::vector_type: {
-        write_vector(wr, val.vector_value());
+    default: {
+        sc.fail("unexpected token", pos);
         break;
     }
-    default: break;
     }
+    return value();
+}
+
+//
+// read_group(), building only the entries that proj asks for. An entry that is only on
+// the way to something asked for is kept if its value is a group with any of it in;
+// since a later entry with the same key replaces the value, one that isn't drops it.
+inline group read_group(scanner& sc, bool braces, const projection& proj) {
+    group grp;
+    sc.expect('{');
+
+    while (!sc.peek_token().is_char('}')) {
+        std::string key = sc.expect_string();
+        sc.expect(':');
+
+        const projection *sub = proj.find(key);
+        if (!sub) {
+            skip_value(sc);
+        } else if (sub->whole()) {
+            grp.set(key, read_value(sc));
+        } else {
+            group sub_grp;
+            if (sc.peek_token().is_char('{')) {
+                sub_grp = read_group(sc, true, *sub);
+            } else {
+                skip_value(sc);
+            }
+            if (sub_grp.size()) {
+                grp.set(key, std::move(sub_grp));
+            } else {
+                grp.unset(key);
+            }
+        }
+
+        if (sc.peek_token().is_char(',')) {
+            sc.expect(',');
+        } else {
+            break;
+        }
+    }
+
+    sc.expect('}');
+    return grp;
 }
 
 //
+// Steps over a value without building it. A group or vector is skipped by matching up
+// its brackets, so what is inside it isn't checked.
+inline void skip_value(scanner& sc) {
+    const token& tok = sc.peek_token();
+    if (tok.is_char('{') || tok.is_char('[')) {
+        const char *input = sc.input();
+        const char *last = skip_brackets(input + tok.pos, input + sc.input_size(), true);
+        if (last) {
+            sc.skip_to((unsigned int)(last - input));
+        } else {
+            read_value(sc);
+        }
+    } else if (tok.type == token_type::string_token || tok.type == token_type::number_token) {
+        sc.expect(tok.type);
+    } else {
+        read_value(sc);
+    }
+}
+
 //
-inline group read(const std::string& src) {
-    scanner sc;
-    sc.scan(src);
-    return read_group(sc, false);
+// Follows read_group(), only going into the groups on the way to the vector
+inline bool element_syntax::seek(scanner& sc, const path& p, size_t index, bool braces) {
+    sc.expect('{');
+
+    while (!sc.peek_token().is_char('}')) {
+        std::string key = sc.expect_string();
+        sc.expect(':');
+
+        size_t count = match_path_key(key, p, index);
+        if (count && index + count == p.size() && sc.peek_token().is_char('[')) {
+            sc.expect('[');
+            return true;
+        } else if (count && index + count < p.size() && sc.peek_token().is_char('{')) {
+            if (seek(sc, p, index + count, true)) {
+                return true;
+            }
+        } else {
+            skip_value(sc);
+        }
+
+        if (sc.peek_token().is_char(',')) {
+            sc.expect(',');
+        } else {
+            break;
+        }
+    }
+
+    sc.expect('}');
+    return false;
+}
+
+//
+//
+inline bool element_syntax::next(scanner& sc, value *out) {
+    if (sc.peek_token().is_char(']')) {
+        sc.expect(']');
+        return false;
+    }
+    *out = read_value(sc);
+    if (sc.peek_token().is_char(',')) {
+        sc.expect(',');
+    } else if (!sc.peek_token().is_char(']')) {
+        sc.expect(']');
+    }
+    return true;
+}
+
+//
+//
+inline void write_group(writer& wr, const group& gr) {
+    write_nested(wr, nullptr, &gr, nullptr);
+}
+
+//
+//
+inline void write_vector(writer& wr, const value_vector_type& vec) {
+    write_nested(wr, nullptr, nullptr, &vec);
+}
+
+//
+//
+inline void write_value(writer& wr, const value& val) {
+    write_nested(wr, &val, nullptr, nullptr);
+}
+
+//
+// Writes whichever of val, grp and vec is given. Groups and vectors being written are
+// kept on an explicit stack, each with the index of its next entry, rather than
+// recursing into them.
+inline void write_nested(writer& wr, const value *val, const group *grp, const value_vector_type *vec) {
+    struct frame {
+        const group *   grp;
+        const value_vector_type *vec;
+        size_t          index;
+        group::const_iterator key;          // the key of grp's next entry
+    };
+    std::vector<frame> stack;
+
+    while (true) {
+        if (val) {
+            switch (val->type()) {
+            case value_type::number_type:
+                wr.append(stringize_number(val->number_value()));
+                break;
+            case value_type::string_type:
+                wr.append("\"");
+                wr.append(escape_string(val->string_value()));
+                wr.append("\"");
+                break;
+            case value_type::bool_type:
+                wr.append(val->bool_value() ? "true" : "false");
+                break;
+            case value_type::group_type:
+                grp = &val->group_value();
+                break;
+            case value_type::vector_type:
+                vec = &val->vector_value();
+                break;
+            default:
+                break;
+            }
+            val = nullptr;
+        }
+        if (grp || vec) {
+            wr.append(grp ? "{" : "[");
+            wr.indent();
+            wr.newline();
+            stack.push_back({ grp, vec, 0, grp ? grp->begin() : group::const_iterator() });
+            grp = nullptr;
+            vec = nullptr;
+        }
+
+        if (stack.empty()) {
+            return;
+        }
+        frame& top = stack.back();
+        if (top.index == (top.grp ? top.grp->size() : top.vec->size())) {
+            wr.unindent();
+            wr.newline();
+            wr.append(top.grp ? "}" : "]");
+            stack.pop_back();
+            continue;
+        }
+        if (top.index > 0) {
+            wr.append(",");
+            wr.newline();
+        }
+        if (top.grp) {
+            const std::string& key = *top.key++;
+            wr.append("\"");
+            wr.append(escape_string(key));
+            wr.append("\": ");
+            val = &top.grp->get<value>(key);
+        } else {
+            val = &(*top.vec)[top.index];
+        }
+        top.index++;
+    }
+}
+
+//
+//
+inline group read(const std::string& src) {
+    return read(src.data(), src.size());
+}
+
+//
+// Builds only the values at the given paths, and the groups they are in. The rest of
+// the document is skipped over without building anything, and isn't checked for errors
+// inside its groups and vectors. A path to a group takes everything in it.
+inline group read(const std::string& src, const std::vector<path>& paths) {
+    scanner sc;
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    return read_group(sc, false, projection(paths));
+}
+
+//
+// The elements of the vector at p, read one at a time. The reader keeps its own copy
+// of src.
+inline element_reader read_elements(const std::string& src, const path& p) {
+    std::shared_ptr<std::string> text = std::make_shared<std::string>(src);
+    return element_reader(text, text->data(), text->size(), p);
+}
+
+//
+// The file stays mapped for as long as the reader is around
+inline element_reader read_file_elements(const std::string& filename, const path& p) {
+    std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>(filename);
+    return element_reader(file, file->data(), file->size(), p);
+}
+
+//
+// Documents go through the structural index where possible. Anything it can't handle,
+// and every invalid document, is read by the scanner instead, which also produces the
+// error to report.
+inline group read(const char *src, size_t size) {
+    return read_limited(src, size, default_read_limits);
+}
+
+//
+// read() with tighter read_limits than the defaults, for documents that aren't trusted.
+// A document over max_input_size fails before any of it is parsed. With mem, the
+// document is read into it as by read(src, size, mem).
+inline group read_limited(const char *src, size_t size, const read_limits& limits, arena *mem) {
+    limit_checker check(limits);
+    scanner sc;
+    sc.scan(src, size, read_scanner_params);
+    check.input(sc, size);
+
+    structural_index index;
+    if (index.build(src, size)) {
+        group read_grp = mem ? group(*mem) : group();
+        if (read_indexed(src, size, index, &read_grp, limits)) {
+            return read_grp;
+        }
+    }
+    return read_group(sc, false, check, mem);
+}
+
+//
+//
+inline group read_limited(const std::string& src, const read_limits& limits) {
+    return read_limited(src.data(), src.size(), limits);
+}
+
+//
+//
+inline group read_file_limited(const std::string& filename, const read_limits& limits) {
+    mapped_file file(filename);
+    return read_limited(file.data(), file.size(), limits);
+}
+
+//
+// As read(), but fails with a utf8_error if the document is not well-formed UTF-8
+inline group read_validated(const std::string& src) {
+    structural_index index;
+    bool indexed = index.build(src.data(), src.size(), true);
+    if (index.utf8_error() != structural_index::npos) {
+        int line, col;
+        text_location(src.data(), index.utf8_error(), &line, &col);
+        throw utf8_error("invalid UTF-8", line, col);
+    }
+    if (indexed) {
+        group read_grp;
+        if (read_indexed(src.data(), src.size(), index, &read_grp)) {
+            return read_grp;
+        }
+    }
+    scanner sc;
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    return read_group(sc, false);
+}
+
+//
+// A key that group::set rejects only fails read_group once the value after it has been
+// read and the scanner has looked one token further ahead, which may turn up a parse
+// error first. So any failure here leaves the scanner to decide which error to report.
+// The document is built in the arena grp is in, if it is in one.
+inline bool read_indexed(const char *src, size_t size, const structural_index& index, group *grp,
+        const read_limits& limits) {
+    group_builder builder(grp->mem());
+    structural_parser<group_builder> parser(builder, limits);
+    try {
+        if (!parser.parse(src, size, index)) {
+            return false;
+        }
+    } catch (const lightconf_error&) {
+        return false;
+    }
+    std::swap(*grp, builder.result());
+    return true;
+}
+
+//
+// The stream is parsed a chunk at a time as it is read
+inline group read(std::istream& in) {
+    push_parser parser;
+    parser.feed(in);
+    return parser.finish();
+}
+
+//
+// Parses from a pipe, socket or file descriptor a chunk at a time as data arrives
+inline group read_fd(int fd) {
+    push_parser parser;
+    parser.feed_fd(fd);
+    return parser.finish();
+}
+
+//
+// Regular files are memory-mapped and scanned in place
+inline group read_file(const std::string& filename) {
+    mapped_file file(filename);
+    return read(file.data(), file.size());
+}
+
+//
+// Reads the whole document into mem, which has to outlive the group returned; see
+// config_format::read(const std::string&, arena&)
+inline group read(const std::string& src, arena& mem) {
+    return read_limited(src.data(), src.size(), default_read_limits, &mem);
+}
+
+//
+//
+inline group read(const char *src, size_t size, arena& mem) {
+    return read_limited(src, size, default_read_limits, &mem);
+}
+
+//
+//
+inline group read_file(const std::string& filename, arena& mem) {
+    mapped_file file(filename);
+    return read_limited(file.data(), file.size(), default_read_limits, &mem);
+}
+
+//
+// Reads the document straight into a T, which value_type_info<T>::read_value() pulls
+// from the scanner a token at a time, so no group is built for it. As with read(), the
+// document is a group, and T is read from it as from any group in it.
+//
+// The document only has to be valid as far as T looks into it; entries T has no member
+// for are skipped without checking inside their objects and arrays. A value of the
+// wrong type is a value_error, even for an optional member.
+template <typename T>
+inline T read_as(const std::string& src) {
+    scanner sc;
+    sc.scan(src.data(), src.size(), read_scanner_params);
+    return read_as<T>(sc);
+}
+
+//
+//
+template <typename T>
+inline T read_file_as(const std::string& filename) {
+    mapped_file file(filename);
+    scanner sc;
+    sc.scan(file.data(), file.size(), read_scanner_params);
+    return read_as<T>(sc);
+}
+
+//
+//
+template <typename T>
+inline T read_as(scanner& sc) {
+    if (!sc.peek_token().is_char('{')) {
+        sc.expect('{');
+    }
+    scanner_source source(sc);
+    T out;
+    read_typed(source, &out);
+    return out;
+}
+
+//
+// Every document in src, one after another as document_reader reads them
+inline std::vector<group> read_documents(const std::string& src) {
+    document_reader reader(src.data(), src.size());
+    return read_documents(reader);
+}
+
+//
+//
+inline std::vector<group> read_documents(const std::string& src, thread_pool& pool) {
+    return read_documents(src.data(), src.size(), pool);
+}
+
+//
+// Reads the documents on a thread_pool. The text is indexed once, the documents are
+// found by counting brackets in the index, and they are handed out to the threads a
+// batch at a time. Text that can't be indexed, or that has an error anywhere in it, is
+// read with a document_reader instead, so the groups are always in document order and
+// an error is the one the first bad document gives.
+inline std::vector<group> read_documents(const char *src, size_t size, thread_pool& pool) {
+    structural_index index;
+    std::vector<const uint32_t *> starts;
+    bool split = index.build(src, size);
+    size_t depth = 0;
+    for (const uint32_t *pos = index.begin(); split && pos != index.end(); ++pos) {
+        char c = src[*pos];
+        if (depth == 0) {
+            split = c == '{';
+            starts.push_back(pos);
+        }
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            depth--;
+        }
+    }
+
+    size_t count = starts.size();
+    std::vector<group> docs(count);
+    std::atomic<bool> failed(!split || depth != 0);
+    size_t batches = failed ? 0 : std::min<size_t>(count, 4 * pool.size());
+    pool.run(batches, [&](size_t batch) {
+        group_builder builder;
+        structural_parser<group_builder> parser(builder);
+        for (size_t i = count * batch / batches; i < count * (batch + 1) / batches && !failed; i++) {
+            const uint32_t *last = i + 1 < count ? starts[i + 1] : index.end();
+            const uint32_t *end;
+            builder.reset();
+            try {
+                // only ever set, so a batch that finishes later can't hide a failure
+                if (!parser.parse(src, size, starts[i], last, &end) || end != last) {
+                    failed = true;
+                }
+            } catch (const lightconf_error&) {
+                failed = true;
+            }
+            std::swap(docs[i], builder.result());
+        }
+    });
+
+    if (failed) {
+        document_reader reader(src, size);
+        return read_documents(reader);
+    }
+    return docs;
+}
+
+//
+// The documents left in reader
+inline std::vector<group> read_documents(document_reader& reader) {
+    std::vector<group> docs;
+    group doc;
+    while (reader.next(&doc)) {
+        docs.push_back(group());
+        std::swap(docs.back(), doc);
+    }
+    return docs;
+}
+
+//
+// Regular files are memory-mapped and read in place
+inline std::vector<group> read_file_documents(const std::string& filename) {
+    mapped_file file(filename);
+    document_reader reader(file.data(), file.size());
+    return read_documents(reader);
+}
+
+//
+//
+inline std::vector<group> read_file_documents(const std::string& filename, thread_pool& pool) {
+    mapped_file file(filename);
+    return read_documents(file.data(), file.size(), pool);
+}
+
+//
+// Where the next document starts, past the whitespace and comments between documents,
+// or size if there isn't one
+inline size_t find_document(const char *text, size_t size, size_t pos) {
+    while (pos < size) {
+        if ((signed char)text[pos] <= 0x20) {
+            pos++;
+        } else if (text[pos] == '/' && pos + 1 < size && text[pos + 1] == '/') {
+            const void *newline = std::memchr(text + pos, '\n', size - pos);
+            pos = newline ? (const char *)newline - text : size;
+        } else {
+            break;
+        }
+    }
+    return pos;
+}
+
+//
+//
+inline document_parser::document_parser(const read_limits& limits) :
+    limits_(limits),
+    sc_(),
+    index_(),
+    origin_line_(1),
+    origin_col_(1),
+    located_(0),
+    line_(1),
+    col_(1)
+{ }
+
+//
+// The line and column of the first byte of the text, if it is a piece of a larger one
+inline void document_parser::set_origin(int line, int col) {
+    origin_line_ = line;
+    origin_col_ = col;
+    located_ = 0;
+    line_ = line;
+    col_ = col;
+}
+
+//
+// Reads the document that starts at byte first of the text, and returns where the one
+// after it may start. With last 0, where the document ends isn't known, and the scanner
+// reads as far as it goes.
+inline size_t document_parser::read(const char *text, size_t size, size_t first, size_t last, group *out) {
+    if (last && last - first <= limits_.max_input_size && index_.build(text + first, last - first)
+            && json_format::read_indexed(text + first, last - first, index_, out, limits_)) {
+        return last;
+    }
+
+    try {
+        limit_checker check(limits_);
+        sc_.scan(text + first, (last ? last : size) - first, read_scanner_params);
+        if (last) {
+            check.input(sc_, last - first);
+        }
+        *out = read_group(sc_, false, check);
+        size_t end = sc_.peek_token().pos;
+        check.input(sc_, end);
+        return first + end;
+    } catch (const parse_error& e) {
+        // the scanner started at first, which is only worked out when something fails,
+        // counting on from the last document that failed
+        if (first < located_) {
+            set_origin(origin_line_, origin_col_);
+        }
+        int line, col;
+        text_location(text + located_, first - located_, &line, &col);
+        if (line == 1) {
+            col += col_ - 1;
+        }
+        line += line_ - 1;
+        located_ = first;
+        line_ = line;
+        col_ = col;
+        throw parse_error(e.what(), line + e.line() - 1, e.line() == 1 ? col + e.col() - 1 : e.col());
+    }
+}
+
+//
+// The text is not copied, so it must stay alive and unchanged while the reader is in use
+inline document_reader::document_reader(const char *text, size_t size, const read_limits& limits) :
+    in_(nullptr),
+    buffer_(),
+    text_(text),
+    size_(size),
+    pos_(0),
+    line_(1),
+    col_(1),
+    limits_(limits),
+    index_(),
+    index_first_(0),
+    index_last_(0),
+    indexed_(false),
+    cur_(nullptr),
+    builder_(),
+    parser_(builder_, limits),
+    fallback_(limits)
+{ }
+
+//
+// The stream is read a chunk at a time, and only as much of it is held at once as the
+// longest document needs
+inline document_reader::document_reader(std::istream& in, const read_limits& limits) :
+    in_(&in),
+    buffer_(),
+    text_(buffer_.data()),
+    size_(0),
+    pos_(0),
+    line_(1),
+    col_(1),
+    limits_(limits),
+    index_(),
+    index_first_(0),
+    index_last_(0),
+    indexed_(false),
+    cur_(nullptr),
+    builder_(),
+    parser_(builder_, limits),
+    fallback_(limits)
+{ }
+
+//
+// Returns false once there are no documents left
+inline bool document_reader::next(group *out) {
+    size_t first;
+    while ((first = find_document(text_, size_, pos_)) == size_ && fill()) { }
+    if (first == size_) {
+        pos_ = size_;
+        return false;
+    }
+    if (text_[first] == '{' && read_indexed(&first, out)) {
+        return true;
+    }
+
+    // Otherwise the scanner reads it, as far as it goes. If that is because the text
+    // couldn't be indexed, a stream is read on until the brackets of the document match
+    // up, or there is no more to read, so that the scanner has all of it.
+    const char *end = nullptr;
+    while (in_ && !indexed_ && text_[first] == '{' && !(end = skip_brackets(text_ + first, text_ + size_, true))
+            && fill()) {
+        first = find_document(text_, size_, pos_);
+    }
+    const void *newline = std::memchr(text_ + first, '\n', size_ - first);
+    pos_ = newline ? (const char *)newline - text_ + 1 : size_;
+    pos_ = fallback_.read(text_, size_, first, end ? end - text_ : 0, out);
+    return true;
+}
+
+//
+// Reads the document at *first from the index of the window it is in, indexing a new
+// window if it isn't in this one. Returns false if the scanner has to read it instead:
+// the window can't be indexed, or the document fails or is over the limits.
+inline bool document_reader::read_indexed(size_t *first, group *out) {
+    size_t window = document_index_window;
+    bool rebuild = *first < index_first_ || *first >= index_last_;
+    while (true) {
+        if (rebuild) {
+            index_first_ = *first;
+            index_last_ = std::min(size_, *first + window);
+            indexed_ = index_.build(text_ + index_first_, index_last_ - index_first_);
+            cur_ = index_.begin();
+        }
+        if (!indexed_) {
+            return false;
+        }
+
+        size_t offset = *first - index_first_;
+        const uint32_t *last = index_.end();
+        while (cur_ != last && *cur_ < offset) {
+            ++cur_;
+        }
+        if (cur_ == last || *cur_ != offset) {
+            // an unterminated string before the document has put the index out of step
+            if (rebuild) {
+                return false;
+            }
+            rebuild = true;
+            continue;
+        }
+
+        const uint32_t *end;
+        bool done;
+        builder_.reset();
+        try {
+            done = parser_.parse(text_ + index_first_, index_last_ - index_first_, cur_, last, &end);
+        } catch (const lightconf_error&) {
+            return false;
+        }
+        if (done) {
+            size_t doc_last = index_first_ + end[-1] + 1;
+            if (doc_last - *first > limits_.max_input_size) {
+                return false;
+            }
+            std::swap(*out, builder_.result());
+            cur_ = end;
+            pos_ = doc_last;
+            return true;
+        }
+
+        // Failing at the end of the window may only mean the document goes on past it
+        if (end + 1 < last) {
+            return false;
+        }
+        window = std::max(document_index_window, 2 * (index_last_ - index_first_));
+        if (index_last_ == size_ && !fill()) {
+            return false;
+        }
+        *first = find_document(text_, size_, pos_);
+        rebuild = true;
+    }
+}
+
+//
+// Drops what has been read from the buffer and reads another chunk onto the end of it,
+// at least as big as what is left, so that a document is looked through a bounded
+// number of times however long it is
+inline bool document_reader::fill() {
+    if (!in_ || !*in_) {
+        return false;
+    }
+    const char *first = buffer_.data();
+    const char *end = first + pos_;
+    while (const void *newline = std::memchr(first, '\n', end - first)) {
+        first = (const char *)newline + 1;
+        line_++;
+        col_ = 1;
+    }
+    col_ += (int)(end - first);
+    buffer_.erase(0, pos_);
+    pos_ = 0;
+    fallback_.set_origin(line_, col_);
+    index_first_ = 0;
+    index_last_ = 0;
+
+    size_t used = buffer_.size();
+    size_t chunk = std::max<size_t>(65536, used);
+    buffer_.resize(used + chunk);
+    in_->read(&buffer_[used], chunk);
+    buffer_.resize(used + (size_t)in_->gcount());
+    text_ = buffer_.data();
+    size_ = buffer_.size();
+    return size_ > used;
+}
+
+//
+//
+inline scanner_source::scanner_source(scanner& sc, const read_limits& limits) :
+    sc_(sc),
+    check_(limits),
+    first_()
+{ }
+
+//
+//
+inline value_type scanner_source::peek_type() {
+    const token& tok = sc_.peek_token();
+    switch (tok.type) {
+    case token_type::number_token:
+        return value_type::number_type;
+    case token_type::string_token:
+        return value_type::string_type;
+    case token_type::identifier_token: {
+        string_ref ident = sc_.token_text(tok);
+        return ident == "true" || ident == "false" ? value_type::bool_type : value_type::invalid_type;
+    }
+    case token_type::char_token:
+        return tok.is_char('{') ? value_type::group_type
+            : tok.is_char('[') ? value_type::vector_type : value_type::invalid_type;
+    default:
+        return value_type::invalid_type;
+    }
+}
+
+//
+//
+inline double scanner_source::read_number() {
+    expect_type(value_type::number_type);
+    check_.node(sc_, sc_.peek_token().pos);
+    return sc_.expect_number();
+}
+
+//
+//
+inline void scanner_source::read_string(std::string *out) {
+    expect_type(value_type::string_type);
+    unsigned int pos = sc_.peek_token().pos;
+    check_.node(sc_, pos);
+    string_ref str = sc_.expect_string_ref();
+    check_.string(sc_, pos, str.size());
+    out->assign(str.data(), str.size());
+}
+
+//
+//
+inline bool scanner_source::read_bool() {
+    expect_type(value_type::bool_type);
+    check_.node(sc_, sc_.peek_token().pos);
+    return sc_.expect_identifier_ref() == "true";
+}
+
+//
+//
+inline void scanner_source::read_group(group *out) {
+    expect_type(value_type::group_type);
+    *out = json_format::read_group(sc_, true, check_);
+}
+
+//
+//
+inline void scanner_source::read_vector(value_vector_type *out) {
+    expect_type(value_type::vector_type);
+    *out = json_format::read_vector(sc_, check_);
+}
+
+//
+//
+inline void scanner_source::read_value(value *out) {
+    value val = json_format::read_value(sc_, check_);
+    out->swap(val);
+}
+
+//
+//
+inline void scanner_source::skip_value() {
+    json_format::skip_value(sc_);
+}
+
+//
+// For the object or array about to be read
+inline void scanner_source::enter() {
+    unsigned int pos = sc_.peek_token().pos;
+    check_.enter(sc_, pos, first_.size() + 1);
+    check_.node(sc_, pos);
+    first_.push_back(true);
+    sc_.expect(sc_.peek_token().is_char('[') ? '[' : '{');
+}
+
+//
+//
+inline void scanner_source::begin_group() {
+    expect_type(value_type::group_type);
+    enter();
+}
+
+//
+//
+inline bool scanner_source::next_key(std::string *key) {
+    if (!next('}')) {
+        return false;
+    }
+    unsigned int pos = sc_.peek_token().pos;
+    string_ref str = sc_.expect_string_ref();
+    check_.string(sc_, pos, str.size());
+    key->assign(str.data(), str.size());
+    sc_.expect(':');
+    return true;
+}
+
+//
+//
+inline void scanner_source::begin_vector() {
+    expect_type(value_type::vector_type);
+    enter();
+}
+
+//
+//
+inline bool scanner_source::next_element() {
+    return next(']');
+}
+
+//
+// Follows read_nested(): goes past the comma after the last entry, or returns false
+// once the innermost object or array has been closed
+inline bool scanner_source::next(char close) {
+    if (first_.back()) {
+        first_.back() = false;
+        if (!sc_.peek_token().is_char(close)) {
+            return true;
+        }
+    } else if (sc_.peek_token().is_char(',')) {
+        sc_.expect(',');
+        if (!sc_.peek_token().is_char(close)) {
+            return true;
+        }
+    }
+    sc_.expect(close);
+    first_.pop_back();
+    return false;
+}
+
+//
+//
+inline event_writer::event_writer(std::ostream& out) :
+    out_(out),
+    wr_(),
+    counts_(),
+    after_key_(false)
+{ }
+
+//
+//
+inline void event_writer::on_key(string_ref key) {
+    separate();
+    wr_.append("\"");
+    wr_.append(escape_string(key.str()));
+    wr_.append("\": ");
+    after_key_ = true;
+}
+
+//
+//
+inline void event_writer::on_number(double val) {
+    separate();
+    wr_.append(stringize_number(val));
+}
+
+//
+//
+inline void event_writer::on_string(string_ref val) {
+    separate();
+    wr_.append("\"");
+    wr_.append(escape_string(val.str()));
+    wr_.append("\"");
+}
+
+//
+//
+inline void event_writer::on_bool(bool val) {
+    separate();
+    wr_.append(val ? "true" : "false");
+}
+
+//
+//
+inline void event_writer::open(char c) {
+    separate();
+    wr_.append(std::string(1, c));
+    wr_.indent();
+    wr_.newline();
+    counts_.push_back(0);
+}
+
+//
+// Hands the output to the stream once the document is done, or whenever enough of it
+// has built up
+inline void event_writer::close(char c) {
+    wr_.unindent();
+    wr_.newline();
+    wr_.append(std::string(1, c));
+    counts_.pop_back();
+    if (counts_.empty() || wr_.buf.size() >= 65536) {
+        flush();
+    }
+}
+
+//
+// Starts the next entry of the object or array being written, unless a key has
+// already started it
+inline void event_writer::separate() {
+    if (after_key_) {
+        after_key_ = false;
+    } else if (!counts_.empty() && counts_.back()++) {
+        wr_.append(",");
+        wr_.newline();
+    }
+}
+
+//
+//
+inline void event_writer::flush() {
+    out_.write(wr_.buf.data(), wr_.buf.size());
+    wr_.buf.clear();
+}
+
+//
+// Reports the document to the handler without building a group
+inline void parse(const std::string& src, handler& h) {
+    parse(src.data(), src.size(), h);
+}
+
+//
+// Uses the structural index where possible, as read() does. If the document turns out
+// to be invalid, it is parsed again with the scanner, without reporting any events, to
+// produce the error.
+inline void parse(const char *src, size_t size, handler& h) {
+    structural_index index;
+    handler ignore;
+    handler *target = &h;
+    if (index.build(src, size)) {
+        structural_parser<handler> parser(h);
+        if (parser.parse(src, size, index)) {
+            return;
+        }
+        target = &ignore;
+    }
+    scanner sc;
+    sc.scan(src, size, read_scanner_params);
+    token_parser<handler> parser(*target);
+    parse_tokens(sc, parser);
+}
+
+//
+// The stream is parsed a chunk at a time as it is read
+inline void parse(std::istream& in, handler& h) {
+    event_push_parser parser(h);
+    parser.feed(in);
+    parser.finish();
+}
+
+//
+//
+inline void parse_file(const std::string& filename, handler& h) {
+    mapped_file file(filename);
+    parse(file.data(), file.size(), h);
 }
 
 //
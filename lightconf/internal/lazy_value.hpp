@@ -0,0 +1,68 @@
+#ifndef _LIGHTCONF_LAZY_VALUE_H_
+#define _LIGHTCONF_LAZY_VALUE_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "value.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// The text of a document read lazily, kept alive for as long as any of its values
+// still have to be parsed. parse is the format's function for turning the text of one
+// group or vector into a value.
+struct lazy_document {
+    std::shared_ptr<const void> owner;
+    const char *        text;
+    size_t              size;
+    void                (*parse)(const lazy_span& span, value *out);
+};
+
+//
+// Where a group or vector that hasn't been parsed yet is in its document. line and col
+// are those of the opening bracket, for reporting errors in it.
+struct lazy_span {
+    std::shared_ptr<const lazy_document> doc;
+    size_t              first;
+    size_t              last;
+    int                 line;
+    int                 col;
+};
+
+//
+// A value that is parsed the first time something looks at it. Any number of threads
+// may call get() at once; the first parses the text and the others wait for it. If the
+// text fails to parse, the exception is thrown to the caller and the next call tries
+// again.
+struct lazy_value {
+    lazy_span           span;
+    std::atomic<bool>   done;
+    std::mutex          mutex;
+    value               result;
+
+    const value&        get();
+
+    explicit lazy_value(const lazy_span& span) : span(span), done(false), mutex(), result() { }
+};
+
+//
+//
+inline const value& lazy_value::get() {
+    if (!done.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!done.load(std::memory_order_relaxed)) {
+            value val;
+            span.doc->parse(span, &val);
+            result.swap(val);
+            done.store(true, std::memory_order_release);
+        }
+    }
+    return result;
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_LAZY_VALUE_H_
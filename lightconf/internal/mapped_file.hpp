@@ -0,0 +1,138 @@
+#ifndef _LIGHTCONF_MAPPED_FILE_H_
+#define _LIGHTCONF_MAPPED_FILE_H_
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "exceptions.hpp"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lightconf {
+////////////////////
+
+//
+// The contents of a file, mapped read-only into memory where possible so that it can
+// be scanned in place. Pipes, character devices and anything else that can't be mapped
+// are read into a buffer instead.
+class mapped_file {
+public:
+    const char *        data() const        { return data_; }
+    size_t              size() const        { return size_; }
+    bool                is_mapped() const   { return mapped_; }
+
+    explicit mapped_file(const std::string& filename);
+    ~mapped_file();
+
+private:
+    mapped_file(const mapped_file&);
+    mapped_file&        operator=(const mapped_file&);
+
+    void                read_stream(const std::string& filename);
+    void                read_fd(int fd, const std::string& filename);
+
+    const char *        data_;
+    size_t              size_;
+    bool                mapped_;
+    std::string         buffer_;
+};
+
+//
+//
+inline mapped_file::mapped_file(const std::string& filename) :
+    data_(nullptr),
+    size_(0),
+    mapped_(false)
+{
+#if !defined(_WIN32)
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw io_error("could not open " + filename + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *addr = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+#if defined(MADV_SEQUENTIAL)
+            ::madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            data_ = static_cast<const char *>(addr);
+            size_ = (size_t)st.st_size;
+            mapped_ = true;
+        }
+    }
+    if (!mapped_) {
+        // A pipe can only be read once, so read from the descriptor we already have
+        try {
+            read_fd(fd, filename);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+    }
+    ::close(fd);
+#else
+    read_stream(filename);
+#endif
+}
+
+//
+//
+inline mapped_file::~mapped_file() {
+#if !defined(_WIN32)
+    if (mapped_) {
+        ::munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+}
+
+//
+//
+inline void mapped_file::read_fd(int fd, const std::string& filename) {
+#if !defined(_WIN32)
+    char chunk[65536];
+    while (true) {
+        ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count == 0) {
+            break;
+        }
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw io_error("could not read " + filename + ": " + std::strerror(errno));
+        }
+        buffer_.append(chunk, (size_t)count);
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+}
+
+//
+//
+inline void mapped_file::read_stream(const std::string& filename) {
+    std::ifstream stream(filename, std::ios::in | std::ios::binary);
+    if (!stream) {
+        throw io_error("could not open " + filename);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    if (stream.bad()) {
+        throw io_error("could not read " + filename);
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_MAPPED_FILE_H_
@@ -1,25 +1,34 @@
 #ifndef _LIGHTCONF_INTERNAL_PATH_H_
 #define _LIGHTCONF_INTERNAL_PATH_H_
 
+#include "atom.hpp"
 #include "exceptions.hpp"
+#include <cstring>
 #include <iterator>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace lightconf {
 ////////////////////
 
+//
+// A key split into its parts, each held as an atom, so that looking a path up in a
+// group compares each part by its interned pointer. Since an atom may be shared, a part
+// is read as a const std::string and changed with replace().
 class path {
 public:
-    typedef std::vector<std::string>                container_type;
+    typedef std::vector<atom>                       container_type;
     typedef container_type::iterator                iterator;
     typedef container_type::const_iterator          const_iterator;
     typedef container_type::size_type               size_type;
 
     path&               operator=(const path& rhs);
+    path&               operator=(path&& rhs) noexcept;
 
     path&               operator+=(const std::string& part);
     path&               operator+=(const char *part);
+    path&               operator+=(const atom& part);
     path&               operator+=(const path& rhs);
 
     path                operator+(const std::string& part) const;
@@ -42,10 +51,9 @@ public:
     void                push_back(const char *part)         { *this += part; }
     void                pop_back()                          { parts_.pop_back(); }
     void                clear()                             { parts_.clear(); }
-    std::string&        operator[](size_type pos)           { return parts_[pos]; }
-    const std::string&  operator[](size_type pos) const     { return parts_[pos]; }
-    std::string&        at(size_type pos)                   { return parts_.at(pos); }
-    const std::string&  at(size_type pos) const             { return parts_.at(pos); }
+    const std::string&  operator[](size_type pos) const     { return parts_[pos].str(); }
+    const std::string&  at(size_type pos) const             { return parts_.at(pos).str(); }
+    void                replace(size_type pos, const std::string& part) { parts_.at(pos) = atom(part); }
     bool                operator==(const path& rhs) const   { return parts_ == rhs.parts_; }
     bool                operator!=(const path& rhs) const   { return parts_ != rhs.parts_; }
     bool                operator<(const path& rhs) const    { return parts_ < rhs.parts_; }
@@ -56,11 +64,12 @@ public:
     path(const std::string& path_string, char separator = '.');
     path(const char *path_string, char separator = '.');
     path(const path& rhs);
+    path(path&& rhs) noexcept;
     template <typename InputIterator> path(InputIterator first, InputIterator last);
     path();
 
 private:
-    void                parse(const std::string& path_string, char separator = '.');
+    void                parse(string_ref path_string, char separator = '.');
 
     container_type parts_;
 };
@@ -78,7 +87,7 @@ inline path::path(const std::string& path_string, char separator) {
 //
 //
 inline path::path(const char *path_string, char separator) {
-    parse(std::string(path_string), separator);
+    parse(string_ref(path_string), separator);
 }
 
 //
@@ -86,6 +95,11 @@ inline path::path(const char *path_string, char separator) {
 inline path::path(const path& rhs) : parts_(rhs.parts_)
 { }
 
+//
+//
+inline path::path(path&& rhs) noexcept : parts_(std::move(rhs.parts_))
+{ }
+
 //
 //
 template <typename InputIterator>
@@ -99,6 +113,13 @@ inline path& path::operator=(const path& rhs) {
     return *this;
 }
 
+//
+//
+inline path& path::operator=(path&& rhs) noexcept {
+    parts_ = std::move(rhs.parts_);
+    return *this;
+}
+
 //
 //
 inline path& path::operator+=(const std::string& part) {
@@ -109,7 +130,15 @@ inline path& path::operator+=(const std::string& part) {
 //
 //
 inline path& path::operator+=(const char *part) {
-    return operator+=(std::string(part));
+    parts_.push_back(atom(part));
+    return *this;
+}
+
+//
+//
+inline path& path::operator+=(const atom& part) {
+    parts_.push_back(part);
+    return *this;
 }
 
 //
@@ -147,7 +176,7 @@ inline path path::operator+(const path& rhs) const {
 inline std::string path::fullpath(char separator) const {
     std::string p;
     for (auto it = begin(); it != end(); ++it) {
-        p += *it;
+        p += it->str();
         if (it != end() - 1) p += separator;
     }
     return p;
@@ -155,16 +184,15 @@ inline std::string path::fullpath(char separator) const {
 
 //
 //
-inline void path::parse(const std::string& path_string, char separator) {
-    size_t start = 0, end = 0;
-    while (start < path_string.size()) {
-        end = path_string.find(separator, start);
-        if (end == std::string::npos) {
-            end = path_string.size();
+inline void path::parse(string_ref path_string, char separator) {
+    const char *first = path_string.begin();
+    while (first < path_string.end()) {
+        const char *end = (const char *)std::memchr(first, separator, path_string.end() - first);
+        if (!end) {
+            end = path_string.end();
         }
-        std::string subkey(&path_string[start], &path_string[end]);
-        parts_.push_back(subkey);
-        start = end = end + 1;
+        parts_.push_back(atom(string_ref(first, end - first)));
+        first = end + 1;
     }
 }
 
@@ -0,0 +1,78 @@
+#ifndef _LIGHTCONF_PROJECTION_H_
+#define _LIGHTCONF_PROJECTION_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "path.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// The paths to keep when reading only part of a document, as a tree of their keys. A
+// path that is asked for takes everything under it, so a path to a group works as a
+// prefix for all of its contents.
+class projection {
+public:
+    const projection *  find(const std::string& key) const;
+    bool                whole() const       { return whole_; }
+
+    explicit projection(const std::vector<path>& paths);
+    projection();
+
+private:
+    std::map<std::string, projection> children_;
+    bool                whole_;
+};
+
+//
+//
+inline projection::projection() :
+    children_(),
+    whole_(false)
+{ }
+
+//
+//
+inline projection::projection(const std::vector<path>& paths) :
+    children_(),
+    whole_(false)
+{
+    for (const auto& p : paths) {
+        projection *node = this;
+        for (const auto& part : p) {
+            node = &node->children_[part];
+        }
+        node->whole_ = true;
+    }
+}
+
+//
+// The part of the projection for the entry with the given key, or nullptr if nothing
+// under it is wanted. A key with dots in it is followed as a path, since that is how
+// group::set() stores it.
+inline const projection *projection::find(const std::string& key) const {
+    const projection *node = this;
+    size_t start = 0;
+    while (!node->whole_) {
+        size_t end = key.find('.', start);
+        auto it = start == 0 && end == std::string::npos
+            ? node->children_.find(key)
+            : node->children_.find(key.substr(start, end - start));
+        if (it == node->children_.end()) {
+            return nullptr;
+        }
+        node = &it->second;
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return node;
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_PROJECTION_H_
@@ -0,0 +1,239 @@
+#ifndef _LIGHTCONF_PUSH_PARSER_H_
+#define _LIGHTCONF_PUSH_PARSER_H_
+
+#include <cerrno>
+#include <cstring>
+#include <istream>
+#include <string>
+#include "exceptions.hpp"
+#include "group_builder.hpp"
+#include "read_limits.hpp"
+#include "scanner.hpp"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+namespace lightconf {
+////////////////////
+
+const scanner_params push_scanner_params = {
+    nullptr,
+    allow_comments_flag | lazy_scan_flag | skip_trivia_flag | partial_input_flag
+};
+
+//
+// Parses a document handed over in chunks of any size, such as the reads from a pipe
+// or socket, reporting it to a handler as it goes. Each chunk is tokenized as far as it
+// goes and the tokens are fed to the format's token_parser straight away. Only a token
+// cut off by the end of a chunk is held back, to be scanned again once more input has
+// arrived, so the parser holds the nesting stack and at most one unfinished token.
+//
+// The events and any parse_error are the same as for the whole document at once. The
+// read_limits are checked as the chunks arrive, so a document over max_input_size fails
+// as soon as the chunk that crosses it is fed.
+template <typename Parser>
+class basic_push_parser {
+public:
+    typedef typename Parser::handler_type handler_type;
+
+    void                feed(const char *data, size_t size);
+    void                feed(const std::string& chunk);
+    void                feed(std::istream& in);
+    void                feed_fd(int fd);
+    void                finish();
+
+    explicit basic_push_parser(handler_type& handler, const read_limits& limits = default_read_limits);
+
+private:
+    basic_push_parser(const basic_push_parser&);
+    basic_push_parser&  operator=(const basic_push_parser&);
+
+    void                parse(bool last);
+
+    Parser              parser_;
+    scanner             scanner_;
+    std::string         pending_;
+    size_t              retry_size_;
+    size_t              fed_;
+    size_t              max_input_size_;
+    int                 line_;
+    int                 col_;
+};
+
+//
+// A push parser that builds a group.
+//
+//     config_format::push_parser parser;
+//     while ((count = read(fd, buf, sizeof(buf))) > 0) {
+//         parser.feed(buf, count);
+//     }
+//     group grp = parser.finish();
+//
+// The result is the same as read() gives for the whole document.
+template <template <typename> class TokenParser>
+class basic_group_push_parser {
+public:
+    void                feed(const char *data, size_t size)     { parser_.feed(data, size); }
+    void                feed(const std::string& chunk)          { parser_.feed(chunk); }
+    void                feed(std::istream& in)                  { parser_.feed(in); }
+    void                feed_fd(int fd)                         { parser_.feed_fd(fd); }
+    group               finish();
+
+    explicit basic_group_push_parser(const read_limits& limits = default_read_limits) :
+        builder_(),
+        parser_(builder_, limits)
+    { }
+
+private:
+    group_builder       builder_;
+    basic_push_parser<TokenParser<group_builder>> parser_;
+};
+
+//
+//
+template <typename Parser>
+inline basic_push_parser<Parser>::basic_push_parser(handler_type& handler, const read_limits& limits) :
+    parser_(handler, limits),
+    scanner_(),
+    pending_(),
+    retry_size_(0),
+    fed_(0),
+    max_input_size_(limits.max_input_size),
+    line_(1),
+    col_(1)
+{ }
+
+//
+//
+template <typename Parser>
+inline void basic_push_parser<Parser>::feed(const char *data, size_t size) {
+    if (parser_.done()) {
+        // anything after the end of a JSON document is ignored, as read() does
+        return;
+    }
+    if (size > max_input_size_ - fed_) {
+        // what is within the limit is parsed first, so that any error in it comes first
+        size_t allowed = max_input_size_ - fed_;
+        feed(data, allowed);
+        if (parser_.done()) {
+            return;
+        }
+        scanner_.set_origin(line_, col_);
+        scanner_.scan(pending_.data(), pending_.size(), push_scanner_params);
+        scanner_.fail("document too large", (unsigned int)pending_.size());
+    }
+    fed_ += size;
+    pending_.append(data, size);
+    parse(false);
+}
+
+//
+//
+template <typename Parser>
+inline void basic_push_parser<Parser>::feed(const std::string& chunk) {
+    feed(chunk.data(), chunk.size());
+}
+
+//
+// Feeds everything up to the end of the stream
+template <typename Parser>
+inline void basic_push_parser<Parser>::feed(std::istream& in) {
+    char chunk[65536];
+    while (in) {
+        in.read(chunk, sizeof(chunk));
+        feed(chunk, (size_t)in.gcount());
+    }
+    if (in.bad()) {
+        throw io_error("could not read stream");
+    }
+}
+
+//
+// Feeds everything up to end of file, parsing each read as it completes
+template <typename Parser>
+inline void basic_push_parser<Parser>::feed_fd(int fd) {
+#if !defined(_WIN32)
+    char chunk[65536];
+    while (true) {
+        ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count == 0) {
+            break;
+        }
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw io_error(std::string("could not read file descriptor: ") + std::strerror(errno));
+        }
+        feed(chunk, (size_t)count);
+    }
+#else
+    throw io_error("reading from a file descriptor is not supported on this platform");
+#endif
+}
+
+//
+// Parses whatever is left as the end of the document
+template <typename Parser>
+inline void basic_push_parser<Parser>::finish() {
+    if (!parser_.done()) {
+        parse(true);
+    }
+}
+
+//
+// A held-back token is usually a few bytes, but a long string literal can arrive over
+// many chunks. Rescanning it for every chunk would be quadratic in its length, so it is
+// only retried once the pending input has doubled in size since the last attempt.
+template <typename Parser>
+inline void basic_push_parser<Parser>::parse(bool last) {
+    if (!last && pending_.size() < retry_size_) {
+        return;
+    }
+
+    scanner_params params = push_scanner_params;
+    if (last) {
+        params.flags &= ~partial_input_flag;
+    }
+    scanner_.set_origin(line_, col_);
+    scanner_.scan(pending_.data(), pending_.size(), params);
+
+    while (!parser_.done()) {
+        const token& tok = scanner_.peek_token();
+        if (tok.type == token_type::eof_token && !last) {
+            break;
+        }
+        parser_.feed(scanner_, tok);
+        if (tok.type == token_type::eof_token) {
+            break;
+        }
+        scanner_.next_token();
+    }
+
+    // Drop the consumed input, keeping track of where the rest of it starts
+    size_t consumed = parser_.done() ? pending_.size() : scanner_.scanned_length();
+    const char *first = pending_.data();
+    const char *end = first + consumed;
+    while (const void *newline = std::memchr(first, '\n', end - first)) {
+        first = (const char *)newline + 1;
+        line_++;
+        col_ = 1;
+    }
+    col_ += (int)(end - first);
+    pending_.erase(0, consumed);
+    retry_size_ = 2 * pending_.size();
+}
+
+//
+//
+template <template <typename> class TokenParser>
+inline group basic_group_push_parser<TokenParser>::finish() {
+    parser_.finish();
+    return builder_.result();
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_PUSH_PARSER_H_
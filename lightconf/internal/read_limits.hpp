@@ -0,0 +1,97 @@
+#ifndef _LIGHTCONF_READ_LIMITS_H_
+#define _LIGHTCONF_READ_LIMITS_H_
+
+#include <cstdint>
+#include <string>
+#include "scanner.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// Bounds on what a document may contain, for reading documents from sources that
+// aren't trusted. A document over any of them fails with a parse_error at the point
+// where the limit is crossed, without reading any further.
+struct read_limits {
+    size_t              max_depth;          // groups and vectors open at once, the document included
+    size_t              max_nodes;          // groups, vectors and scalars in all
+    size_t              max_string_length;  // bytes in any one key or string, once unescaped
+    size_t              max_input_size;     // bytes in the whole document
+};
+
+// What read() and parse() use. Only the depth is limited, to keep the recursion in
+// copying, comparing and destroying the groups that are read well clear of the stack's
+// end; the readers and writers themselves don't recurse.
+const read_limits default_read_limits = {
+    512,
+    SIZE_MAX,
+    SIZE_MAX,
+    SIZE_MAX
+};
+
+//
+// Counts a document against read_limits as a parser goes through it. Each check fails
+// through the scanner, so the error has the location of the token that crossed the
+// limit.
+class limit_checker {
+public:
+    void                enter(const scanner& sc, unsigned int pos, size_t depth) const;
+    void                node(const scanner& sc, unsigned int pos);
+    void                string(const scanner& sc, unsigned int pos, size_t length) const;
+    void                input(const scanner& sc, size_t size) const;
+
+    bool                allows_depth(size_t depth) const            { return depth <= limits_.max_depth; }
+    bool                allows_node()                               { return ++nodes_ <= limits_.max_nodes; }
+    bool                allows_string(size_t length) const          { return length <= limits_.max_string_length; }
+    const read_limits&  limits() const                              { return limits_; }
+
+    explicit limit_checker(const read_limits& limits = default_read_limits);
+
+private:
+    read_limits         limits_;
+    size_t              nodes_;
+};
+
+//
+//
+inline limit_checker::limit_checker(const read_limits& limits) :
+    limits_(limits),
+    nodes_(0)
+{ }
+
+//
+// For a group or vector opened at pos, depth deep
+inline void limit_checker::enter(const scanner& sc, unsigned int pos, size_t depth) const {
+    if (!allows_depth(depth)) {
+        sc.fail("nesting too deep", pos);
+    }
+}
+
+//
+//
+inline void limit_checker::node(const scanner& sc, unsigned int pos) {
+    if (!allows_node()) {
+        sc.fail("too many values", pos);
+    }
+}
+
+//
+//
+inline void limit_checker::string(const scanner& sc, unsigned int pos, size_t length) const {
+    if (!allows_string(length)) {
+        sc.fail("string too long", pos);
+    }
+}
+
+//
+// Fails at the first byte past the limit
+inline void limit_checker::input(const scanner& sc, size_t size) const {
+    if (size > limits_.max_input_size) {
+        sc.fail("document too large", (unsigned int)limits_.max_input_size);
+    }
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_READ_LIMITS_H_
@@ -0,0 +1,356 @@
+#ifndef _LIGHTCONF_SCAN_KERNELS_H_
+#define _LIGHTCONF_SCAN_KERNELS_H_
+
+#include <cstdint>
+#include <cstring>
+
+// SIMD kernels are used on x86 with GCC-compatible compilers unless LIGHTCONF_NO_SIMD
+// is defined. The AVX2 versions are only selected if the CPU supports them at runtime.
+#if !defined(LIGHTCONF_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define LIGHTCONF_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace lightconf {
+////////////////////
+
+//
+// Classes of bytes in a 64-byte block, one bit per byte with byte 0 in the lowest bit
+struct block_masks {
+    uint64_t            quote;          // '"'
+    uint64_t            backslash;      // '\\'
+    uint64_t            op;             // '{', '}', '[', ']', ':' or ','
+    uint64_t            whitespace;     // <= 0x20 as a signed char, so bytes >= 0x80 too
+    uint64_t            slash;          // '/'
+    uint64_t            high;           // >= 0x80
+};
+
+//
+// Each find kernel returns a pointer to the first byte in [first, last) that ends the
+// span being skipped, or last if there is no such byte.
+//
+//   find_string_special    first '"', '\\', '\r' or '\n' (things scan_string handles)
+//   find_identifier_end    first byte not in [A-Za-z0-9_-]
+//   find_whitespace_end    first '\n' or byte that is not whitespace (> 0x20 as a signed char)
+//
+// classify_block fills in the block_masks for the 64 bytes at block.
+//
+struct scan_kernels {
+    const char *        (*find_string_special)(const char *first, const char *last);
+    const char *        (*find_identifier_end)(const char *first, const char *last);
+    const char *        (*find_whitespace_end)(const char *first, const char *last);
+    void                (*classify_block)(const char *block, block_masks *masks);
+    const char *        name;
+};
+
+const scan_kernels&     scalar_scan_kernels();
+const scan_kernels *    sse2_scan_kernels();
+const scan_kernels *    avx2_scan_kernels();
+const scan_kernels&     active_scan_kernels();
+
+namespace kernels {
+////////////////////
+
+//
+//
+inline bool is_string_special(char c) {
+    return c == '"' || c == '\\' || c == '\r' || c == '\n';
+}
+
+//
+//
+inline bool is_identifier_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+//
+//
+inline bool is_whitespace_end(char c) {
+    return c == '\n' || c > 0x20;
+}
+
+//
+//
+inline const char *scalar_find_string_special(const char *first, const char *last) {
+    while (first != last && !is_string_special(*first)) {
+        ++first;
+    }
+    return first;
+}
+
+//
+//
+inline const char *scalar_find_identifier_end(const char *first, const char *last) {
+    while (first != last && is_identifier_char(*first)) {
+        ++first;
+    }
+    return first;
+}
+
+//
+//
+inline const char *scalar_find_whitespace_end(const char *first, const char *last) {
+    while (first != last && !is_whitespace_end(*first)) {
+        ++first;
+    }
+    return first;
+}
+
+//
+//
+inline void scalar_classify_block(const char *block, block_masks *masks) {
+    block_masks m = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 64; i++) {
+        char c = block[i];
+        uint64_t bit = 1ULL << i;
+        if (c == '"') m.quote |= bit;
+        if (c == '\\') m.backslash |= bit;
+        if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') m.op |= bit;
+        if (c <= 0x20) m.whitespace |= bit;
+        if (c == '/') m.slash |= bit;
+        if (c & 0x80) m.high |= bit;
+    }
+    *masks = m;
+}
+
+#ifdef LIGHTCONF_SIMD_X86
+
+//
+// The vector kernels build a mask of "stop" bytes for each block and jump straight to
+// the first set bit; the remaining tail shorter than a block is handled by the scalar
+// kernel. Byte comparisons are signed, so bytes >= 0x80 compare as negative, exactly
+// as they do for char in the scalar kernels.
+
+//
+//
+inline const char *sse2_find_string_special(const char *first, const char *last) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (last - first >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        __m128i stop = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, lf)));
+        int mask = _mm_movemask_epi8(stop);
+        if (mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 16;
+    }
+    return scalar_find_string_special(first, last);
+}
+
+//
+//
+inline const char *sse2_find_identifier_end(const char *first, const char *last) {
+    while (last - first >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        __m128i folded = _mm_or_si128(block, _mm_set1_epi8(0x20));
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+            _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)),
+            _mm_cmplt_epi8(block, _mm_set1_epi8('9' + 1)));
+        __m128i punct = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('_')),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('-')));
+        int mask = ~_mm_movemask_epi8(_mm_or_si128(alpha, _mm_or_si128(digit, punct))) & 0xffff;
+        if (mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 16;
+    }
+    return scalar_find_identifier_end(first, last);
+}
+
+//
+//
+inline const char *sse2_find_whitespace_end(const char *first, const char *last) {
+    while (last - first >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        __m128i stop = _mm_or_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(0x20)),
+            _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+        int mask = _mm_movemask_epi8(stop);
+        if (mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 16;
+    }
+    return scalar_find_whitespace_end(first, last);
+}
+
+//
+//
+__attribute__((target("avx2")))
+inline const char *avx2_find_string_special(const char *first, const char *last) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (last - first >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        __m256i stop = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, cr), _mm256_cmpeq_epi8(block, lf)));
+        unsigned int mask = _mm256_movemask_epi8(stop);
+        if (mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 32;
+    }
+    return sse2_find_string_special(first, last);
+}
+
+//
+//
+__attribute__((target("avx2")))
+inline const char *avx2_find_identifier_end(const char *first, const char *last) {
+    while (last - first >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        __m256i folded = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), folded));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8('0' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), block));
+        __m256i punct = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('_')),
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('-')));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(alpha, _mm256_or_si256(digit, punct)));
+        if (mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 32;
+    }
+    return sse2_find_identifier_end(first, last);
+}
+
+//
+//
+__attribute__((target("avx2")))
+inline const char *avx2_find_whitespace_end(const char *first, const char *last) {
+    while (last - first >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        __m256i stop = _mm256_or_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(0x20)),
+            _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')));
+        unsigned int mask = _mm256_movemask_epi8(stop);
+        if (mask != 0) {
+            return first + __builtin_ctz(mask);
+        }
+        first += 32;
+    }
+    return sse2_find_whitespace_end(first, last);
+}
+
+//
+// '[' and ']' differ from '{' and '}' only in bit 0x20, so setting it folds all four
+// brackets onto two comparisons
+inline void sse2_classify_block(const char *block, block_masks *masks) {
+    block_masks m = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+        __m128i folded = _mm_or_si128(in, _mm_set1_epi8(0x20));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(':')), _mm_cmpeq_epi8(in, _mm_set1_epi8(','))));
+        int shift = 16 * i;
+        m.quote |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('"'))) << shift;
+        m.backslash |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('\\'))) << shift;
+        m.op |= (uint64_t)(unsigned)_mm_movemask_epi8(op) << shift;
+        m.whitespace |= (uint64_t)(~(unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(in, _mm_set1_epi8(0x20))) & 0xffff) << shift;
+        m.slash |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('/'))) << shift;
+        m.high |= (uint64_t)(unsigned)_mm_movemask_epi8(in) << shift;
+    }
+    *masks = m;
+}
+
+//
+//
+__attribute__((target("avx2")))
+inline void avx2_classify_block(const char *block, block_masks *masks) {
+    block_masks m = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 2; i++) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * i));
+        __m256i folded = _mm256_or_si256(in, _mm256_set1_epi8(0x20));
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(':')),
+                _mm256_cmpeq_epi8(in, _mm256_set1_epi8(','))));
+        int shift = 32 * i;
+        m.quote |= (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('"'))) << shift;
+        m.backslash |= (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\\'))) << shift;
+        m.op |= (uint64_t)(unsigned)_mm256_movemask_epi8(op) << shift;
+        m.whitespace |= (uint64_t)(~(unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(in, _mm256_set1_epi8(0x20)))) << shift;
+        m.slash |= (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'))) << shift;
+        m.high |= (uint64_t)(unsigned)_mm256_movemask_epi8(in) << shift;
+    }
+    *masks = m;
+}
+
+#endif // LIGHTCONF_SIMD_X86
+
+////////////////////
+}
+
+//
+//
+inline const scan_kernels& scalar_scan_kernels() {
+    static const scan_kernels k = {
+        kernels::scalar_find_string_special,
+        kernels::scalar_find_identifier_end,
+        kernels::scalar_find_whitespace_end,
+        kernels::scalar_classify_block,
+        "scalar"
+    };
+    return k;
+}
+
+//
+// Returns nullptr if the kernels are not compiled in or not supported by this CPU
+inline const scan_kernels *sse2_scan_kernels() {
+#ifdef LIGHTCONF_SIMD_X86
+    static const scan_kernels k = {
+        kernels::sse2_find_string_special,
+        kernels::sse2_find_identifier_end,
+        kernels::sse2_find_whitespace_end,
+        kernels::sse2_classify_block,
+        "sse2"
+    };
+    return &k;
+#else
+    return nullptr;
+#endif
+}
+
+//
+// Returns nullptr if the kernels are not compiled in or not supported by this CPU
+inline const scan_kernels *avx2_scan_kernels() {
+#ifdef LIGHTCONF_SIMD_X86
+    static const scan_kernels k = {
+        kernels::avx2_find_string_special,
+        kernels::avx2_find_identifier_end,
+        kernels::avx2_find_whitespace_end,
+        kernels::avx2_classify_block,
+        "avx2"
+    };
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return supported ? &k : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+//
+// The best kernels available, selected once on first use
+inline const scan_kernels& active_scan_kernels() {
+    static const scan_kernels& k = avx2_scan_kernels() ? *avx2_scan_kernels()
+        : sse2_scan_kernels() ? *sse2_scan_kernels()
+        : scalar_scan_kernels();
+    return k;
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_SCAN_KERNELS_H_
@@ -1,10 +1,15 @@
 #ifndef _LIGHTCONF_SCANNER_H_
 #define _LIGHTCONF_SCANNER_H_
 
-#include <cstdlib>
+#include <algorithm>
+#include <cstring>
 #include <functional>
 #include <string>
+#include <vector>
 #include "exceptions.hpp"
+#include "number_parser.hpp"
+#include "scan_kernels.hpp"
+#include "string_ref.hpp"
 
 namespace lightconf {
 ////////////////////
@@ -18,7 +23,10 @@ enum scanner_flags {
     empty_flag                  = 0x00,
     allow_comments_flag         = 0x01,     
     utf8_exceptions_flag        = 0x02,     
-    blank_line_comment_flag     = 0x04
+    blank_line_comment_flag     = 0x04,
+    lazy_scan_flag              = 0x08,
+    skip_trivia_flag            = 0x10,
+    partial_input_flag          = 0x20
 };
 
 //
@@ -37,28 +45,29 @@ enum class token_type {
 typedef std::function<void (const std::string&)> comment_function_t;
 
 //
-//
+// Tokens refer to their text as a range of the scanner's input. Only string literals
+// that contain escape sequences carry their own (unescaped) copy of the text.
 struct token {
     token_type          type;
  
-    std::string         string_value;
+    std::string         unescaped;
+    bool                escaped;
     double              number_value;
     char                char_value;
 
-    int                 pos;
-    int                 line;
-    int                 col;
+    unsigned int        pos;
+    unsigned int        length;
 
     bool                is_char(char c) const { return type == token_type::char_token && char_value == c; }
 
     explicit token(token_type type = token_type::none_token) :
         type(type),
-        string_value(),
+        unescaped(),
+        escaped(),
         number_value(),
         char_value(),
         pos(),
-        line(),
-        col()
+        length()
     { }
 };
 
@@ -75,48 +84,82 @@ const scanner_params default_scanner_params = {
     allow_comments_flag | blank_line_comment_flag
 };
 
+// Tokens are produced on demand as the parser pulls them, and whitespace and comments
+// are skipped without ever becoming tokens, since nothing is needed from them when
+// just building a group. write() uses default_scanner_params to keep the comments.
+const scanner_params read_scanner_params = {
+    nullptr,
+    allow_comments_flag | lazy_scan_flag | skip_trivia_flag
+};
+
 //
 //
 class scanner {
 public:
     void                scan(const std::string& input, scanner_params params = default_scanner_params);
+    void                scan(const char *input, size_t size, scanner_params params = default_scanner_params);
 
     void                next_token();
+    void                skip_to(unsigned int pos);
     void                skip_whitespace(bool ignore_comments);
     void                expect(token_type type, bool optional = false);
     void                expect(char c, bool optional = false);
     std::string         expect_string();
     std::string         expect_identifier();
+    string_ref          expect_string_ref();
+    string_ref          expect_identifier_ref();
     double              expect_number();
 
     bool                token_available() const;
-    token               cur_token() const;
-    token               peek_token() const;
+    const token&        cur_token() const;
+    const token&        peek_token() const;
+    string_ref          token_text(const token& tok) const;
+
+    bool                starved() const;
+    unsigned int        scanned_length() const;
 
-    void                fail(const std::string& message, int line, int col) const;
+    void                set_origin(int line, int col);
+    void                location(unsigned int pos, int *line, int *col) const;
+    void                fail(const std::string& message, unsigned int pos) const;
+
+    const char *        input() const { return external_input_ ? external_input_ : storage_.data(); }
+    unsigned int        input_size() const { return input_size_; }
 
     scanner();
 private:
     bool                eof() const;
     char                ch() const;
     void                next_ch();
+    void                advance(unsigned int count);
     std::string         utf8_unescape();
 
-    std::string         scan_identifier();
-    std::string         scan_string();
+    void                scan_token();
+    void                skip_trivia();
+    bool                token_complete() const;
+    void                find_significant_token();
+
+    void                scan_identifier();
+    void                scan_string(token& tok);
     double              scan_number();
 
     char32_t            try_read_hex(bool *failed);
     
-    std::string         input_;
+    std::string         storage_;
+    const char *        external_input_;
+    unsigned int        input_size_;
     std::vector<token>  tokens_;
     unsigned int        cur_token_;
+    unsigned int        peek_token_;
     bool                eof_;
+    bool                starved_;
+    std::string         string_buf_;
+    int                 origin_line_;
+    int                 origin_col_;
 
+    token               eof_token_;
     unsigned int        pos_;
-    int                 line_;
-    int                 col_;
 
+    const scan_kernels *kernels_;
     scanner_params      params_;
 };
 
@@ -161,45 +204,55 @@ inline std::string token_name(const token& tok) {
 //
 //
 inline scanner::scanner() :
+    external_input_(nullptr),
+    input_size_(0),
     cur_token_(0),
+    peek_token_(0),
     eof_(true),
+    starved_(false),
+    origin_line_(1),
+    origin_col_(1),
+    eof_token_(token_type::eof_token),
     pos_(0),
-    line_(1),
-    col_(1),
+    kernels_(&active_scan_kernels()),
     params_({ comment_function_t(), empty_flag })
 { }
 
 //
 //
 inline bool scanner::token_available() const {
-    return cur_token_ <= tokens_.size() - 1;
+    return cur_token_ < tokens_.size();
 }
 
 //
 //
-inline token scanner::cur_token() const {
+inline const token& scanner::cur_token() const {
     if (cur_token_ == tokens_.size()) {
-        token tok;
-        tok.type = token_type::eof_token;
-        return tok;
+        return eof_token_;
     }
     return tokens_[cur_token_];
 }
 
 //
 //
-inline token scanner::peek_token() const {
-    unsigned int i = cur_token_;
-    while (i < tokens_.size()) {
-        if (tokens_[i].type != token_type::whitespace_token && tokens_[i].type != token_type::comment_token) {
-            break;
-        }
-        i++;
+inline const token& scanner::peek_token() const {
+    if (peek_token_ == tokens_.size()) {
+        return eof_token_;
     }
-    if (i == tokens_.size()) {
-        return token(token_type::eof_token);
+    return tokens_[peek_token_];
+}
+
+//
+// The text of an identifier, whitespace or comment token, or the contents of a string
+// literal with the quotes removed and any escape sequences resolved
+inline string_ref scanner::token_text(const token& tok) const {
+    if (tok.type == token_type::string_token) {
+        if (tok.escaped) {
+            return string_ref(tok.unescaped);
+        }
+        return string_ref(input() + tok.pos + 1, tok.length - 2);
     }
-    return tokens_[i];
+    return string_ref(input() + tok.pos, tok.length);
 }
 
 //
@@ -214,7 +267,7 @@ inline char scanner::ch() const {
     if (eof()) {
         return 0;
     }
-    return input_[pos_];
+    return input()[pos_];
 }
 
 //
@@ -222,14 +275,17 @@ inline char scanner::ch() const {
 inline void scanner::next_ch() {
     if (eof()) return;
 
-    col_++;
-    if (ch() == '\n') {
-        line_++;
-        col_ = 1;
+    pos_++;
+    if (pos_ >= input_size_) {
+        eof_ = true;
     }
+}
 
-    pos_++;
-    if (pos_ >= input_.length()) {
+//
+//
+inline void scanner::advance(unsigned int count) {
+    pos_ += count;
+    if (pos_ >= input_size_) {
         eof_ = true;
     }
 }
@@ -237,98 +293,245 @@ inline void scanner::next_ch() {
 //
 //
 inline void scanner::scan(const std::string& input, scanner_params params) {
-    input_ = input;
+    storage_ = input;
+    scan(nullptr, input.size(), params);
+}
+
+//
+// The input is not copied, so it must stay alive and unchanged while the scanner is
+// in use. Passing nullptr scans the scanner's own copy made by scan(std::string).
+inline void scanner::scan(const char *input, size_t size, scanner_params params) {
+    external_input_ = input;
+    input_size_ = size;
     pos_ = 0;
-    line_ = 1;
-    col_ = 1;
+    eof_token_.pos = size;
+    tokens_.clear();
     cur_token_ = 0;
-    eof_ = input.empty();
+    peek_token_ = 0;
+    eof_ = size == 0;
+    starved_ = false;
     params_ = params;
 
-    while (!eof()) {
-        token tok;
-        tok.pos = pos_;
-        tok.line = line_;
-        tok.col = col_;
-
-        switch (ch()) {
-        case '"': 
-            tok.type = token_type::string_token;
-            tok.string_value = scan_string();
-            break;
-
-        case '0': case '1': case '2': case '3': case '4':
-        case '5': case '6': case '7': case '8': case '9':
-        case '-': case '.':
-            tok.type = token_type::number_token;
-            tok.number_value = scan_number(); 
-            break;
+    if (!(params_.flags & lazy_scan_flag)) {
+        while (!eof()) {
+            scan_token();
+        }
+    }
+    find_significant_token();
+}
 
-        case 'a': case 'b': case 'c': case 'd': case 'e': case 'f':
-        case 'g': case 'h': case 'i': case 'j': case 'k': case 'l':
-        case 'm': case 'n': case 'o': case 'p': case 'q': case 'r':
-        case 's': case 't': case 'u': case 'v': case 'w': case 'x':
-        case 'y': case 'z':
-        case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
-        case 'G': case 'H': case 'I': case 'J': case 'K': case 'L':
-        case 'M': case 'N': case 'O': case 'P': case 'Q': case 'R':
-        case 'S': case 'T': case 'U': case 'V': case 'W': case 'X':
-        case 'Y': case 'Z':
-            tok.type = token_type::identifier_token;
-            tok.string_value = scan_identifier();
-            break;
+//
+// Scan the next whitespace run, comment or significant token and append it to tokens_
+inline void scanner::scan_token() {
+    if (params_.flags & skip_trivia_flag) {
+        skip_trivia();
+        if (eof()) {
+            return;
+        }
+    }
+    if (params_.flags & partial_input_flag && !token_complete()) {
+        starved_ = true;
+        eof_ = true;
+        return;
+    }
 
-        case '/':
-            if (params_.flags & allow_comments_flag && pos_ < input_.size() - 1 && input[pos_ + 1] == '/') {
-                tok.type = token_type::comment_token;
-                tok.string_value = "";
-                while (!eof() && ch() != '\n') {
-                    if (ch() != '\r') {
-                        tok.string_value.append(1, ch());
+    token tok;
+    tok.pos = pos_;
+
+    switch (ch()) {
+    case '"': 
+        tok.type = token_type::string_token;
+        scan_string(tok);
+        break;
+
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+    case '-': case '.':
+        tok.type = token_type::number_token;
+        tok.number_value = scan_number(); 
+        break;
+
+    case 'a': case 'b': case 'c': case 'd': case 'e': case 'f':
+    case 'g': case 'h': case 'i': case 'j': case 'k': case 'l':
+    case 'm': case 'n': case 'o': case 'p': case 'q': case 'r':
+    case 's': case 't': case 'u': case 'v': case 'w': case 'x':
+    case 'y': case 'z':
+    case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
+    case 'G': case 'H': case 'I': case 'J': case 'K': case 'L':
+    case 'M': case 'N': case 'O': case 'P': case 'Q': case 'R':
+    case 'S': case 'T': case 'U': case 'V': case 'W': case 'X':
+    case 'Y': case 'Z':
+        tok.type = token_type::identifier_token;
+        scan_identifier();
+        break;
+
+    case '/':
+        if (params_.flags & allow_comments_flag && pos_ < input_size_ - 1 && input()[pos_ + 1] == '/') {
+            tok.type = token_type::comment_token;
+            const char *first = input() + pos_;
+            const void *newline = std::memchr(first, '\n', input_size_ - pos_);
+            advance(newline ? (const char *)newline - first : input_size_ - pos_);
+        } else {
+            tok.type = token_type::char_token;
+            tok.char_value = '/';
+            next_ch();
+        }
+        break;
+
+    default:
+        if (ch() <= 0x20) {
+            bool newline_seen = false;
+
+            tok.type = token_type::whitespace_token;
+
+            while (!eof() && ch() <= 0x20) {
+                // If we have more than one newline in a block of whitespace, we consider that
+                // a blank comment (if the appropriate scanner flag is enabled)
+                if (ch() == '\n') {
+                    if (newline_seen && params_.flags & blank_line_comment_flag) {
+                        token blank_line;
+                        blank_line.type = token_type::comment_token;
+                        blank_line.pos = pos_;
+                        tok.length = pos_ - tok.pos;
+                        tokens_.push_back(tok);
+                        tokens_.push_back(blank_line);
+                        next_ch();
+                        tok.pos = pos_;
+                        continue;
                     }
+                    newline_seen = true;
                     next_ch();
+                } else {
+                    const char *first = input() + pos_;
+                    advance(kernels_->find_whitespace_end(first, input() + input_size_) - first);
                 }
-            } else {
-                tok.type = token_type::char_token;
-                tok.char_value = '/';
-                next_ch();
             }
-            break;
+        } else {
+            tok.type = token_type::char_token;
+            tok.char_value = ch();
+            next_ch();
+        }
+        break;
+    }
 
-        default:
-            if (ch() <= 0x20) {
-                bool newline_seen = false;
-
-                tok.type = token_type::whitespace_token;
-                tok.string_value = "";
-
-                while (!eof() && ch() <= 0x20) {
-                    // If we have more than one newline in a block of whitespace, we consider that
-                    // a blank comment (if the appropriate scanner flag is enabled)
-                    if (ch() == '\n') {
-                        if (newline_seen && params_.flags & blank_line_comment_flag) {
-                            token blank_line;
-                            blank_line.type = token_type::comment_token;
-                            blank_line.string_value = "";
-                            tokens_.push_back(tok);
-                            tokens_.push_back(blank_line);
-                            next_ch();
-                            continue;
-                        }
-                        newline_seen = true;
-                    }
-                    tok.string_value.append(1, ch());
-                    next_ch();
-                }
-            } else {
-                tok.type = token_type::char_token;
-                tok.char_value = ch();
-                next_ch();
+    tok.length = pos_ - tok.pos;
+    tokens_.push_back(tok);
+}
+
+//
+// Consume whitespace and comments without producing any tokens
+inline void scanner::skip_trivia() {
+    const char *last = input() + input_size_;
+    while (!eof()) {
+        const char *first = input() + pos_;
+        if (ch() == '\n') {
+            next_ch();
+        } else if (ch() <= 0x20) {
+            advance(kernels_->find_whitespace_end(first, last) - first);
+        } else if (ch() == '/' && params_.flags & allow_comments_flag && first + 1 != last && first[1] == '/') {
+            const void *newline = std::memchr(first, '\n', last - first);
+            if (!newline && params_.flags & partial_input_flag) {
+                // the rest of the comment hasn't arrived yet
+                starved_ = true;
+                eof_ = true;
+                return;
             }
+            advance(newline ? (const char *)newline - first : last - first);
+        } else if (ch() == '/' && params_.flags & allow_comments_flag && params_.flags & partial_input_flag
+            && first + 1 == last) {
+            starved_ = true;
+            eof_ = true;
+            return;
+        } else {
             break;
         }
+    }
+}
+
+//
+// With partial_input_flag set, the input may be cut off anywhere, so a token that runs
+// into the end of it might continue in the next piece. This checks whether the token
+// at pos_ is known to end within the input; if not, scan_token leaves it unscanned.
+inline bool scanner::token_complete() const {
+    const char *first = input() + pos_;
+    const char *last = input() + input_size_;
+    const char *p = first + 1;
+
+    switch (*first) {
+    case '"':
+        // look for the closing quote, stepping over escape sequences; a newline also
+        // ends the token (scan_string reports it)
+        while (true) {
+            p = kernels_->find_string_special(p, last);
+            if (p == last) {
+                return false;
+            }
+            if (*p != '\\') {
+                return true;
+            }
+            if (last - p <= 2) {
+                return false;
+            }
+            p += 2;
+        }
 
-        tokens_.push_back(tok);
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+    case '-': case '.':
+        while (p != last && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E'
+            || *p == '+' || *p == '-')) {
+            ++p;
+        }
+        return p != last;
+
+    case '/':
+        if (params_.flags & allow_comments_flag) {
+            return p != last && (*p != '/' || std::memchr(p, '\n', last - p));
+        }
+        return true;
+
+    default:
+        if ((*first >= 'A' && *first <= 'Z') || (*first >= 'a' && *first <= 'z')) {
+            return kernels_->find_identifier_end(p, last) != last;
+        }
+        if (*first <= 0x20) {
+            while (p != last && *p <= 0x20) {
+                ++p;
+            }
+            return p != last;
+        }
+        return true;
+    }
+}
+
+//
+// Move peek_token_ forward to the first significant token at or after cur_token_. It
+// only ever moves forward, so each token is examined once. In lazy mode this is also
+// where tokens get scanned: just far enough that the window holds the next significant
+// token (or everything up to the end of the input), after discarding consumed tokens.
+inline void scanner::find_significant_token() {
+    bool lazy = params_.flags & lazy_scan_flag;
+    if (lazy && cur_token_ == tokens_.size()) {
+        tokens_.clear();
+        cur_token_ = 0;
+        peek_token_ = 0;
+    }
+    if (peek_token_ < cur_token_) {
+        peek_token_ = cur_token_;
+    }
+
+    while (true) {
+        while (peek_token_ < tokens_.size()) {
+            if (tokens_[peek_token_].type != token_type::whitespace_token
+                && tokens_[peek_token_].type != token_type::comment_token) {
+                return;
+            }
+            peek_token_++;
+        }
+        if (!lazy || eof()) {
+            return;
+        }
+        scan_token();
     }
 }
 
@@ -337,17 +540,53 @@ inline void scanner::scan(const std::string& input, scanner_params params) {
 inline void scanner::next_token() {
     if (token_available()) {
         cur_token_++;
+        find_significant_token();
     }
 }
 
+//
+// Drops the peeked token and anything scanned after it, and carries on from byte pos,
+// which must not be before the start of the peeked token. For stepping over a value
+// whose end has been found some other way. Without lazy_scan_flag every token has been
+// scanned already, so it steps on to the first that starts at pos or later instead.
+inline void scanner::skip_to(unsigned int pos) {
+    if (!(params_.flags & lazy_scan_flag)) {
+        while (cur_token_ < tokens_.size() && tokens_[cur_token_].pos < pos) {
+            cur_token_++;
+        }
+        peek_token_ = cur_token_;
+        find_significant_token();
+        return;
+    }
+    tokens_.clear();
+    cur_token_ = 0;
+    peek_token_ = 0;
+    pos_ = std::min(pos, input_size_);
+    eof_ = pos_ >= input_size_;
+    find_significant_token();
+}
+
 //
 //
 inline void scanner::skip_whitespace(bool ignore_comments) {
+    if (ignore_comments || !params_.comment_function) {
+        // nothing needs to see the skipped tokens, so jump straight to the next one
+        if (cur_token_ != peek_token_) {
+            cur_token_ = peek_token_;
+            find_significant_token();
+        }
+        return;
+    }
     while (cur_token().type == token_type::whitespace_token || cur_token().type == token_type::comment_token) {
-        if (cur_token().type == token_type::comment_token && !ignore_comments) {
-            if (params_.comment_function) {
-                params_.comment_function(cur_token().string_value);
+        if (cur_token().type == token_type::comment_token) {
+            string_ref text = token_text(cur_token());
+            std::string comment;
+            for (char c : text) {
+                if (c != '\r') {
+                    comment.append(1, c);
+                }
             }
+            params_.comment_function(comment);
         }
         next_token();
     }
@@ -362,7 +601,7 @@ inline void scanner::expect(token_type tok, bool optional) {
     } else {
         if (!optional) {
             fail("expected " + token_name(token(tok)) + " but found " + token_name(cur_token()),
-                cur_token().line, cur_token().col);
+                cur_token().pos);
         }
     }
 }
@@ -376,7 +615,7 @@ inline void scanner::expect(char c, bool optional) {
     } else {
         if (!optional) {
             fail("expected '" + std::string(1, c) + "' but found " + token_name(cur_token()),
-                cur_token().line, cur_token().col);
+                cur_token().pos);
         }
     }
 }
@@ -384,25 +623,43 @@ inline void scanner::expect(char c, bool optional) {
 //
 //
 inline std::string scanner::expect_string() {
+    return expect_string_ref().str();
+}
+
+//
+//
+inline std::string scanner::expect_identifier() {
+    return expect_identifier_ref().str();
+}
+
+//
+// The returned text stays valid until the next call to expect_string_ref, or until
+// the scanner is destroyed or rescanned
+inline string_ref scanner::expect_string_ref() {
     skip_whitespace(false);
     if (cur_token().type != token_type::string_token) {
         fail("expected " + token_name(token(token_type::string_token)) + " but found " + token_name(cur_token()),
-            cur_token().line, cur_token().pos);
+            cur_token().pos);
+    }
+    string_ref val = token_text(cur_token());
+    if (cur_token().escaped) {
+        // In lazy mode the token itself may be discarded by next_token()
+        string_buf_.swap(tokens_[cur_token_].unescaped);
+        val = string_ref(string_buf_);
     }
-    std::string val = cur_token().string_value;
     next_token();
     return val;
 }
 
 //
-//
-inline std::string scanner::expect_identifier() {
+// The returned text stays valid until the scanner is destroyed or rescanned
+inline string_ref scanner::expect_identifier_ref() {
     skip_whitespace(false);
     if (cur_token().type != token_type::identifier_token) {
         fail("expected " + token_name(token(token_type::identifier_token)) + " but found " + token_name(cur_token()),
-            cur_token().line, cur_token().pos);
+            cur_token().pos);
     }
-    std::string val = cur_token().string_value;
+    string_ref val = token_text(cur_token());
     next_token();
     return val;
 }
@@ -413,7 +670,7 @@ inline double scanner::expect_number() {
     skip_whitespace(false);
     if (cur_token().type != token_type::number_token) {
         fail("expected " + token_name(token(token_type::number_token)) + " but found " + token_name(cur_token()),
-            cur_token().line, cur_token().pos);
+            cur_token().pos);
     }
     double val = cur_token().number_value;
     next_token();
@@ -422,33 +679,42 @@ inline double scanner::expect_number() {
 
 //
 //
-inline std::string scanner::scan_identifier() {
-    std::string buf;
-    while ((ch() >= 'A' && ch() <= 'Z')
-        || (ch() >= 'a' && ch() <= 'z')
-        || (ch() >= '0' && ch() <= '9')
-        || ch() == '_' || ch() == '-')
-    {
-        buf += ch();
-        next_ch();
-    }
-    return buf;
+inline void scanner::scan_identifier() {
+    const char *first = input() + pos_;
+    advance(kernels_->find_identifier_end(first, input() + input_size_) - first);
 }
 
 
 //
-//
-inline std::string scanner::scan_string() {
-    std::string buf;
+// Strings without escape sequences are left in place in the input; the first escape
+// sequence switches to building an unescaped copy in the token
+inline void scanner::scan_string(token& tok) {
+    std::string& buf = tok.unescaped;
     next_ch();
-    while (ch() != '"') {
+    unsigned int start = pos_;
+    while (true) {
+        // Skip straight to the next character that needs attention
+        const char *first = input() + pos_;
+        unsigned int count = kernels_->find_string_special(first, input() + input_size_) - first;
+        if (tok.escaped) {
+            buf.append(first, count);
+        }
+        advance(count);
+
+        if (ch() == '"') {
+            break;
+        }
         if (eof_) {
-            fail("unclosed string literal", line_, col_);
+            fail("unclosed string literal", pos_);
         }
         if (ch() == '\r' || ch() == '\n') {
-            fail("newline in string literal", line_, col_);
+            fail("newline in string literal", pos_);
         }
         if (ch() == '\\') {
+            if (!tok.escaped) {
+                tok.escaped = true;
+                buf.assign(input() + start, pos_ - start);
+            }
             next_ch();
             if (ch() == 'u') {
                 next_ch();
@@ -467,32 +733,28 @@ inline std::string scanner::scan_string() {
                 }
                 next_ch();
             }
-        } else {
-            buf += ch();
-            next_ch();
         }
     }
     next_ch();
-    return buf;
 }
 
 //
 //
 inline double scanner::scan_number() {
-    const char *ptr = input_.c_str() + pos_;
-    char *endptr;
-    double val = strtod(ptr, &endptr);
-    int diff = endptr - ptr;
-    for (int i = 0; i < diff; i++) {
-        next_ch();
+    const char *first = input() + pos_;
+    double val = 0;
+    const char *last = parse_number(first, input() + input_size_, &val);
+    if (last == first) {
+        fail("invalid number", pos_);
     }
+    advance(last - first);
     return val;
 }
 
 //
 //
 inline std::string scanner::utf8_unescape() {
-    bool failed;
+    bool failed = false;
 
     char32_t uch = try_read_hex(&failed);
     char32_t uch2 = 0;
@@ -508,7 +770,7 @@ inline std::string scanner::utf8_unescape() {
             goto invalid;
         }
         // check to make sure that the second half follows the first half
-        if (ch() != '\\' || pos_ == input_.size() - 1 || input_[pos_+1] != 'u') {
+        if (ch() != '\\' || pos_ == input_size_ - 1 || input()[pos_+1] != 'u') {
             goto invalid;
         }
         next_ch(); next_ch(); // skip the \u
@@ -532,7 +794,9 @@ inline std::string scanner::utf8_unescape() {
 
 invalid:
     if (params_.flags & utf8_exceptions_flag) {
-        throw utf8_error("invalid unicode escape character", line_, col_);
+        int line, col;
+        location(pos_, &line, &col);
+        throw utf8_error("invalid unicode escape character", line, col);
     } else {
         return u8"\ufffd"; // return a replacement character
     }
@@ -564,9 +828,129 @@ inline char32_t scanner::try_read_hex(bool *failed) {
 }
 
 
+//
+// True if scanning stopped at a token that may continue past the end of partial input
+inline bool scanner::starved() const {
+    return starved_;
+}
+
+//
+// The length of the input scanned so far. Once the scanner is starved, everything from
+// here on has to be scanned again along with the rest of the input.
+inline unsigned int scanner::scanned_length() const {
+    return pos_;
+}
+
+//
+// Sets the line and column of the first byte of the input, for when it is a piece of
+// a larger document. Call it before scan(), which may already report errors.
+inline void scanner::set_origin(int line, int col) {
+    origin_line_ = line;
+    origin_col_ = col;
+}
+
+//
+// The line and column of byte pos of the text, counting from 1
+inline void text_location(const char *text, size_t pos, int *line, int *col) {
+    const char *last = text + pos;
+    const char *line_start = text;
+    *line = 1;
+    while (const void *newline = std::memchr(line_start, '\n', last - line_start)) {
+        line_start = (const char *)newline + 1;
+        (*line)++;
+    }
+    *col = (int)(last - line_start) + 1;
+}
+
+//
+// The end of the {...} or [...] value that starts at first, found by matching up the
+// brackets without parsing what is between them. String literals and comments are
+// skipped, since they may contain brackets. Returns nullptr if the brackets don't match.
+//
+// Without empty_groups it also gives up on a value with an empty group anywhere in it.
+// The .config read_group() leaves the closing brace of an empty group to the enclosing
+// group, so there the brackets wouldn't say where the value ends.
+inline const char *skip_brackets(const char *first, const char *last, bool empty_groups) {
+    const scan_kernels& kernels = active_scan_kernels();
+    std::string closers;
+    bool group_opened = false;
+    const char *p = first;
+    while (p != last) {
+        if ((signed char)*p <= 0x20) {
+            p++;
+            continue;
+        }
+        bool opens_group = *p == '{';
+        switch (*p) {
+        case '{':
+            closers += '}';
+            p++;
+            break;
+        case '[':
+            closers += ']';
+            p++;
+            break;
+        case '}':
+        case ']':
+            if (closers.empty() || closers.back() != *p || (*p == '}' && group_opened && !empty_groups)) {
+                return nullptr;
+            }
+            closers.erase(closers.size() - 1);
+            p++;
+            if (closers.empty()) {
+                return p;
+            }
+            break;
+        case '"':
+            p++;
+            while (true) {
+                p = kernels.find_string_special(p, last);
+                if (p == last || *p == '\r' || *p == '\n') {
+                    return nullptr;
+                }
+                if (*p == '"') {
+                    p++;
+                    break;
+                }
+                if (last - p < 2) {
+                    return nullptr;
+                }
+                p += 2;
+            }
+            break;
+        case '/':
+            if (last - p > 1 && p[1] == '/') {
+                const void *newline = std::memchr(p, '\n', last - p);
+                p = newline ? (const char *)newline : last;
+                continue;
+            }
+            p++;
+            break;
+        default:
+            p++;
+            break;
+        }
+        group_opened = opens_group;
+    }
+    return nullptr;
+}
+
+//
+// Line and column are not tracked while scanning; they are worked out from the byte
+// offset by counting newlines only when an error is actually reported
+inline void scanner::location(unsigned int pos, int *line, int *col) const {
+    text_location(input(), std::min<size_t>(pos, input_size_), line, col);
+    if (*line == 1) {
+        *col += origin_col_ - 1;
+    }
+    *line += origin_line_ - 1;
+}
+
 //
 //
-inline void scanner::fail(const std::string& message, int line, int col) const {
+inline void scanner::fail(const std::string& message, unsigned int pos) const {
+    int line, col;
+    location(pos, &line, &col);
     throw parse_error(message, line, col);
 }
 
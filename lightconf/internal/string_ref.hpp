@@ -0,0 +1,46 @@
+#ifndef _LIGHTCONF_STRING_REF_H_
+#define _LIGHTCONF_STRING_REF_H_
+
+#include <cstring>
+#include <string>
+
+namespace lightconf {
+////////////////////
+
+//
+// A non-owning view of a range of characters, used to hand slices of the scanner's
+// input around without copying them into a std::string
+class string_ref {
+public:
+    const char *        data() const                        { return data_; }
+    size_t              size() const                        { return size_; }
+    bool                empty() const                       { return size_ == 0; }
+    const char *        begin() const                       { return data_; }
+    const char *        end() const                         { return data_ + size_; }
+    char                operator[](size_t pos) const        { return data_[pos]; }
+
+    std::string         str() const                         { return std::string(data_, size_); }
+
+    bool                operator==(const string_ref& rhs) const;
+    bool                operator!=(const string_ref& rhs) const { return !(*this == rhs); }
+
+    string_ref() : data_(""), size_(0) { }
+    string_ref(const char *data, size_t size) : data_(data), size_(size) { }
+    string_ref(const char *str) : data_(str), size_(std::strlen(str)) { }
+    string_ref(const std::string& str) : data_(str.data()), size_(str.size()) { }
+
+private:
+    const char *        data_;
+    size_t              size_;
+};
+
+//
+//
+inline bool string_ref::operator==(const string_ref& rhs) const {
+    return size_ == rhs.size_ && std::memcmp(data_, rhs.data_, size_) == 0;
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_STRING_REF_H_
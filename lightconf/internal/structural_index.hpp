@@ -0,0 +1,234 @@
+#ifndef _LIGHTCONF_STRUCTURAL_INDEX_H_
+#define _LIGHTCONF_STRUCTURAL_INDEX_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "scan_kernels.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// Stage one of the JSON reader. A single pass over the input, 64 bytes at a time, that
+// records the offset of every byte where a token starts: the brackets, ':' and ',' that
+// are outside string literals, the opening quote of each string literal, and the first
+// byte of each run of other non-whitespace bytes (numbers and identifiers). Most of the
+// work is done on bitmasks from the classify_block kernel, so the bytes in between are
+// never looked at one by one.
+//
+// Inputs containing a '/' outside a string literal (comments, mostly) can't be indexed
+// this way; build() returns false for those, and for inputs of 4GB or more.
+//
+// With validate_utf8 set, the same pass also checks that the input is well-formed UTF-8.
+// Blocks of plain ASCII cost nothing extra.
+class structural_index {
+public:
+    static const size_t npos = (size_t)-1;
+
+    bool                build(const char *input, size_t size, bool validate_utf8 = false);
+
+    const uint32_t *    begin() const           { return positions_.get(); }
+    const uint32_t *    end() const             { return positions_.get() + count_; }
+    size_t              size() const            { return count_; }
+    size_t              utf8_error() const      { return utf8_error_; }
+
+    structural_index();
+
+private:
+    structural_index(const structural_index&);
+    structural_index&   operator=(const structural_index&);
+
+    void                reserve(size_t count);
+
+    std::unique_ptr<uint32_t[]> positions_;
+    size_t              count_;
+    size_t              capacity_;
+    size_t              utf8_error_;
+};
+
+//
+//
+inline int trailing_zeroes(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+//
+// The length of the well-formed UTF-8 sequence at first, or 0 if there isn't one
+inline size_t utf8_sequence_length(const unsigned char *first, const unsigned char *last) {
+    unsigned char c = first[0];
+    if (c < 0x80) {
+        return 1;
+    }
+
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xbf;     // allowed range of the second byte
+    if (c >= 0xc2 && c <= 0xdf) {
+        len = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        len = 3;
+        if (c == 0xe0) lo = 0xa0;           // overlong
+        if (c == 0xed) hi = 0x9f;           // surrogates
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        len = 4;
+        if (c == 0xf0) lo = 0x90;           // overlong
+        if (c == 0xf4) hi = 0x8f;           // above U+10FFFF
+    } else {
+        return 0;
+    }
+
+    if ((size_t)(last - first) < len || first[1] < lo || first[1] > hi) {
+        return 0;
+    }
+    for (size_t i = 2; i < len; i++) {
+        if (first[i] < 0x80 || first[i] > 0xbf) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+//
+//
+inline structural_index::structural_index() :
+    positions_(),
+    count_(0),
+    capacity_(0),
+    utf8_error_(npos)
+{ }
+
+//
+//
+inline void structural_index::reserve(size_t count) {
+    if (count <= capacity_) {
+        return;
+    }
+    size_t capacity = capacity_ ? capacity_ : 1024;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    std::unique_ptr<uint32_t[]> positions(new uint32_t[capacity]);
+    if (count_) {
+        std::memcpy(positions.get(), positions_.get(), count_ * sizeof(uint32_t));
+    }
+    positions_.swap(positions);
+    capacity_ = capacity;
+}
+
+//
+// The state carried from one block to the next is whether the block ended inside a
+// string literal, with a backslash still to apply, or partway through a run.
+inline bool structural_index::build(const char *input, size_t size, bool validate_utf8) {
+    count_ = 0;
+    utf8_error_ = npos;
+    if (size >= 0xffffffffu) {
+        return false;
+    }
+
+    const scan_kernels& kernels = active_scan_kernels();
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input);
+    bool indexing = true;
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;
+    uint64_t prev_scalar = 0;
+    size_t utf8_checked = 0;
+    char tail[64];
+
+    for (size_t offset = 0; offset < size; offset += 64) {
+        const char *block = input + offset;
+        if (size - offset < 64) {
+            // pad the last block with whitespace, which never starts anything
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, block, size - offset);
+            block = tail;
+        }
+        block_masks masks;
+        kernels.classify_block(block, &masks);
+
+        if (validate_utf8 && masks.high && utf8_error_ == npos && offset + 64 > utf8_checked) {
+            size_t pos = utf8_checked > offset ? utf8_checked : offset;
+            size_t stop = offset + 64 < size ? offset + 64 : size;
+            while (pos < stop) {
+                size_t len = utf8_sequence_length(bytes + pos, bytes + size);
+                if (len == 0) {
+                    utf8_error_ = pos;
+                    break;
+                }
+                pos += len;
+            }
+            utf8_checked = pos;
+        }
+        if (!indexing) {
+            continue;
+        }
+
+        // Work out which bytes are escaped. Backslashes are rare, so they are walked
+        // one escape sequence at a time; a backslash that is itself escaped escapes
+        // nothing.
+        uint64_t backslash = masks.backslash & ~prev_escaped;
+        uint64_t escaped = prev_escaped;
+        prev_escaped = 0;
+        while (backslash) {
+            int i = trailing_zeroes(backslash);
+            if (i == 63) {
+                prev_escaped = 1;
+                break;
+            }
+            escaped |= 2ULL << i;
+            backslash &= ~(3ULL << i);
+        }
+
+        // A running XOR of the unescaped quotes sets every bit from an opening quote up
+        // to (not including) its closing quote
+        uint64_t quote = masks.quote & ~escaped;
+        uint64_t in_string = quote;
+        in_string ^= in_string << 1;
+        in_string ^= in_string << 2;
+        in_string ^= in_string << 4;
+        in_string ^= in_string << 8;
+        in_string ^= in_string << 16;
+        in_string ^= in_string << 32;
+        in_string ^= prev_in_string;
+        prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+        uint64_t outside = ~(in_string | quote);
+        if (masks.slash & outside) {
+            indexing = false;
+            if (!validate_utf8) {
+                break;
+            }
+            continue;
+        }
+        uint64_t scalar = outside & ~masks.whitespace & ~masks.op;
+        uint64_t structurals = (masks.op & outside) | (quote & in_string)
+            | (scalar & ~((scalar << 1) | prev_scalar));
+        prev_scalar = scalar >> 63;
+
+        reserve(count_ + 64);
+        uint32_t *out = positions_.get() + count_;
+        while (structurals) {
+            *out++ = (uint32_t)(offset + trailing_zeroes(structurals));
+            structurals &= structurals - 1;
+        }
+        count_ = out - positions_.get();
+    }
+
+    if (!indexing) {
+        count_ = 0;
+    }
+    return indexing;
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_STRUCTURAL_INDEX_H_
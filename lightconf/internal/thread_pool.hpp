@@ -0,0 +1,84 @@
+#ifndef _LIGHTCONF_THREAD_POOL_H_
+#define _LIGHTCONF_THREAD_POOL_H_
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lightconf {
+////////////////////
+
+//
+// A bounded number of threads for running batches of independent jobs. run() hands the
+// jobs 0 to count - 1 out to the threads, the calling thread among them, and returns
+// once all of them have finished. If any job throws, the first exception is rethrown
+// from run() after the rest of the batch is done.
+//
+// The threads only live for the length of a batch, so a pool costs nothing while idle.
+// Batches are meant to be a handful of big jobs per thread.
+class thread_pool {
+public:
+    void                run(size_t count, const std::function<void (size_t)>& job);
+    unsigned int        size() const        { return threads_; }
+
+    explicit thread_pool(unsigned int threads = 0);
+
+private:
+    thread_pool(const thread_pool&);
+    thread_pool&        operator=(const thread_pool&);
+
+    unsigned int        threads_;
+};
+
+//
+// With threads 0, one thread per hardware thread
+inline thread_pool::thread_pool(unsigned int threads) :
+    threads_(threads ? threads : std::thread::hardware_concurrency())
+{
+    if (threads_ == 0) {
+        threads_ = 1;
+    }
+}
+
+//
+//
+inline void thread_pool::run(size_t count, const std::function<void (size_t)>& job) {
+    std::atomic<size_t> next(0);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto work = [&] {
+        size_t index;
+        while ((index = next++) < count) {
+            try {
+                job(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads_ && i < count; i++) {
+        workers.push_back(std::thread(work));
+    }
+    work();
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_THREAD_POOL_H_
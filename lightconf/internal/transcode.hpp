@@ -0,0 +1,86 @@
+#ifndef _LIGHTCONF_TRANSCODE_H_
+#define _LIGHTCONF_TRANSCODE_H_
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include "config_format.hpp"
+#include "json_format.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// Converting a document between .config and JSON without reading it into a group. The
+// parser for one format reports the document to the other format's event_writer,
+// which writes it out as it goes, so memory use doesn't grow with the size of the
+// document when it comes from a stream.
+//
+//     std::ifstream in("users.config");
+//     std::ofstream out("users.json");
+//     config_to_json(in, out);
+//
+// The output is what write() gives for the group that read() builds, as long as no key
+// appears twice in a group (and, from JSON, every key is a .config identifier; any
+// other key is a value_error). A document with a parse_error in it leaves whatever
+// came before the error in out.
+
+void                    config_to_json(const std::string& src, std::ostream& out);
+void                    config_to_json(std::istream& in, std::ostream& out);
+void                    config_file_to_json(const std::string& filename, std::ostream& out);
+void                    json_to_config(const std::string& src, std::ostream& out, int wrap_length = 120);
+void                    json_to_config(std::istream& in, std::ostream& out, int wrap_length = 120);
+void                    json_file_to_config(const std::string& filename, std::ostream& out, int wrap_length = 120);
+
+//
+//
+inline void config_to_json(const std::string& src, std::ostream& out) {
+    json_format::event_writer wr(out);
+    config_format::parse(src, wr);
+    wr.flush();
+}
+
+//
+// The stream is read a chunk at a time
+inline void config_to_json(std::istream& in, std::ostream& out) {
+    json_format::event_writer wr(out);
+    config_format::parse(in, wr);
+    wr.flush();
+}
+
+//
+//
+inline void config_file_to_json(const std::string& filename, std::ostream& out) {
+    json_format::event_writer wr(out);
+    config_format::parse_file(filename, wr);
+    wr.flush();
+}
+
+//
+//
+inline void json_to_config(const std::string& src, std::ostream& out, int wrap_length) {
+    config_format::event_writer wr(out, wrap_length);
+    json_format::parse(src, wr);
+    wr.flush();
+}
+
+//
+// The stream is read a chunk at a time
+inline void json_to_config(std::istream& in, std::ostream& out, int wrap_length) {
+    config_format::event_writer wr(out, wrap_length);
+    json_format::parse(in, wr);
+    wr.flush();
+}
+
+//
+//
+inline void json_file_to_config(const std::string& filename, std::ostream& out, int wrap_length) {
+    config_format::event_writer wr(out, wrap_length);
+    json_format::parse_file(filename, wr);
+    wr.flush();
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_TRANSCODE_H_
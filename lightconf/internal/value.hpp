@@ -10,6 +10,8 @@ namespace lightconf {
 ////////////////////
 
 template <typename T> struct value_type_info;
+struct lazy_span;
+struct lazy_value;
 
 template <typename T>
 using return_type = decltype(value_type_info<T>::extract_value(std::declval<value>()));
@@ -28,7 +30,14 @@ enum class value_type {
 };
 
 //
+// One of the value_types, held in 16 bytes. Numbers and bools are stored in the value
+// itself; strings, vectors and groups are allocated separately and owned by it, so a
+// vector of numbers is no bigger than it needs to be. A value that is moved from is
+// left invalid.
 //
+// The string, vector or group of a value can instead be made in an arena, along with
+// everything under it, in which case it is left for the arena to free. Copying such a
+// value gives one with a copy on the heap.
 class value {
 public:
     template <typename T>
@@ -40,13 +49,15 @@ public:
     value_type          type() const { return type_; }
 
     value&              operator=(const value& rhs);
+    value&              operator=(value&& rhs) noexcept;
+    void                swap(value& rhs);
     bool                operator==(const value& rhs) const;
 
-    double              number_value() const { return number_value_; }
-    const std::string&  string_value() const { return string_value_; }
-    bool                bool_value() const   { return bool_value_; }
-    const value_vector_type& vector_value() const { return vector_value_; }
-    const group&        group_value() const  { return group_value_; }
+    double              number_value() const { return type_ == value_type::number_type ? data_.number : 0; }
+    const std::string&  string_value() const;
+    bool                bool_value() const   { return type_ == value_type::bool_type && data_.boolean; }
+    const value_vector_type& vector_value() const;
+    const group&        group_value() const;
 
     value();
     explicit value(double dbl);
@@ -54,14 +65,35 @@ public:
     explicit value(bool bl);
     explicit value(const value_vector_type& lst);
     explicit value(const group& grp);
+    explicit value(std::string&& str);
+    explicit value(value_vector_type&& lst);
+    explicit value(group&& grp);
+    explicit value(const lazy_span& span);
+    value(std::string&& str, arena& mem);
+    value(value_vector_type&& lst, arena& mem);
+    value(group&& grp, arena& mem);
+    value(value&& val, arena& mem);
     value(const value& val);
+    value(value&& val) noexcept;
+    ~value();
 private:
+    friend class group;
+
+    bool                on_heap() const;
+
+    union storage {
+        double          number;
+        bool            boolean;
+        std::string *   string;
+        value_vector_type *vector;
+        group *         grp;
+        lazy_value *    lazy;               // for a group or vector that hasn't been parsed
+    };
+
     value_type          type_;
-    double              number_value_;
-    std::string         string_value_;
-    bool                bool_value_;
-    value_vector_type   vector_value_;
-    group               group_value_;
+    bool                lazy_;              // whether data_ holds a lazy_value
+    bool                arena_;             // whether data_ points into an arena
+    storage             data_;
 };
 
 ////////////////////
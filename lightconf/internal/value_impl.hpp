@@ -1,6 +1,8 @@
 #ifndef _LIGHTCONF_VALUE_IMPL_H_
 #define _LIGHTCONF_VALUE_IMPL_H_
 
+#include <utility>
+#include "lazy_value.hpp"
 #include "value.hpp"
 
 namespace lightconf {
@@ -8,53 +10,219 @@ namespace lightconf {
 
 //
 //
-inline value::value()                           : type_(value_type::invalid_type) { }
-inline value::value(double dbl)                 : type_(value_type::number_type), number_value_(dbl) { }
-inline value::value(const std::string& str)     : type_(value_type::string_type), string_value_(str) { }
-inline value::value(bool bl)                    : type_(value_type::bool_type), bool_value_(bl) { }
-inline value::value(const value_vector_type& lst) : type_(value_type::vector_type), vector_value_(lst) { }
-inline value::value(const group& grp)           : type_(value_type::group_type), group_value_(grp) { }
+inline value::value()                           : type_(value_type::invalid_type), lazy_(false), arena_(false) { data_.number = 0; }
+inline value::value(double dbl)                 : type_(value_type::number_type), lazy_(false), arena_(false) { data_.number = dbl; }
+inline value::value(const std::string& str)     : type_(value_type::string_type), lazy_(false), arena_(false) { data_.string = new std::string(str); }
+inline value::value(bool bl)                    : type_(value_type::bool_type), lazy_(false), arena_(false) { data_.boolean = bl; }
+inline value::value(const value_vector_type& lst) : type_(value_type::vector_type), lazy_(false), arena_(false) { data_.vector = new value_vector_type(lst); }
+inline value::value(const group& grp)           : type_(value_type::group_type), lazy_(false), arena_(false) { data_.grp = new group(grp); }
 
 //
+// The string, vector or group is moved into the value rather than copied
+inline value::value(std::string&& str)          : type_(value_type::string_type), lazy_(false), arena_(false) { data_.string = new std::string(std::move(str)); }
+inline value::value(value_vector_type&& lst)    : type_(value_type::vector_type), lazy_(false), arena_(false) { data_.vector = new value_vector_type(std::move(lst)); }
+inline value::value(group&& grp)                : type_(value_type::group_type), lazy_(false), arena_(false) { data_.grp = new group(std::move(grp)); }
+
 //
+// A group or vector whose text is only parsed once something looks at it
+inline value::value(const lazy_span& span) :
+    type_(span.doc->text[span.first] == '{' ? value_type::group_type : value_type::vector_type),
+    lazy_(true),
+    arena_(false)
+{
+    data_.lazy = new lazy_value(span);
+}
+
+//
+// Once a lazy value has been parsed it is copied like any other; before that, the copy
+// gets a lazy_value of its own for the same text
 inline value::value(const value& val) :
     type_(val.type_),
-    number_value_(val.number_value_),
-    string_value_(val.string_value_),
-    bool_value_(val.bool_value_),
-    vector_value_(val.vector_value_),
-    group_value_(val.group_value_)
-{ }
+    lazy_(false),
+    arena_(false)
+{
+    switch (type_) {
+    case value_type::string_type:
+        data_.string = new std::string(*val.data_.string);
+        break;
+    case value_type::vector_type:
+    case value_type::group_type:
+        if (val.lazy_ && !val.data_.lazy->done.load(std::memory_order_acquire)) {
+            data_.lazy = new lazy_value(val.data_.lazy->span);
+            lazy_ = true;
+        } else if (type_ == value_type::vector_type) {
+            data_.vector = new value_vector_type(val.vector_value());
+        } else {
+            data_.grp = new group(val.group_value());
+        }
+        break;
+    default:
+        data_ = val.data_;
+        break;
+    }
+}
+
+//
+// Takes over what val owns, leaving it invalid
+inline value::value(value&& val) noexcept :
+    type_(val.type_),
+    lazy_(val.lazy_),
+    arena_(val.arena_),
+    data_(val.data_)
+{
+    val.type_ = value_type::invalid_type;
+    val.lazy_ = false;
+    val.arena_ = false;
+}
+
+//
+// The string, vector or group is moved into mem. A string short enough to keep its
+// characters inside itself, which most keys and many values are, needs nothing more
+// from the heap; a vector's elements are moved into mem in turn.
+inline value::value(std::string&& str, arena& mem) : type_(value_type::string_type), lazy_(false), arena_(true) {
+    data_.string = mem.make<std::string>(std::move(str));
+    own_string(mem, data_.string);
+}
 
 //
 //
+inline value::value(value_vector_type&& lst, arena& mem) : type_(value_type::vector_type), lazy_(false), arena_(true) {
+    data_.vector = mem.make<value_vector_type>(std::move(lst));
+    mem.own(data_.vector);
+    for (value& val : *data_.vector) {
+        if (val.on_heap()) {
+            val = value(std::move(val), mem);
+        }
+    }
+}
+
+//
+//
+inline value::value(group&& grp, arena& mem) : type_(value_type::group_type), lazy_(false), arena_(true) {
+    data_.grp = mem.make<group>(std::move(grp), mem);
+}
+
+//
+// Moves what val holds on the heap into mem. A lazy value is parsed first.
+inline value::value(value&& val, arena& mem) : value() {
+    if (!val.on_heap()) {
+        value moved(std::move(val));
+        swap(moved);
+    } else if (val.type_ == value_type::string_type) {
+        value moved(std::move(*val.data_.string), mem);
+        swap(moved);
+    } else if (val.type_ == value_type::vector_type) {
+        value moved(val.lazy_ ? value_vector_type(val.vector_value()) : std::move(*val.data_.vector), mem);
+        swap(moved);
+    } else {
+        value moved(val.lazy_ ? group(val.group_value()) : std::move(*val.data_.grp), mem);
+        swap(moved);
+    }
+}
+
+//
+//
+inline value::~value() {
+    if (arena_) {
+        return;
+    }
+    if (lazy_) {
+        delete data_.lazy;
+        return;
+    }
+    switch (type_) {
+    case value_type::string_type:
+        delete data_.string;
+        break;
+    case value_type::vector_type:
+        delete data_.vector;
+        break;
+    case value_type::group_type:
+        delete data_.grp;
+        break;
+    default:
+        break;
+    }
+}
+
+//
+// Copied before anything is replaced, since rhs may be part of this value
 inline value& value::operator=(const value& rhs) {
     if (&rhs != this) {
-        number_value_ = rhs.number_value_;
-        string_value_ = rhs.string_value_;
-        bool_value_ = rhs.bool_value_;
-        vector_value_ = rhs.vector_value_;
-        group_value_ = rhs.group_value_;
-        type_ = rhs.type_;
+        value val(rhs);
+        swap(val);
     }
     return *this;
 }
 
+//
+// What this value owned is freed once rhs is left with it, so rhs may be part of it
+inline value& value::operator=(value&& rhs) noexcept {
+    if (&rhs != this) {
+        value val(std::move(rhs));
+        swap(val);
+    }
+    return *this;
+}
+
+//
+// Exchanges the contents of two values without copying them
+inline void value::swap(value& rhs) {
+    std::swap(type_, rhs.type_);
+    std::swap(lazy_, rhs.lazy_);
+    std::swap(arena_, rhs.arena_);
+    std::swap(data_, rhs.data_);
+}
+
+//
+// Whether the value owns a string, vector or group on the heap
+inline bool value::on_heap() const {
+    return !arena_ && (type_ == value_type::string_type || type_ == value_type::vector_type ||
+        type_ == value_type::group_type);
+}
+
+//
+// The accessors for the heavier types give an empty one for a value of another type
+inline const std::string& value::string_value() const {
+    static const std::string empty;
+    return type_ == value_type::string_type ? *data_.string : empty;
+}
+
+//
+//
+inline const value_vector_type& value::vector_value() const {
+    static const value_vector_type empty;
+    if (type_ != value_type::vector_type) {
+        return empty;
+    }
+    return lazy_ ? data_.lazy->get().vector_value() : *data_.vector;
+}
+
+//
+//
+inline const group& value::group_value() const {
+    static const group empty;
+    if (type_ != value_type::group_type) {
+        return empty;
+    }
+    return lazy_ ? data_.lazy->get().group_value() : *data_.grp;
+}
+
 //
 //
 inline bool value::operator==(const value& rhs) const {
     if (rhs.type_ != type_) return false;
     switch (type_) {
     case value_type::number_type:
-        return rhs.number_value_ == number_value_;
+        return rhs.data_.number == data_.number;
     case value_type::string_type:
-        return rhs.string_value_ == string_value_;
+        return *rhs.data_.string == *data_.string;
     case value_type::bool_type:
-        return rhs.bool_value_ == bool_value_;
+        return rhs.data_.boolean == data_.boolean;
     case value_type::vector_type:
-        return rhs.vector_value_ == vector_value_;
+        return rhs.vector_value() == vector_value();
     case value_type::group_type:
-        return rhs.group_value_ == group_value_;
+        return rhs.group_value() == group_value();
     default:
         return false;
     }
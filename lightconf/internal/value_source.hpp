@@ -0,0 +1,277 @@
+#ifndef _LIGHTCONF_VALUE_SOURCE_H_
+#define _LIGHTCONF_VALUE_SOURCE_H_
+
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "exceptions.hpp"
+#include "group.hpp"
+#include "path.hpp"
+#include "value.hpp"
+
+namespace lightconf {
+////////////////////
+
+//
+// A document being read straight into typed values, one token at a time, without
+// building a group for it first. Each format has one over its scanner (see read_as()),
+// and value_type_info<T>::read_value() pulls a T out of it:
+//
+//     static void read_value(value_source& src, T *out);
+//
+// Reading a value of one type where the document has another throws a value_error, as
+// value::get<T>() does; anything that isn't a value at all is a parse_error.
+//
+// A group is read by begin_group() and then next_key() until it returns false, reading
+// or skipping the value after each key; a vector by begin_vector() and next_element().
+class value_source {
+public:
+    virtual value_type  peek_type() = 0;    // invalid_type if what is next isn't a value
+    virtual double      read_number() = 0;
+    virtual void        read_string(std::string *out) = 0;
+    virtual bool        read_bool() = 0;
+    virtual void        read_group(group *out) = 0;
+    virtual void        read_vector(value_vector_type *out) = 0;
+    virtual void        read_value(value *out) = 0;
+    virtual void        skip_value() = 0;
+
+    virtual void        begin_group() = 0;
+    virtual bool        next_key(std::string *key) = 0;
+    virtual void        begin_vector() = 0;
+    virtual bool        next_element() = 0;
+
+    virtual ~value_source() { }
+
+protected:
+    void                expect_type(value_type type);
+};
+
+//
+// What the LIGHTCONF_TYPE_MEMBER_* lines of a LIGHTCONF_BEGIN_TYPE type do when it is
+// read from a value_source (see read_members()). convert() is run over the members
+// once to list their keys, once for each key in the document to read the member it
+// belongs to, and once at the end to fill in the members that weren't there.
+//
+// A key with dots in it, or one that is only part of the way to a member's key, can't
+// be matched to a single member, so its value is read into a group and the members
+// under it are taken from there at the end, as group::get() would find them (so an
+// optional one of the wrong type there takes its default).
+class member_reader {
+public:
+    template <typename T, typename K, typename M>
+    bool                member(const K& key, M& out, bool required);
+
+    void                select(const std::string& key);
+    bool                selected() const    { return selected_ != npos; }
+    void                finish();
+    const std::vector<std::string>& keys() const { return *keys_; }
+
+    member_reader(value_source& src, const std::vector<std::string>& keys);
+    member_reader();
+
+private:
+    enum class mode { describe, read, finish };
+    static const size_t npos = (size_t)-1;
+
+    member_reader(const member_reader&) = delete;
+    member_reader&      operator=(const member_reader&) = delete;
+
+    mode                mode_;
+    value_source *      src_;
+    std::vector<std::string> described_;
+    const std::vector<std::string> *keys_;
+    std::vector<bool>   seen_;
+    size_t              index_;             // of the member convert() is at
+    size_t              selected_;          // the member to read the current key's value into
+    group               extra_;
+};
+
+//
+// T read from src into *out. A value_type_info without a read_value() of its own gets
+// the value read as a value and converted with value::get<T>().
+template <typename T>
+inline auto read_typed(value_source& src, T *out, int) -> decltype(value_type_info<T>::read_value(src, out)) {
+    return value_type_info<T>::read_value(src, out);
+}
+
+//
+//
+template <typename T>
+inline void read_typed(value_source& src, T *out, long) {
+    value val;
+    src.read_value(&val);
+    *out = val.get<T>();
+}
+
+//
+//
+template <typename T>
+inline void read_typed(value_source& src, T *out) {
+    read_typed(src, out, 0);
+}
+
+//
+// A member declared as T but stored as some other type that T converts to
+template <typename T, typename M>
+inline void read_member_value(value_source& src, M& out, std::false_type) {
+    T val;
+    read_typed(src, &val);
+    out = std::move(val);
+}
+
+//
+//
+template <typename T, typename M>
+inline void read_member_value(value_source& src, M& out, std::true_type) {
+    read_typed(src, &out);
+}
+
+//
+// The keys of a LIGHTCONF_BEGIN_TYPE type's members, in the order they are declared.
+// They are worked out once for each type, so they need to be the same every time.
+template <typename T>
+inline const std::vector<std::string>& member_keys() {
+    static const std::vector<std::string> keys = [] {
+        T dummy;
+        member_reader rd;
+        value_type_info<T>::convert(nullptr, nullptr, nullptr, &dummy, &rd);
+        return rd.keys();
+    }();
+    return keys;
+}
+
+//
+// Reads a group from src into the members of a LIGHTCONF_BEGIN_TYPE type. The entries
+// that aren't members are skipped over without being built, or checked for errors
+// inside their groups and vectors. A required member that isn't there is a value_error.
+template <typename T>
+inline void read_members(value_source& src, T *out) {
+    member_reader rd(src, member_keys<T>());
+    std::string key;
+    src.begin_group();
+    while (src.next_key(&key)) {
+        rd.select(key);
+        if (rd.selected()) {
+            value_type_info<T>::convert(nullptr, nullptr, nullptr, out, &rd);
+        }
+    }
+    rd.finish();
+    value_type_info<T>::convert(nullptr, nullptr, nullptr, out, &rd);
+}
+
+//
+// Reads what is next if it is a value of another type, so that a document with an
+// error in it fails with the parse_error rather than a value_error
+inline void value_source::expect_type(value_type type) {
+    value_type next = peek_type();
+    if (next == type) {
+        return;
+    }
+    if (next == value_type::invalid_type) {
+        value val;
+        read_value(&val);
+    }
+    throw value_error("incompatible type requested");
+}
+
+//
+// For listing the members' keys
+inline member_reader::member_reader() :
+    mode_(mode::describe),
+    src_(nullptr),
+    described_(),
+    keys_(&described_),
+    seen_(),
+    index_(0),
+    selected_(npos),
+    extra_()
+{ }
+
+//
+//
+inline member_reader::member_reader(value_source& src, const std::vector<std::string>& keys) :
+    mode_(mode::read),
+    src_(&src),
+    described_(),
+    keys_(&keys),
+    seen_(keys.size()),
+    index_(0),
+    selected_(npos),
+    extra_()
+{ }
+
+//
+// Returns true for an optional member that is to take its default
+template <typename T, typename K, typename M>
+inline bool member_reader::member(const K& key, M& out, bool required) {
+    size_t index = index_++;
+    switch (mode_) {
+    case mode::describe:
+        described_.push_back(path(key).fullpath());
+        return false;
+    case mode::read:
+        if (index == selected_) {
+            read_member_value<T>(*src_, out, std::is_same<T, M>());
+            seen_[index] = true;
+        }
+        return false;
+    case mode::finish:
+        break;
+    }
+
+    const std::string& name = (*keys_)[index];
+    if (seen_[index]) {
+        return false;
+    } else if (extra_.has<T>(name)) {
+        out = extra_.get<T>(name);
+        return false;
+    } else if (required) {
+        throw value_error(extra_.has<value>(name) ? "incompatible type requested" : "missing required member: " + name);
+    }
+    return true;
+}
+
+//
+// Picks the member for the value after key, or reads or skips the value if there isn't
+// just the one
+inline void member_reader::select(const std::string& key) {
+    bool nested = false;
+    selected_ = npos;
+    for (size_t i = 0; i < keys_->size(); i++) {
+        const std::string& name = (*keys_)[i];
+        if (name == key) {
+            selected_ = i;
+        } else if (name.size() > key.size() ? name[key.size()] == '.' && name.compare(0, key.size(), key) == 0
+                : key.size() > name.size() && key[name.size()] == '.' && key.compare(0, name.size(), name) == 0) {
+            nested = true;
+            seen_[i] = false;
+        }
+    }
+    index_ = 0;
+
+    if (nested) {
+        if (selected_ != npos) {
+            seen_[selected_] = false;
+            selected_ = npos;
+        }
+        value val;
+        src_->read_value(&val);
+        extra_.set(key, std::move(val));
+    } else if (selected_ == npos) {
+        src_->skip_value();
+    }
+}
+
+//
+//
+inline void member_reader::finish() {
+    mode_ = mode::finish;
+    selected_ = npos;
+    index_ = 0;
+}
+
+////////////////////
+}
+
+#endif // _LIGHTCONF_VALUE_SOURCE_H_
@@ -2,36 +2,41 @@
 #define _LIGHTCONF_VALUE_TYPE_INFO_H_
 
 #include <tuple>
+#include <utility>
 #include <vector>
 #include <map>
 #include "value.hpp"
+#include "value_source.hpp"
 
 namespace lightconf {
 ////////////////////
 
 template <typename T> struct value_type_info;
 
-#define DEFINE_VALUE_TYPE(type_name, req_type,  extract, construct) \
+#define DEFINE_VALUE_TYPE(type_name, req_type,  extract, construct, read) \
 template <> struct value_type_info<type_name> { \
     static bool can_convert_from(const value& val) { return val.type() == req_type; } \
     static type_name extract_value(const value& val) { return extract; } \
     static value create_value(const type_name& x) { return construct; } \
+    static void read_value(value_source& src, type_name *out) { read; } \
 };
-#define DEFINE_VALUE_TYPE_REF(type_name, req_type,  extract, construct) \
+#define DEFINE_VALUE_TYPE_REF(type_name, req_type,  extract, construct, read) \
 template <> struct value_type_info<type_name> { \
     static bool can_convert_from(const value& val) { return val.type() == req_type; } \
     static const type_name& extract_value(const value& val) { return extract; } \
     static value create_value(const type_name& x) { return construct; } \
+    static value create_value(type_name&& x) { return value(std::move(x)); } \
+    static void read_value(value_source& src, type_name *out) { read; } \
 };
 
 
-DEFINE_VALUE_TYPE    (double,            value_type::number_type, val.number_value(),   value(x))
-DEFINE_VALUE_TYPE    (int,               value_type::number_type, val.number_value(),   value((double)x))
-DEFINE_VALUE_TYPE    (float,             value_type::number_type, val.number_value(),   value((double)x))
-DEFINE_VALUE_TYPE    (bool,              value_type::bool_type,   val.bool_value(),     value(x))
-DEFINE_VALUE_TYPE_REF(std::string,       value_type::string_type, val.string_value(),   value(x))
-DEFINE_VALUE_TYPE_REF(value_vector_type, value_type::vector_type, val.vector_value(),   value(x))
-DEFINE_VALUE_TYPE_REF(group,             value_type::group_type,  val.group_value(),    value(x))
+DEFINE_VALUE_TYPE    (double,            value_type::number_type, val.number_value(),   value(x),           *out = src.read_number())
+DEFINE_VALUE_TYPE    (int,               value_type::number_type, val.number_value(),   value((double)x),   *out = src.read_number())
+DEFINE_VALUE_TYPE    (float,             value_type::number_type, val.number_value(),   value((double)x),   *out = src.read_number())
+DEFINE_VALUE_TYPE    (bool,              value_type::bool_type,   val.bool_value(),     value(x),           *out = src.read_bool())
+DEFINE_VALUE_TYPE_REF(std::string,       value_type::string_type, val.string_value(),   value(x),           src.read_string(out))
+DEFINE_VALUE_TYPE_REF(value_vector_type, value_type::vector_type, val.vector_value(),   value(x),           src.read_vector(out))
+DEFINE_VALUE_TYPE_REF(group,             value_type::group_type,  val.group_value(),    value(x),           src.read_group(out))
 
 #undef DEFINE_VALUE_TYPE
 #undef DEFINE_VALUE_TYPE_REF
@@ -53,6 +58,12 @@ template <> struct value_type_info<enumname> { \
         if (it != std::end(names)) { return value(it->second); } \
         return value(std::begin(names)->second); \
     } \
+    static void read_value(value_source& src, enumname *out) { \
+        std::string str; \
+        src.read_string(&str); \
+        for (auto kv : names) { if (kv.second == str) { *out = kv.first; return; } } \
+        throw value_error("incompatible type requested"); \
+    } \
 }; \
 const std::map<enumname, std::string> value_type_info<enumname>::names = {
 #define LIGHTCONF_ENUM_VALUE(value, string) { value, string },
@@ -62,7 +73,8 @@ const std::map<enumname, std::string> value_type_info<enumname>::names = {
 
 #define LIGHTCONF_BEGIN_TYPE(tyname) \
 template <> struct value_type_info<tyname> { \
-    static bool convert(const value *inval, const tyname *inty, group *outgrp, tyname *outty); \
+    static bool convert(const value *inval, const tyname *inty, group *outgrp, tyname *outty, \
+        member_reader *rd = nullptr); \
     static bool can_convert_from(const value& val) { \
         return convert(&val, nullptr, nullptr, nullptr); \
     } \
@@ -76,8 +88,12 @@ template <> struct value_type_info<tyname> { \
         convert(nullptr, &x, &out, nullptr); \
         return value(out); \
     } \
+    static void read_value(value_source& src, tyname *out) { \
+        read_members(src, out); \
+    } \
 }; \
-bool value_type_info<tyname>::convert(const value *inval, const tyname *inty, group *outgrp, tyname *outty) { \
+bool value_type_info<tyname>::convert(const value *inval, const tyname *inty, group *outgrp, tyname *outty, \
+        member_reader *rd) { \
     const group *grp = nullptr; \
     if (inval) grp = &inval->group_value();
 
@@ -85,11 +101,13 @@ bool value_type_info<tyname>::convert(const value *inval, const tyname *inty, gr
 #define LIGHTCONF_TYPE_MEMBER_REQ(type, name, key) \
     if (grp && !grp->has<type>(key)) return false; \
     if (grp && outty) outty->name = grp->get<type>(key); \
-    if (outgrp && inty) outgrp->set<type>(key, inty->name);
+    if (outgrp && inty) outgrp->set<type>(key, inty->name); \
+    if (rd) rd->member<type>(key, outty->name, true);
 
 #define LIGHTCONF_TYPE_MEMBER_OPT(type, name, key, def) \
     if (grp && outty) outty->name = grp->get<type>(key, def); \
-    if (outgrp && inty) outgrp->set<type>(key, inty->name);
+    if (outgrp && inty) outgrp->set<type>(key, inty->name); \
+    if (rd && rd->member<type>(key, outty->name, false)) outty->name = def;
 
 #define LIGHTCONF_END_TYPE() \
     return true; \
@@ -104,6 +122,8 @@ struct value_type_info<value> {
     static bool can_convert_from(const value& val) { return true; }
     static const value& extract_value(const value& val) { return val; }
     static value create_value(const value& val) { return val; }
+    static value create_value(value&& val) { return std::move(val); }
+    static void read_value(value_source& src, value *out) { src.read_value(out); }
 };
 
 //
@@ -135,6 +155,14 @@ struct value_type_info<std::vector<U>> {
         }
         return value(inner_vals);
     }
+    static void read_value(value_source& src, std::vector<U> *out) {
+        out->clear();
+        src.begin_vector();
+        while (src.next_element()) {
+            out->push_back(U());
+            read_typed(src, &out->back());
+        }
+    }
 };
 
 //
@@ -158,6 +186,14 @@ struct tuple_value_converter<First, Rest...> {
     static bool types_match(const value_vector_type& vec, int i) {
         return vec[i].is<First>() && tuple_value_converter<Rest...>::types_match(vec, i+1);
     }
+    template <int idx, typename... Args>
+    static void read(value_source& src, std::tuple<Args...>& tup) {
+        if (!src.next_element()) {
+            throw value_error("incompatible type requested");
+        }
+        read_typed(src, &std::get<idx>(tup));
+        tuple_value_converter<Rest...>::template read<idx+1>(src, tup);
+    }
 };
 
 //
@@ -172,6 +208,12 @@ struct tuple_value_converter<> {
     static bool types_match(const value_vector_type& vec, int i) {
         return true;
     }
+    template <int idx, typename... Args>
+    static void read(value_source& src, std::tuple<Args...>& tup) {
+        if (src.next_element()) {
+            throw value_error("incompatible type requested");
+        }
+    }
 };
 
 //
@@ -194,6 +236,10 @@ struct value_type_info<std::tuple<T...>> {
         tuple_value_converter<T...>::template append<0>(vec, x);
         return value(vec);
     }
+    static void read_value(value_source& src, std::tuple<T...> *out) {
+        src.begin_vector();
+        tuple_value_converter<T...>::template read<0>(src, *out);
+    }
 };
 
 
@@ -0,0 +1,6 @@
+#ifndef _LIGHTCONF_OUTER_TRANSCODE_H_
+#define _LIGHTCONF_OUTER_TRANSCODE_H_
+
+#include "internal/transcode.hpp"
+
+#endif // _LIGHTCONF_OUTER_TRANSCODE_H_
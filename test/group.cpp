@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -152,3 +153,101 @@ TEST_F(GroupTest, IteratorTest) {
     EXPECT_EQ("abcdefghi", s);
     EXPECT_EQ(5+10+15, d);
 }
+
+TEST_F(GroupTest, CompactValues) {
+    EXPECT_LE(sizeof(lightconf::value), 16u);
+
+    lightconf::value str(std::string("hello"));
+    lightconf::value num(2.5);
+    lightconf::value copy(str);
+    copy.swap(num);
+    EXPECT_EQ(2.5, copy.number_value());
+    EXPECT_EQ("hello", num.string_value());
+    EXPECT_EQ("hello", str.string_value());
+    num = lightconf::value(grp);
+    EXPECT_EQ(grp, num.group_value());
+    EXPECT_EQ("", num.string_value());
+    EXPECT_TRUE(num.vector_value().empty());
+    EXPECT_EQ(0, num.number_value());
+    EXPECT_FALSE(num.bool_value());
+}
+
+TEST_F(GroupTest, MovesValues) {
+    lightconf::value_vector_type vec(3, lightconf::value(1.0));
+    const lightconf::value *elems = vec.data();
+    grp.set("group1.vecval", std::move(vec));
+    EXPECT_EQ(elems, grp.get<lightconf::value_vector_type>("group1.vecval").data());
+
+    lightconf::value val(grp);
+    lightconf::value moved(std::move(val));
+    EXPECT_EQ(lightconf::value_type::invalid_type, val.type());
+    EXPECT_EQ(grp, moved.group_value());
+    val = std::move(moved);
+    EXPECT_EQ(grp, val.group_value());
+
+    lightconf::group sub = grp.get<lightconf::group>("group1");
+    lightconf::value& set = grp.emplace("group2.subval", std::move(sub));
+    EXPECT_EQ(&set, &grp.get<lightconf::value>("group2.subval"));
+    EXPECT_EQ(grp.get<lightconf::group>("group1"), set.group_value());
+    grp.emplace("group2.subval", grp.get<lightconf::value>("group1.vecval"));
+    EXPECT_EQ(3u, grp.get<lightconf::value_vector_type>("group2.subval").size());
+
+    lightconf::path p("a.b.c");
+    lightconf::path q(std::move(p));
+    EXPECT_EQ("a.b.c", q.fullpath());
+}
+
+TEST_F(GroupTest, ManyKeys) {
+    lightconf::group g;
+    std::vector<std::string> order;
+    for (int i = 0; i < 2000; i++) {
+        order.push_back("host" + std::to_string(i * 7919 % 2000));
+        g.set<int>(order.back(), i);
+    }
+    for (int i = 0; i < 2000; i += 3) {
+        g.unset(order[i]);
+        order[i].clear();
+    }
+    g.set<int>(order[1], -1);
+    g.set<int>(order[0] = "host_again", 5);
+    std::rotate(order.begin(), order.begin() + 1, order.end());
+    order.erase(std::remove(order.begin(), order.end(), ""), order.end());
+
+    EXPECT_EQ(order.size(), g.size());
+    EXPECT_EQ(order, std::vector<std::string>(g.begin(), g.end()));
+    EXPECT_EQ(-1, g.get<int>(order[0]));
+    EXPECT_FALSE(g.has<int>("host0"));
+
+    lightconf::group h;
+    for (const auto& key : order) {
+        h.set<lightconf::value>(key, g.get<lightconf::value>(key));
+    }
+    EXPECT_EQ(h, g);
+    h.unset(order[1]);
+    EXPECT_FALSE(h == g);
+
+    for (const auto& key : order) {
+        g.unset(key);
+    }
+    EXPECT_EQ(0u, g.size());
+    EXPECT_TRUE(g.begin() == g.end());
+    g.set<int>("a.b", 1);
+    EXPECT_EQ(1, g.get<int>("a.b"));
+}
+
+TEST_F(GroupTest, SetAfterShrinking) {
+    lightconf::group g;
+    for (int i = 0; i < 10; i++) {
+        g.set<int>("k" + std::to_string(i), i);
+    }
+    for (int i = 9; i >= 5; i--) {
+        g.unset("k" + std::to_string(i));
+    }
+    g.set<int>("newkey", 1);
+    EXPECT_TRUE(g.has<int>("newkey"));
+    g.set<int>("newkey", 2);
+    EXPECT_EQ(6u, g.size());
+    EXPECT_EQ(2, g.get<int>("newkey"));
+    EXPECT_EQ(std::vector<std::string>({ "k0", "k1", "k2", "k3", "k4", "newkey" }),
+        std::vector<std::string>(g.begin(), g.end()));
+}
@@ -1,3 +1,4 @@
+#include <stdexcept>
 #include <vector>
 #include "gtest/gtest.h"
 #include "lightconf/lightconf.hpp"
@@ -44,3 +45,42 @@ TEST(PathTest, IteratorTest) {
     }
     ASSERT_EQ(2*3*5*7*9, prod);
 }
+
+TEST(PathTest, InternsParts) {
+    lightconf::path p("users.first_name");
+    lightconf::path q("first_name.users");
+    EXPECT_TRUE(p.begin()->interned());
+    EXPECT_EQ(&p[0], &q[1]);
+    EXPECT_EQ(p[1], q[0]);
+    EXPECT_NE(p[0], p[1]);
+    size_t interned = lightconf::atom_table_size();
+    lightconf::path r("users.first_name.users");
+    EXPECT_EQ(interned, lightconf::atom_table_size());
+    EXPECT_EQ(p + "users", r);
+
+    const std::string& part = r.at(2);
+    EXPECT_EQ("users", part);
+    r.replace(2, "last_name");
+    EXPECT_EQ("users.first_name.last_name", r.fullpath());
+    EXPECT_EQ(&r[0], &p[0]);
+    EXPECT_THROW(r.replace(3, "x"), std::out_of_range);
+}
+
+TEST(PathTest, PartsPastAtomTableLimit) {
+    size_t limit = lightconf::atom_table_limit();
+    lightconf::set_atom_table_limit(0);
+    lightconf::path p("not_interned_part.shared");
+    lightconf::set_atom_table_limit(limit);
+
+    lightconf::path q("not_interned_part.shared");
+    EXPECT_FALSE(p.begin()->interned());
+    EXPECT_EQ(p, q);
+    lightconf::path copy = p;
+    EXPECT_EQ("not_interned_part", copy[0]);
+    EXPECT_NE(&p[0], &copy[0]);
+
+    lightconf::group g;
+    g.set<int>(p, 1);
+    EXPECT_EQ(1, g.get<int>(q));
+    EXPECT_EQ(std::vector<std::string>{ "not_interned_part" }, std::vector<std::string>(g.begin(), g.end()));
+}
@@ -1,7 +1,15 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 #include "lightconf/lightconf.hpp"
 #include "lightconf/config_format.hpp"
+#include "lightconf/file_loader.hpp"
 #include "lightconf/json_format.hpp"
+#include "lightconf/transcode.hpp"
 
 struct point {
     double x;
@@ -38,6 +46,50 @@ struct value_type_info<point> {
 
 }
 
+enum class access_level {
+    guest, member, admin
+};
+
+typedef std::tuple<int, int, int> date_tuple;
+
+struct account {
+    int id;
+    std::string name;
+    std::vector<access_level> levels;
+    date_tuple joined;
+    point home;
+    double home_x;
+};
+
+struct account_list {
+    std::vector<account> accounts;
+    std::string owner;
+};
+
+namespace lightconf {
+
+LIGHTCONF_BEGIN_ENUM(access_level)
+    LIGHTCONF_ENUM_VALUE(access_level::guest,   "GUEST")
+    LIGHTCONF_ENUM_VALUE(access_level::member,  "MEMBER")
+    LIGHTCONF_ENUM_VALUE(access_level::admin,   "ADMIN")
+LIGHTCONF_END_ENUM()
+
+LIGHTCONF_BEGIN_TYPE(account)
+    LIGHTCONF_TYPE_MEMBER_REQ(int,                          id,         "id")
+    LIGHTCONF_TYPE_MEMBER_OPT(std::string,                  name,       "name",     "")
+    LIGHTCONF_TYPE_MEMBER_OPT(std::vector<access_level>,    levels,     "levels",   std::vector<access_level>())
+    LIGHTCONF_TYPE_MEMBER_OPT(date_tuple,                   joined,     "joined",   date_tuple())
+    LIGHTCONF_TYPE_MEMBER_OPT(point,                        home,       "home",     point())
+    LIGHTCONF_TYPE_MEMBER_OPT(double,                       home_x,     "home.x",   -1)
+LIGHTCONF_END_TYPE()
+
+LIGHTCONF_BEGIN_TYPE(account_list)
+    LIGHTCONF_TYPE_MEMBER_REQ(std::vector<account>,         accounts,   "accounts")
+    LIGHTCONF_TYPE_MEMBER_OPT(std::string,                  owner,      "owner",    "")
+LIGHTCONF_END_TYPE()
+
+}
+
 class ConfigFormatTest : public ::testing::Test {
 protected:
     virtual void SetUp() {
@@ -87,6 +139,723 @@ TEST_F(ConfigFormatTest, ParseJson) {
     EXPECT_EQ(grp1, grp2);
 }
 
+TEST_F(ConfigFormatTest, ReadFile) {
+    std::string config_path = ::testing::TempDir() + "lightconf_read_file.config";
+    std::string json_path = ::testing::TempDir() + "lightconf_read_file.json";
+    std::ofstream(config_path) << sampleConfig;
+    std::ofstream(json_path) << sampleJson;
+
+    EXPECT_EQ(lightconf::config_format::read(sampleConfig), lightconf::config_format::read_file(config_path));
+    EXPECT_EQ(lightconf::json_format::read(sampleJson), lightconf::json_format::read_file(json_path));
+    EXPECT_THROW(lightconf::config_format::read_file(config_path + ".missing"), lightconf::io_error);
+
+    std::remove(config_path.c_str());
+    std::remove(json_path.c_str());
+}
+
+TEST_F(ConfigFormatTest, ParseErrorLocation) {
+    try {
+        lightconf::config_format::read("key1 = 5\nkey2 = [ 1,\n    2 ] key3 = ]");
+        FAIL() << "expected a parse_error";
+    } catch (const lightconf::parse_error& e) {
+        EXPECT_EQ(3, e.line());
+        EXPECT_EQ(16, e.col());
+    }
+    try {
+        lightconf::json_format::read("{\n  \"a\": 1,\n  \"b\": null }");
+        FAIL() << "expected a parse_error";
+    } catch (const lightconf::parse_error& e) {
+        EXPECT_EQ(3, e.line());
+        EXPECT_EQ(8, e.col());
+    }
+    try {
+        lightconf::config_format::read("a = \"x\nb = 1");
+        FAIL() << "expected a parse_error";
+    } catch (const lightconf::parse_error& e) {
+        EXPECT_EQ(1, e.line());
+        EXPECT_EQ(7, e.col());
+    }
+}
+
+// Parses src with a push parser, split into chunks of the given size, and reports any
+// parse error in the same form as parse_error_string
+template <typename PushParser>
+std::string push_parse(const std::string& src, size_t chunk, lightconf::group *grp) {
+    PushParser parser;
+    try {
+        for (size_t i = 0; i < src.size(); i += chunk) {
+            parser.feed(src.substr(i, chunk));
+        }
+        *grp = parser.finish();
+    } catch (const lightconf::parse_error& e) {
+        return std::string(e.what()) + " at " + std::to_string(e.line()) + ":" + std::to_string(e.col());
+    }
+    return "";
+}
+
+template <typename ReadFunction>
+std::string parse_error_string(ReadFunction read, const std::string& src, lightconf::group *grp) {
+    try {
+        *grp = read(src);
+    } catch (const lightconf::parse_error& e) {
+        return std::string(e.what()) + " at " + std::to_string(e.line()) + ":" + std::to_string(e.col());
+    } catch (const lightconf::lightconf_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+TEST_F(ConfigFormatTest, PushParserAnySplit) {
+    lightconf::group expected_config = lightconf::config_format::read(sampleConfig);
+    lightconf::group expected_json = lightconf::json_format::read(sampleJson);
+    for (size_t split = 0; split <= sampleConfig.size(); split++) {
+        lightconf::config_format::push_parser parser;
+        parser.feed(sampleConfig.substr(0, split));
+        parser.feed(sampleConfig.substr(split));
+        EXPECT_EQ(expected_config, parser.finish()) << "split at " << split;
+    }
+    for (size_t split = 0; split <= sampleJson.size(); split++) {
+        lightconf::json_format::push_parser parser;
+        parser.feed(sampleJson.substr(0, split));
+        parser.feed(sampleJson.substr(split));
+        EXPECT_EQ(expected_json, parser.finish()) << "split at " << split;
+    }
+}
+
+TEST_F(ConfigFormatTest, PushParserMatchesRead) {
+    std::vector<std::string> configs = {
+        "", "a = 1", "a = 1 // trailing comment", "a = { b = 1", "a = { b = 1 }, c = \"x\\u00e9\"",
+        "a = 1.5e3 b = -2 c = [ true, false, ]", "a = {}", "a = [ 1, 2", "a = [ 1 ] }", "a = b",
+        "a = \"unclosed", "a = \"new\nline\"", "\n\n  a = 1\n  b = = 2", "a = /", "a = 1 /",
+        "a = { b = {} } c = 2", "a.b = 1 a.c = 2", "a = - b = 1", "a = \"\\ud83d\\ude00\"",
+    };
+    for (const auto& src : configs) {
+        lightconf::group expected;
+        std::string expected_error = parse_error_string<lightconf::group (*)(const std::string&)>(
+            lightconf::config_format::read, src, &expected);
+        for (size_t chunk = 1; chunk <= src.size() + 1; chunk++) {
+            lightconf::group grp;
+            EXPECT_EQ(expected_error, push_parse<lightconf::config_format::push_parser>(src, chunk, &grp))
+                << src << " in chunks of " << chunk;
+            EXPECT_EQ(expected, grp) << src << " in chunks of " << chunk;
+        }
+    }
+
+    std::vector<std::string> jsons = {
+        "{}", "{ \"a\": 1 } trailing", "{ \"a\": [1, 2, ], }", "{ \"a\": null }", "[1]", "",
+        "{ \"a\": 1 \"b\": 2 }", "{ \"a\" 1 }", "{ \"a\": [1 2] }", "{ a: 1 }", "{ \"a\": {",
+        "{ \"a\": { \"b\": -1.25e-3, \"c\": \"\\t\" } }",
+    };
+    for (const auto& src : jsons) {
+        lightconf::group expected;
+        std::string expected_error = parse_error_string<lightconf::group (*)(const std::string&)>(
+            lightconf::json_format::read, src, &expected);
+        for (size_t chunk = 1; chunk <= src.size() + 1; chunk++) {
+            lightconf::group grp;
+            EXPECT_EQ(expected_error, push_parse<lightconf::json_format::push_parser>(src, chunk, &grp))
+                << src << " in chunks of " << chunk;
+            EXPECT_EQ(expected, grp) << src << " in chunks of " << chunk;
+        }
+    }
+}
+
+TEST_F(ConfigFormatTest, PushParserLongString) {
+    std::string text(1 << 20, 'x');
+    std::string src = "a = \"" + text + "\"\nb = 2";
+    lightconf::config_format::push_parser parser;
+    for (size_t i = 0; i < src.size(); i += 100) {
+        parser.feed(src.substr(i, 100));
+    }
+    lightconf::group grp = parser.finish();
+    EXPECT_EQ(text, grp.get<std::string>("a"));
+    EXPECT_EQ(2, grp.get<int>("b"));
+}
+
+TEST_F(ConfigFormatTest, ReadStream) {
+    std::istringstream config(sampleConfig);
+    std::istringstream json(sampleJson);
+    EXPECT_EQ(lightconf::config_format::read(sampleConfig), lightconf::config_format::read(config));
+    EXPECT_EQ(lightconf::json_format::read(sampleJson), lightconf::json_format::read(json));
+
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    ASSERT_EQ((ssize_t)sampleConfig.size(), write(fds[1], sampleConfig.data(), sampleConfig.size()));
+    close(fds[1]);
+    EXPECT_EQ(lightconf::config_format::read(sampleConfig), lightconf::config_format::read_fd(fds[0]));
+    close(fds[0]);
+}
+
+// Records every event as text, one per line
+class recording_handler : public lightconf::handler {
+public:
+    std::string events;
+
+    void begin_group() override             { events += "{\n"; }
+    void end_group() override               { events += "}\n"; }
+    void begin_vector() override            { events += "[\n"; }
+    void end_vector() override              { events += "]\n"; }
+    void on_key(lightconf::string_ref key) override { events += "key " + key.str() + "\n"; }
+    void on_number(double val) override     { events += "number " + std::to_string(val) + "\n"; }
+    void on_string(lightconf::string_ref val) override { events += "string " + val.str() + "\n"; }
+    void on_bool(bool val) override         { events += val ? "true\n" : "false\n"; }
+};
+
+TEST_F(ConfigFormatTest, ParseEvents) {
+    recording_handler config;
+    lightconf::config_format::parse("a = 1, b = [ \"x\\ty\" true { c = false } ]", config);
+    EXPECT_EQ("{\nkey a\nnumber 1.000000\nkey b\n[\nstring x\ty\ntrue\n{\nkey c\nfalse\n}\n]\n}\n",
+        config.events);
+
+    recording_handler json;
+    lightconf::json_format::parse("{ \"a\": 1, \"b\": [ \"x\\ty\", true, { \"c\": false } ] }", json);
+    EXPECT_EQ(config.events, json.events);
+
+    recording_handler sample_config, sample_json;
+    lightconf::config_format::parse(sampleConfig, sample_config);
+    lightconf::json_format::parse(sampleJson, sample_json);
+    EXPECT_EQ(sample_config.events, sample_json.events);
+
+    // The handler only sees what comes before the error
+    recording_handler partial;
+    EXPECT_THROW(lightconf::json_format::parse("{ \"a\": 1, \"b\": null }", partial), lightconf::parse_error);
+    EXPECT_EQ("{\nkey a\nnumber 1.000000\nkey b\n", partial.events);
+}
+
+TEST_F(ConfigFormatTest, ParseEventsInChunks) {
+    recording_handler expected;
+    lightconf::config_format::parse(sampleConfig, expected);
+
+    recording_handler pushed;
+    lightconf::config_format::event_push_parser parser(pushed);
+    for (char c : sampleConfig) {
+        parser.feed(&c, 1);
+    }
+    parser.finish();
+    EXPECT_EQ(expected.events, pushed.events);
+
+    recording_handler streamed;
+    std::istringstream in(sampleConfig);
+    lightconf::config_format::parse(in, streamed);
+    EXPECT_EQ(expected.events, streamed.events);
+}
+
+TEST_F(ConfigFormatTest, ReadJsonMatchesTokenReader) {
+    std::vector<std::string> docs = {
+        sampleJson, "{}", "", "[1]", "{ \"a\": null }", "{ \"a\": 1 } trailing", "{ \"a\": 1 } \"unclosed",
+        "{ \"a\": 1 } -", "{ \"a\": [1, 2, ], }", "{ \"a\": 1 // comment\n }", "{ \"a\": 1.2.3 }", "{ \"a\": truex }",
+        "{ \"a\": \"x\\ty\\\"z\\u00e9\\ud83d\\ude00\\q\" }", "{ \"a\": \"new\nline\" }", "{ \"a\": \"esc\\\nline\" }",
+        "{ \"a\": 1 \"b\": 2 }", "{ \"a\" 1 }", "{ \"a\": [1 2] }", "{ a: 1 }", "{ \"a\": {", "{ \"a\": 1, \"a.b\": 2 }",
+        "\xef\xbb\xbf{ \"bom\": 1 }", "{ \"a\": 1#}", "{ \"a\": \"\\", "{ \"x\\\"y\": 1 }", "{ \"a\": -.5e-3 }",
+    };
+    for (const auto& doc : docs) {
+        // shift the document across a block boundary
+        for (size_t pad : { 0, 1, 40, 63, 64 }) {
+            std::string src = std::string(pad, ' ') + doc;
+            lightconf::group expected, actual;
+            std::string expected_error = parse_error_string([](const std::string& s) {
+                lightconf::scanner sc;
+                sc.scan(s.data(), s.size(), lightconf::read_scanner_params);
+                return lightconf::json_format::read_group(sc, false);
+            }, src, &expected);
+            std::string actual_error = parse_error_string<lightconf::group (*)(const std::string&)>(
+                lightconf::json_format::read, src, &actual);
+            EXPECT_EQ(expected_error, actual_error) << src;
+            EXPECT_EQ(expected, actual) << src;
+        }
+    }
+}
+
+TEST_F(ConfigFormatTest, ReadJsonValidated) {
+    EXPECT_EQ(lightconf::json_format::read(sampleJson), lightconf::json_format::read_validated(sampleJson));
+
+    std::string invalid = "{\n  \"a\": \"caf\xe9\" }";
+    EXPECT_EQ("caf\xe9", lightconf::json_format::read(invalid).get<std::string>("a"));
+    try {
+        lightconf::json_format::read_validated(invalid);
+        FAIL() << "expected a utf8_error";
+    } catch (const lightconf::utf8_error& e) {
+        EXPECT_EQ(2, e.line());
+        EXPECT_EQ(12, e.col());
+    }
+}
+
+TEST_F(ConfigFormatTest, ReadParallelMatchesRead) {
+    std::string users = "users = [\n";
+    for (int i = 0; i < 200; i++) {
+        users += "  { uid = " + std::to_string(i) + " name = \"user " + std::to_string(i) + " // {[\"\n"
+            "    permissions = [ \"READ\", \"UPDATE\" ] // ]}\n    home = { dir = \"/home/u\", shell = \"sh\" } }\n";
+    }
+    users += "]\nglobal = { maintainer = \"user\" }, users2 = { a = 1 b = [ ] c = { d = 1 } }, users = [ 1 2 ]\n";
+
+    std::vector<std::string> configs = {
+        sampleConfig, users, "", "a = 1", "a = 1, b = 2, a = 3", "a = { b = 1", "a = {}", "a = { }, b = 1",
+        "a = [ 1, 2", "a = [ 1 ] }", "a = { b = {} } c = 2", "a = { b = {} c = 2", "a = [ {} ]", "a = [ [ ], [ 1 ] ]",
+        "a = { x = [ 1 2 ] y = { z = \"]\" } } b = [ { c = 1 }, { c = 2 }, ]", "a = [ { b = 1 } ] ] c = 1",
+        "a = { b = 1 }} c = 1", "a = [ 1, 2 } b = 1", "a = { b = \"x\ny\" } c = 1", "a = { b = 1 ,, } c = 1",
+        "a.b = { c = 1 } d = 2", "a = { b = 1 } = 2", "a = { b = 1 } // {\nc = [ 1 \"/\" ] // ]",
+    };
+    lightconf::thread_pool pool(4);
+    for (const auto& src : configs) {
+        lightconf::group expected;
+        std::string expected_error = parse_error_string<lightconf::group (*)(const std::string&)>(
+            lightconf::config_format::read, src, &expected);
+        for (size_t chunk : { 1, 8, 64, 1000, 1 << 20 }) {
+            lightconf::group grp;
+            std::string error = parse_error_string([&](const std::string& s) {
+                return lightconf::config_format::read_parallel(s, pool, chunk);
+            }, src, &grp);
+            EXPECT_EQ(expected_error, error) << src << " in chunks of " << chunk;
+            EXPECT_EQ(expected, grp) << src << " in chunks of " << chunk;
+        }
+    }
+
+    EXPECT_EQ(lightconf::config_format::read(users), lightconf::config_format::read_parallel(users, 3));
+    std::string path = ::testing::TempDir() + "lightconf_read_parallel.config";
+    std::ofstream(path) << users;
+    EXPECT_EQ(lightconf::config_format::read(users), lightconf::config_format::read_file_parallel(path, 2));
+    std::remove(path.c_str());
+}
+
+TEST_F(ConfigFormatTest, ReadLazy) {
+    std::vector<std::string> configs = {
+        sampleConfig, "", "a = [ [ 1, { b = [ ] } ], \"]\" ] c = { d = { e = 1 } // }\n }",
+        "a = { b = 1", "a = [ { b = [ 1 ] } { b = [ 2 ] } ]", "a = 1, a = { b = 2 }",
+    };
+    for (const auto& src : configs) {
+        lightconf::group expected = lightconf::config_format::read(src);
+        lightconf::group grp = lightconf::config_format::read_lazy(src);
+        EXPECT_EQ(expected, grp) << src;
+        EXPECT_EQ(lightconf::config_format::write(expected, ""), lightconf::config_format::write(grp, "")) << src;
+    }
+
+    // Copies made before and after the text is parsed
+    lightconf::group grp = lightconf::config_format::read_lazy(sampleConfig);
+    lightconf::value before = grp.get<lightconf::value>("key4");
+    EXPECT_EQ(5, grp.get<int>("key4.subkey1"));
+    lightconf::value after = grp.get<lightconf::value>("key4");
+    EXPECT_EQ(before, after);
+    grp.set("key4.subkey5", 6);
+    EXPECT_EQ(6, grp.get<int>("key4.subkey5"));
+    EXPECT_FALSE(before.get<lightconf::group>().has<int>("subkey5"));
+
+    std::string path = ::testing::TempDir() + "lightconf_read_lazy.config";
+    std::ofstream(path) << sampleConfig;
+    lightconf::group from_file = lightconf::config_format::read_file_lazy(path);
+    std::remove(path.c_str());
+    EXPECT_EQ(lightconf::config_format::read(sampleConfig), from_file);
+}
+
+TEST_F(ConfigFormatTest, ReadLazyErrors) {
+    // Only the top level is checked up front
+    std::string src = "a = 1\nb = { c = [ 1,\n  ] d = = 2 }\ne = [ 2 ]";
+    lightconf::group grp = lightconf::config_format::read_lazy(src);
+    EXPECT_EQ(1, grp.get<int>("a"));
+    EXPECT_EQ(std::vector<int>({ 2 }), grp.get<std::vector<int>>("e"));
+
+    lightconf::group expected;
+    std::string expected_error = parse_error_string<lightconf::group (*)(const std::string&)>(
+        lightconf::config_format::read, src, &expected);
+    for (int i = 0; i < 2; i++) {
+        try {
+            grp.get<lightconf::group>("b");
+            FAIL() << "expected a parse_error";
+        } catch (const lightconf::parse_error& e) {
+            EXPECT_EQ(expected_error, std::string(e.what()) + " at " + std::to_string(e.line()) + ":" + std::to_string(e.col()));
+        }
+    }
+
+    EXPECT_THROW(lightconf::config_format::read_lazy("a = { b = {} }").get<lightconf::group>("a.b"), lightconf::parse_error);
+}
+
+TEST_F(ConfigFormatTest, ReadLazyConcurrently) {
+    std::string src = "users = [\n";
+    for (int i = 0; i < 100; i++) {
+        src += "  { uid = " + std::to_string(i) + " tags = [ \"a\" \"b\" ] home = { dir = \"/home\" } }\n";
+    }
+    src += "]\n";
+    lightconf::group expected = lightconf::config_format::read(src);
+
+    for (int round = 0; round < 20; round++) {
+        const lightconf::group grp = lightconf::config_format::read_lazy(src);
+        std::vector<std::thread> threads;
+        std::vector<int> matches(4);
+        for (int t = 0; t < 4; t++) {
+            threads.push_back(std::thread([&, t] {
+                matches[t] = grp == expected;
+            }));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        EXPECT_EQ(std::vector<int>(4, 1), matches);
+    }
+}
+
+TEST_F(ConfigFormatTest, ReadProjected) {
+    std::vector<lightconf::path> paths = { "key2", "key4.subkey3", "key4.subkey4", "key1.x", "missing.x" };
+    lightconf::group full = lightconf::config_format::read(sampleConfig);
+    lightconf::group expected;
+    for (const auto& p : paths) {
+        if (full.has<lightconf::value>(p)) {
+            expected.set(p, full.get<lightconf::value>(p));
+        }
+    }
+    EXPECT_EQ(expected, lightconf::config_format::read(sampleConfig, paths));
+    EXPECT_EQ(expected, lightconf::json_format::read(sampleJson, paths));
+    EXPECT_EQ(full, lightconf::config_format::read(sampleConfig, { "key1", "key2", "key3", "key4" }));
+    EXPECT_EQ(lightconf::group(), lightconf::config_format::read(sampleConfig, {}));
+
+    // Skipped values are not checked, but a later entry still replaces an earlier one
+    lightconf::group grp = lightconf::config_format::read(
+        "a = { b = 1 }, skipped = [ 1 2 = ], c = { d = , } a = 2, e = { f = 1 } e = { f = 3 }", { "a.b", "e.f" });
+    EXPECT_FALSE(grp.has<lightconf::value>("a"));
+    EXPECT_EQ(3, grp.get<int>("e.f"));
+    EXPECT_EQ(1u, grp.size());
+
+    // A JSON key with dots in it is a path
+    lightconf::group json = lightconf::json_format::read(
+        "{ \"a\": { \"e\": [ { \"f\": 3 } ] }, \"a.b\": { \"c\": 1, \"d\": 2 } }", { "a.b.c", "a.e" });
+    EXPECT_EQ(1, json.get<int>("a.b.c"));
+    EXPECT_FALSE(json.has<int>("a.b.d"));
+    EXPECT_EQ(3, json.get<lightconf::value_vector_type>("a.e")[0].get<lightconf::group>().get<int>("f"));
+
+    EXPECT_THROW(lightconf::config_format::read("a = 1 b = = 2", { "a" }), lightconf::parse_error);
+    EXPECT_THROW(lightconf::json_format::read("{ \"a\": 1 \"b\": 2 }", { "a" }), lightconf::parse_error);
+}
+
+TEST_F(ConfigFormatTest, SkipValue) {
+    // On a scanner that keeps whitespace and comments as well
+    for (const char *text : { " \"x\" }", " 1.5 }", " [ 1, { a = 2 } ] }", " { a = [ 2 ] } }" }) {
+        lightconf::scanner sc = lightconf::config_format::make_scanner(text);
+        lightconf::config_format::skip_value(sc);
+        EXPECT_TRUE(sc.peek_token().is_char('}')) << text;
+    }
+    for (const char *text : { " \"x\" }", " 1.5 }", " [ 1, { \"a\": 2 } ] }" }) {
+        lightconf::scanner sc;
+        sc.scan(text);
+        lightconf::json_format::skip_value(sc);
+        EXPECT_TRUE(sc.peek_token().is_char('}')) << text;
+    }
+}
+
+TEST_F(ConfigFormatTest, ReadElements) {
+    lightconf::group grp = lightconf::config_format::read(sampleConfig);
+    std::vector<lightconf::value> elements;
+    for (const lightconf::value& val : lightconf::config_format::read_elements(sampleConfig, "key4.subkey3")) {
+        elements.push_back(val);
+    }
+    EXPECT_EQ(grp.get<lightconf::value_vector_type>("key4.subkey3"), elements);
+
+    auto strings = lightconf::json_format::read_elements(sampleJson, "key3");
+    std::vector<std::string> v;
+    for (const std::string& str : strings.as<std::string>()) {
+        v.push_back(str);
+    }
+    EXPECT_EQ(grp.get<std::vector<std::string>>("key3"), v);
+    EXPECT_FALSE(strings.next(&v[0]));
+
+    auto points = lightconf::config_format::read_elements(
+        "a = { p = 1 } a = { c = [ 1 ], b = { p = [ { x = 1, y = 2 } { x = 3, y = 4 } ] } } rest = [ ] ] }", "a.b.p");
+    point pt;
+    ASSERT_TRUE(points.next(&pt));
+    EXPECT_EQ(1, pt.x);
+    ASSERT_TRUE(points.next(&pt));
+    EXPECT_EQ(4, pt.y);
+    EXPECT_FALSE(points.next(&pt));
+
+    auto json = lightconf::json_format::read_elements("{ \"a\": [ 1, \"x\", 3, ] }", "a");
+    double d;
+    EXPECT_TRUE(json.next(&d));
+    EXPECT_THROW(json.next(&d), lightconf::value_error);
+    EXPECT_TRUE(json.next(&d));
+    EXPECT_EQ(3, d);
+    EXPECT_FALSE(json.next(&d));
+
+    auto dotted = lightconf::json_format::read_elements("{ \"a.b\": 1, \"a\": { \"b.c\": [ true ] } }", "a.b.c");
+    EXPECT_EQ(lightconf::value(true), *dotted.begin());
+
+    EXPECT_THROW(lightconf::config_format::read_elements(sampleConfig, "key4.subkey1"), lightconf::path_error);
+    EXPECT_THROW(lightconf::json_format::read_elements(sampleJson, "key5"), lightconf::path_error);
+    EXPECT_THROW(lightconf::config_format::read_elements("a = 1 b = = [ 1 ]", "b"), lightconf::parse_error);
+    auto bad = lightconf::json_format::read_elements("{ \"a\": [ 1 2 ] }", "a");
+    EXPECT_THROW(bad.next(&d), lightconf::parse_error);
+}
+
+TEST_F(ConfigFormatTest, ReadLimits) {
+    std::string deep_config = "a = " + std::string(100000, '[') + std::string(100000, ']');
+    std::string deep_json = "{ \"a\": " + std::string(100000, '[') + std::string(100000, ']') + " }";
+    try {
+        lightconf::config_format::read(deep_config);
+        FAIL();
+    } catch (const lightconf::parse_error& e) {
+        EXPECT_EQ(std::string("nesting too deep"), e.what());
+        EXPECT_EQ(4 + 512, e.col());
+    }
+    EXPECT_THROW(lightconf::json_format::read(deep_json), lightconf::parse_error);
+    std::istringstream deep_stream(deep_config);
+    EXPECT_THROW(lightconf::config_format::read(deep_stream), lightconf::parse_error);
+
+    // As deep as the default limits allow, there and back
+    std::string nested_config = "a = " + std::string(511, '[') + "1" + std::string(511, ']');
+    lightconf::group grp = lightconf::config_format::read(nested_config);
+    EXPECT_EQ(grp, lightconf::config_format::read(lightconf::config_format::write(grp, "", 120)));
+    EXPECT_EQ(grp, lightconf::json_format::read(lightconf::json_format::write(grp)));
+    EXPECT_EQ(grp, lightconf::config_format::read(lightconf::config_format::write(grp, nested_config, 120)));
+
+    lightconf::read_limits limits = lightconf::default_read_limits;
+    limits.max_nodes = 6;
+    EXPECT_EQ(2u, lightconf::config_format::read_limited("a = [ 1 2 ] b = { c = 3 }", limits).size());
+    EXPECT_THROW(lightconf::config_format::read_limited("a = [ 1 2 ] b = { c = 3 d = 4 }", limits), lightconf::parse_error);
+    EXPECT_THROW(lightconf::json_format::read_limited("{ \"a\": [ 1, 2 ], \"b\": { \"c\": 3, \"d\": 4 } }", limits),
+        lightconf::parse_error);
+
+    limits = lightconf::default_read_limits;
+    limits.max_string_length = 3;
+    EXPECT_EQ("\"", lightconf::json_format::read_limited("{ \"abc\": \"\\\"\" }", limits).get<std::string>("abc"));
+    EXPECT_THROW(lightconf::json_format::read_limited("{ \"abcd\": 1 }", limits), lightconf::parse_error);
+    EXPECT_THROW(lightconf::config_format::read_limited("a = \"abcd\"", limits), lightconf::parse_error);
+    EXPECT_THROW(lightconf::config_format::read_limited("abcd = 1", limits), lightconf::parse_error);
+
+    limits = lightconf::default_read_limits;
+    limits.max_input_size = 10;
+    EXPECT_EQ(1, lightconf::config_format::read_limited("a = 1", limits).get<int>("a"));
+    try {
+        lightconf::config_format::read_limited("a = 1\nb = 22", limits);
+        FAIL();
+    } catch (const lightconf::parse_error& e) {
+        EXPECT_EQ(std::string("document too large"), e.what());
+        EXPECT_EQ(2, e.line());
+        EXPECT_EQ(5, e.col());
+    }
+    lightconf::json_format::push_parser parser(limits);
+    parser.feed("{ \"a\": ");
+    try {
+        parser.feed("12345 }");
+        FAIL();
+    } catch (const lightconf::parse_error& e) {
+        EXPECT_EQ(std::string("document too large"), e.what());
+        EXPECT_EQ(11, e.col());
+    }
+}
+
+TEST_F(ConfigFormatTest, ReadAs) {
+    std::string config =
+        "owner = \"root\"\n"
+        "accounts = [\n"
+        "    { id = 1, name = \"ann\", levels = [ \"ADMIN\", \"GUEST\" ], joined = [ 1, 2, 2003 ] }\n"
+        "    { id = 2, notes = { a = [ 1 { b = 2 } ] }, home = { x = 3, y = 4 } }\n"
+        "]";
+    account_list list = lightconf::config_format::read_as<account_list>(config);
+    ASSERT_EQ(2u, list.accounts.size());
+    EXPECT_EQ("root", list.owner);
+    EXPECT_EQ("ann", list.accounts[0].name);
+    EXPECT_EQ(std::vector<access_level>({ access_level::admin, access_level::guest }), list.accounts[0].levels);
+    EXPECT_EQ(date_tuple(1, 2, 2003), list.accounts[0].joined);
+    EXPECT_EQ(-1, list.accounts[0].home_x);
+    EXPECT_EQ(2, list.accounts[1].id);
+    EXPECT_EQ("", list.accounts[1].name);
+    EXPECT_EQ(4, list.accounts[1].home.y);
+    EXPECT_EQ(3, list.accounts[1].home_x);
+
+    // The same as converting the group that read() builds
+    lightconf::value built(lightconf::config_format::read(config));
+    EXPECT_EQ(lightconf::value_type_info<account_list>::create_value(built.get<account_list>()),
+        lightconf::value_type_info<account_list>::create_value(list));
+
+    std::string json = "{ \"accounts\": [ { \"id\": 5, \"home.x\": 7, \"joined\": [ 3, 4, 5 ], }, ], \"x\": [ null ] }";
+    list = lightconf::json_format::read_as<account_list>(json);
+    ASSERT_EQ(1u, list.accounts.size());
+    EXPECT_EQ(7, list.accounts[0].home_x);
+    EXPECT_EQ(date_tuple(3, 4, 5), list.accounts[0].joined);
+    EXPECT_EQ(2, lightconf::json_format::read_as<lightconf::group>("{ \"a\": { \"b\": 2 } }").get<int>("a.b"));
+
+    // From a scanner that keeps whitespace and comments
+    lightconf::scanner sc;
+    sc.scan(" { \"accounts\": [ { \"id\": 5, \"joined\": [ 3, 4, 5 ] } ], \"owner\": \"x\" } ");
+    list = lightconf::json_format::read_as<account_list>(sc);
+    ASSERT_EQ(1u, list.accounts.size());
+    EXPECT_EQ(date_tuple(3, 4, 5), list.accounts[0].joined);
+    EXPECT_EQ("x", list.owner);
+    lightconf::scanner config_sc = lightconf::config_format::make_scanner(
+        " accounts = [ { id = 5, joined = [ 3, 4, 5 ] } ] // done\n owner = \"x\"");
+    list = lightconf::config_format::read_as<account_list>(config_sc);
+    ASSERT_EQ(1u, list.accounts.size());
+    EXPECT_EQ(date_tuple(3, 4, 5), list.accounts[0].joined);
+    EXPECT_EQ("x", list.owner);
+
+    try {
+        lightconf::config_format::read_as<account_list>("accounts = [ { name = \"x\" } ]");
+        FAIL();
+    } catch (const lightconf::value_error& e) {
+        EXPECT_EQ(std::string("missing required member: id"), e.what());
+    }
+    EXPECT_THROW(lightconf::config_format::read_as<account_list>("owner = \"x\""), lightconf::value_error);
+    EXPECT_THROW(lightconf::config_format::read_as<account_list>("accounts = [ { id = \"1\" } ]"), lightconf::value_error);
+    EXPECT_THROW(lightconf::config_format::read_as<account_list>("accounts = [ { id = 1, joined = [ 1, 2 ] } ]"),
+        lightconf::value_error);
+    EXPECT_THROW(lightconf::config_format::read_as<account_list>("accounts = [ { id = 1, levels = [ \"ROOT\" ] } ]"),
+        lightconf::value_error);
+    EXPECT_THROW(lightconf::config_format::read_as<account_list>("accounts = [ { id = 1 } = ]"), lightconf::parse_error);
+    EXPECT_THROW(lightconf::json_format::read_as<account_list>("[ ]"), lightconf::parse_error);
+}
+
+TEST_F(ConfigFormatTest, ReadDocuments) {
+    std::string docs = "{ \"a\": 1 }\n{ \"a\": [ 2, 3 ] }{ \"a\": { \"b\": 4 } }\n// comment\n\n{ \"a\": 1 2 }\n{ \"a\": 5 }\n";
+    lightconf::json_format::document_reader reader(docs.data(), docs.size());
+    lightconf::group doc;
+    ASSERT_TRUE(reader.next(&doc));
+    EXPECT_EQ(1, doc.get<int>("a"));
+    ASSERT_TRUE(reader.next(&doc));
+    EXPECT_EQ(std::vector<int>({ 2, 3 }), doc.get<std::vector<int>>("a"));
+    ASSERT_TRUE(reader.next(&doc));
+    EXPECT_EQ(4, doc.get<int>("a.b"));
+    try {
+        reader.next(&doc);
+        FAIL();
+    } catch (const lightconf::parse_error& e) {
+        EXPECT_EQ(5, e.line());
+        EXPECT_EQ(10, e.col());
+    }
+    ASSERT_TRUE(reader.next(&doc));
+    EXPECT_EQ(5, doc.get<int>("a"));
+    EXPECT_FALSE(reader.next(&doc));
+
+    // From a stream, and on a pool, the same documents come out
+    std::string good = docs.substr(0, docs.find("// comment"));
+    std::vector<lightconf::group> all = lightconf::json_format::read_documents(good);
+    ASSERT_EQ(3u, all.size());
+    std::istringstream in(good);
+    lightconf::json_format::document_reader stream_reader(in);
+    for (const auto& grp : all) {
+        ASSERT_TRUE(stream_reader.next(&doc));
+        EXPECT_EQ(grp, doc);
+    }
+    EXPECT_FALSE(stream_reader.next(&doc));
+    lightconf::thread_pool pool(2);
+    EXPECT_EQ(all, lightconf::json_format::read_documents(good, pool));
+    EXPECT_THROW(lightconf::json_format::read_documents(docs, pool), lightconf::parse_error);
+    EXPECT_TRUE(lightconf::json_format::read_documents(" \n").empty());
+
+    // A bad document in the last batch fails the read, however long the others take
+    std::string large = "{ \"a\": [ 0";
+    for (int i = 1; i < 20000; i++) {
+        large += ", " + std::to_string(i);
+    }
+    large += " ] }\n";
+    std::string bad_last;
+    for (int i = 0; i < 15; i++) {
+        bad_last += large;
+    }
+    bad_last += "{ \"b\" 2 }\n";
+    lightconf::thread_pool pool4(4);
+    EXPECT_THROW(lightconf::json_format::read_documents(bad_last, pool4), lightconf::parse_error);
+}
+
+TEST_F(ConfigFormatTest, ReadIntoArena) {
+    std::string long_string(100, 'x');
+    std::string config = "a = 1, b = \"" + long_string + "\", c = [ \"short\", \"" + long_string + "\", [ 2 ] ], "
+        "d = { e = true, f = { g = \"" + long_string + "\" } }";
+    lightconf::group copy;
+    {
+        lightconf::arena mem;
+        lightconf::group grp = lightconf::config_format::read(config, mem);
+        EXPECT_EQ(&mem, grp.mem());
+        EXPECT_LT(0u, mem.used());
+        EXPECT_EQ(lightconf::config_format::read(config), grp);
+        EXPECT_EQ(long_string, grp.get<std::string>("d.f.g"));
+
+        // Whatever is set afterwards is moved into the arena too
+        grp.set<std::string>("d.f.g", "replaced " + long_string);
+        grp.set<lightconf::group>("h", lightconf::config_format::read("i = [ \"" + long_string + "\" ]"));
+        grp.unset("b");
+        lightconf::group sub;
+        sub.set<std::string>("j", long_string);
+        grp.emplace("d.f", std::move(sub));
+        EXPECT_EQ(long_string, grp.get<std::string>("d.f.j"));
+        EXPECT_EQ(long_string, grp.get<std::vector<std::string>>("h.i")[0]);
+
+        // A copy is on the heap, and outlives the arena
+        copy = grp;
+        EXPECT_EQ(nullptr, copy.mem());
+        EXPECT_EQ(grp, copy);
+
+        std::string json = lightconf::json_format::write(copy);
+        lightconf::arena json_mem;
+        lightconf::group json_grp = lightconf::json_format::read(json, json_mem);
+        EXPECT_EQ(&json_mem, json_grp.mem());
+        EXPECT_EQ(copy, json_grp);
+        EXPECT_THROW(lightconf::json_format::read("{ \"a\": [ 1, 2 ] ", json_mem), lightconf::parse_error);
+    }
+    EXPECT_EQ(long_string, copy.get<std::string>("d.f.j"));
+    EXPECT_EQ(2, copy.get<std::vector<lightconf::value>>("c")[2].get<std::vector<int>>()[0]);
+
+    // Keys that aren't interned are kept in the arena as well
+    lightconf::set_atom_table_limit(0);
+    {
+        lightconf::arena mem;
+        lightconf::group grp = lightconf::config_format::read("not_interned_" + long_string + " = 1", mem);
+        copy = grp;
+    }
+    lightconf::set_atom_table_limit(lightconf::default_atom_table_limit);
+    EXPECT_EQ(1, copy.get<int>("not_interned_" + long_string));
+}
+
+TEST_F(ConfigFormatTest, LoadFiles) {
+    std::string dir = ::testing::TempDir() + "lightconf_load_files";
+    ::mkdir(dir.c_str(), 0700);
+    std::vector<std::string> names = { "a.config", "b.config", "c.config", "d.json", ".hidden" };
+    std::ofstream(dir + "/a.config") << "db = { host = \"a\", port = 1 } name = \"a\"";
+    std::ofstream(dir + "/b.config") << "db = { port = 2 }\nlist = [ 1 2 ]";
+    std::ofstream(dir + "/c.config") << "x = 1\ny = ]";
+    std::ofstream(dir + "/d.json") << sampleJson;
+    std::ofstream(dir + "/.hidden") << "hidden = 1";
+
+    lightconf::thread_pool pool(3);
+    lightconf::loaded_files files = lightconf::load_files(dir, pool);
+    ASSERT_EQ(4u, files.size());
+    EXPECT_EQ(2, files[dir + "/b.config"].grp.get<int>("db.port"));
+    const lightconf::loaded_file& bad = files[dir + "/c.config"];
+    EXPECT_TRUE(bad.failed);
+    EXPECT_EQ(2, bad.line);
+    EXPECT_EQ(5, bad.col);
+    EXPECT_TRUE(files[dir + "/d.json"].failed);
+
+    lightconf::group merged = lightconf::merge_files(files);
+    EXPECT_EQ(std::vector<std::string>({ "db", "name", "list" }), std::vector<std::string>(merged.begin(), merged.end()));
+    EXPECT_EQ("a", merged.get<std::string>("db.host"));
+    EXPECT_EQ(2, merged.get<int>("db.port"));
+
+    files = lightconf::load_files(dir + "/*.json", pool, lightconf::json_format::read_file);
+    ASSERT_EQ(1u, files.size());
+    EXPECT_EQ(lightconf::json_format::read(sampleJson), files.begin()->second.grp);
+    EXPECT_TRUE(lightconf::find_files(dir + "/*.missing").empty());
+
+    for (const auto& name : names) {
+        std::remove((dir + "/" + name).c_str());
+    }
+    ::rmdir(dir.c_str());
+}
+
+TEST_F(ConfigFormatTest, Transcode) {
+    std::ostringstream json;
+    lightconf::config_to_json(sampleConfig, json);
+    EXPECT_EQ(lightconf::json_format::write(lightconf::config_format::read(sampleConfig)), json.str());
+
+    std::istringstream json_in(sampleJson);
+    for (int wrap_length : { 0, 20, 120 }) {
+        std::ostringstream config;
+        lightconf::json_to_config(sampleJson, config, wrap_length);
+        EXPECT_EQ(lightconf::config_format::write(lightconf::json_format::read(sampleJson), "", wrap_length), config.str());
+    }
+    std::ostringstream config;
+    lightconf::json_to_config(json_in, config, 40);
+    EXPECT_EQ(lightconf::config_format::read(sampleConfig), lightconf::config_format::read(config.str()));
+
+    std::ostringstream out;
+    EXPECT_THROW(lightconf::json_to_config("{ \"a.b\": 1 }", out), lightconf::value_error);
+    EXPECT_THROW(lightconf::config_to_json("a = [ 1 2 }", out), lightconf::parse_error);
+}
+
 TEST_F(ConfigFormatTest, WriteConfig) {
     lightconf::group grp = lightconf::config_format::read(sampleConfig);
     grp.set<double>("key2", 7.55);
@@ -119,6 +888,17 @@ TEST_F(ConfigFormatTest, WriteConfig) {
     EXPECT_EQ(grp, new_grp);
 }
 
+TEST_F(ConfigFormatTest, WriteLengths) {
+    // The lengths are exact however far past wrap_length they go
+    lightconf::group grp;
+    grp.set<std::vector<int>>("k", std::vector<int>(100, 12345));
+    EXPECT_EQ(703, lightconf::config_format::vector_length(grp.get<lightconf::value_vector_type>("k"), 20));
+    EXPECT_EQ(711, lightconf::config_format::group_length(grp, 20));
+    EXPECT_EQ(711, lightconf::config_format::value_length(lightconf::value(grp), 20));
+    EXPECT_FALSE(lightconf::config_format::fits_in(grp, 710));
+    EXPECT_TRUE(lightconf::config_format::fits_in(grp, 711));
+}
+
 TEST_F(ConfigFormatTest, WriteConfigWithParseFailure) {
     lightconf::group grp = lightconf::config_format::read(sampleConfig);
     grp.set<double>("key2", 7.55);
@@ -146,6 +926,31 @@ TEST_F(ConfigFormatTest, WriteConfigWithParseFailure) {
 
     lightconf::group new_grp = lightconf::config_format::read(new_config);
     EXPECT_EQ(grp, new_grp);
+
+    // Nothing written before the error is kept
+    lightconf::group small = lightconf::config_format::read("a = 1");
+    EXPECT_EQ("a = 1", lightconf::config_format::write(small, "a = 1\nb = { c = ", 50));
+}
+
+TEST_F(ConfigFormatTest, WriteConfigNested) {
+    std::string src = "a = 1\nb = { c = 1 }\n";
+    lightconf::group grp = lightconf::config_format::read(src);
+    grp.set<int>("b", 5);
+    EXPECT_EQ("a = 1\nb = 5\n", lightconf::config_format::write(grp, src));
+
+    src = "// top\na = 1\nb = {\n    // about c\n    c = 1\n    d = { e = 2 } // after d\n}\n// after b\nf = [ 1, 2 ]\n";
+    grp = lightconf::config_format::read(src);
+    grp.unset("b.d");
+    grp.set<int>("b.c", 3);
+    EXPECT_EQ("// top\na = 1\nb = { // about c\n    c = 3, // after d\n}\n// after b\nf = [ 1, 2 ]\n",
+        lightconf::config_format::write(grp, src));
+    grp.unset("b");
+    EXPECT_EQ("// top\na = 1\n// about c\n// after d\n// after b\nf = [ 1, 2 ]\n",
+        lightconf::config_format::write(grp, src));
+
+    // A scanner that keeps whitespace and comments reads the same values
+    lightconf::scanner sc = lightconf::config_format::make_scanner("  { x = [ 1 ] } ");
+    EXPECT_EQ(lightconf::config_format::read("x = [ 1 ]"), lightconf::config_format::read_value(sc).get<lightconf::group>());
 }
 
 TEST_F(ConfigFormatTest, WriteJson) {
@@ -1,5 +1,11 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
 #include "gtest/gtest.h"
 #include "lightconf/internal/scanner.hpp"
+#include "lightconf/internal/structural_index.hpp"
 
 class ScannerTest : public ::testing::Test {
 protected:
@@ -11,6 +17,15 @@ TEST_F(ScannerTest, ScanString) {
     EXPECT_EQ("hello\t\f\n\r\bworld", sc.expect_string());
 }
 
+TEST_F(ScannerTest, ScanStringRef) {
+    sc.scan("\"plain\" \"esc\\\"aped\" ident");
+    EXPECT_FALSE(sc.peek_token().escaped);
+    EXPECT_EQ(lightconf::string_ref("plain"), sc.token_text(sc.peek_token()));
+    EXPECT_EQ("plain", sc.expect_string_ref().str());
+    EXPECT_EQ("esc\"aped", sc.expect_string_ref().str());
+    EXPECT_EQ(lightconf::string_ref("ident"), sc.expect_identifier_ref());
+}
+
 TEST_F(ScannerTest, ScanNumber) {
     sc.scan("1.34 -55 4e6 .4 -.6");
     EXPECT_EQ(1.34, sc.expect_number());
@@ -20,6 +35,41 @@ TEST_F(ScannerTest, ScanNumber) {
     EXPECT_EQ(-0.6, sc.expect_number());
 }
 
+TEST_F(ScannerTest, ScanNumberIgnoresLocale) {
+    sc.scan("1e23 2.2250738585072011e-308 123456789012345678901234567890 5. 1e");
+    EXPECT_EQ(1e23, sc.expect_number());
+    EXPECT_EQ(2.2250738585072011e-308, sc.expect_number());
+    EXPECT_EQ(123456789012345678901234567890.0, sc.expect_number());
+    EXPECT_EQ(5, sc.expect_number());
+    EXPECT_EQ(1, sc.expect_number());
+    EXPECT_EQ("e", sc.expect_identifier());
+}
+
+TEST_F(ScannerTest, ScanInvalidNumber) {
+    EXPECT_THROW(sc.scan("- 5"), lightconf::parse_error);
+    EXPECT_THROW(sc.scan("[.]"), lightconf::parse_error);
+}
+
+TEST_F(ScannerTest, ParseNumberMatchesCorrectRounding) {
+    const char *cases[] = {
+        "0", "-0", "1", "0.1", "3.14159", "9007199254740993", "4.9406564584124654e-324",
+        "2.4703282292062328e-324", "1.7976931348623157e308", "1e400", "1e-400",
+        "7.2057594037927933e16", "0.000000000000000000000000000000000000000000001234",
+        "9007199254740993.00000000000000000000000000000000000000000000000001"
+    };
+    const double expected[] = {
+        0.0, -0.0, 1.0, 0.1, 3.14159, 9007199254740992.0, 4.9406564584124654e-324,
+        4.9406564584124654e-324, 1.7976931348623157e308, HUGE_VAL, 0.0,
+        7.2057594037927933e16, 1.234e-45, 9007199254740994.0
+    };
+    for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double val = 0;
+        const char *last = cases[i] + strlen(cases[i]);
+        EXPECT_EQ(last, lightconf::parse_number(cases[i], last, &val)) << cases[i];
+        EXPECT_EQ(0, memcmp(&expected[i], &val, sizeof(val))) << cases[i];
+    }
+}
+
 TEST_F(ScannerTest, ScanIdentifier) {
     sc.scan("hello there");
     EXPECT_EQ("hello", sc.expect_identifier());
@@ -51,6 +101,74 @@ TEST_F(ScannerTest, ScanMultipleWithComments) {
     EXPECT_EQ(comments_expected, comments);
 }
 
+TEST_F(ScannerTest, LazyScanMultipleWithComments) {
+    std::vector<std::string> comments;
+    sc.scan("{ list = [ 1,  // comment \n  2, \n \n \"\\u2603\" // another comment \n ] }",
+        { [&](const std::string& str) { comments.push_back(str); },
+        lightconf::allow_comments_flag | lightconf::blank_line_comment_flag | lightconf::lazy_scan_flag });
+    EXPECT_NO_THROW(sc.expect('{'));
+    EXPECT_EQ("list", sc.expect_identifier());
+    EXPECT_NO_THROW(sc.expect('='));
+    EXPECT_NO_THROW(sc.expect('['));
+    EXPECT_EQ(1, sc.expect_number());
+    EXPECT_NO_THROW(sc.expect(','));
+    EXPECT_EQ(2, sc.expect_number());
+    EXPECT_NO_THROW(sc.expect(','));
+    EXPECT_EQ(u8"☃", sc.expect_string());
+    EXPECT_NO_THROW(sc.expect(']'));
+    EXPECT_NO_THROW(sc.expect('}'));
+    EXPECT_EQ(lightconf::token_type::eof_token, sc.peek_token().type);
+
+    std::vector<std::string> comments_expected = {"// comment ", "", "// another comment "};
+    EXPECT_EQ(comments_expected, comments);
+}
+
+TEST_F(ScannerTest, CommentsStripCarriageReturns) {
+    std::vector<std::string> comments;
+    sc.scan("a // windows\r\nb", { [&](const std::string& str) { comments.push_back(str); },
+        lightconf::allow_comments_flag });
+    EXPECT_EQ("a", sc.expect_identifier());
+    EXPECT_EQ("b", sc.expect_identifier());
+    std::vector<std::string> comments_expected = {"// windows"};
+    EXPECT_EQ(comments_expected, comments);
+}
+
+TEST_F(ScannerTest, PeekSkipsTrivia) {
+    std::vector<std::string> comments;
+    sc.scan("  // one\n  // two\n  x", { [&](const std::string& str) { comments.push_back(str); },
+        lightconf::allow_comments_flag });
+    EXPECT_EQ(lightconf::token_type::whitespace_token, sc.cur_token().type);
+    EXPECT_EQ(lightconf::token_type::identifier_token, sc.peek_token().type);
+    EXPECT_EQ(lightconf::token_type::identifier_token, sc.peek_token().type);
+    EXPECT_TRUE(comments.empty());
+    EXPECT_EQ("x", sc.expect_identifier());
+    std::vector<std::string> comments_expected = {"// one", "// two"};
+    EXPECT_EQ(comments_expected, comments);
+    EXPECT_EQ(lightconf::token_type::eof_token, sc.peek_token().type);
+}
+
+TEST_F(ScannerTest, SkipTriviaProducesNoTokens) {
+    sc.scan("  // comment\n\n\n { a = / } // trailing", { nullptr,
+        lightconf::allow_comments_flag | lightconf::skip_trivia_flag });
+    EXPECT_TRUE(sc.cur_token().is_char('{'));
+    sc.next_token();
+    EXPECT_EQ(lightconf::token_type::identifier_token, sc.cur_token().type);
+    sc.next_token();
+    EXPECT_TRUE(sc.cur_token().is_char('='));
+    sc.next_token();
+    EXPECT_TRUE(sc.cur_token().is_char('/'));
+    sc.next_token();
+    EXPECT_TRUE(sc.cur_token().is_char('}'));
+    sc.next_token();
+    EXPECT_EQ(lightconf::token_type::eof_token, sc.cur_token().type);
+}
+
+TEST_F(ScannerTest, LazyScanErrorsDeferred) {
+    EXPECT_NO_THROW(sc.scan("a b \"unclosed", lightconf::read_scanner_params));
+    EXPECT_EQ("a", sc.expect_identifier());
+    EXPECT_THROW(sc.expect_identifier(), lightconf::parse_error);
+}
+
 TEST_F(ScannerTest, UTF8_OneByte) {
     sc.scan("\"Letter 'a': \\u0061\"");
     EXPECT_EQ("Letter 'a': a", sc.expect_string());
@@ -82,3 +200,94 @@ TEST_F(ScannerTest, UTF8_Bogus_Except) {
         sc.expect_string();
     }, lightconf::utf8_error);
 }
+
+TEST_F(ScannerTest, ScanKernelsMatchScalar) {
+    std::vector<const lightconf::scan_kernels *> all = {
+        lightconf::sse2_scan_kernels(), lightconf::avx2_scan_kernels()
+    };
+    const lightconf::scan_kernels& scalar = lightconf::scalar_scan_kernels();
+    const char alphabet[] = "aZ09_-\"\\\r\n \t\x01\x7f\x80\xe2{=.";
+
+    std::srand(1234);
+    for (int i = 0; i < 2000; i++) {
+        std::string buf;
+        int len = std::rand() % 100;
+        int rare = std::rand() % sizeof(alphabet);
+        for (int j = 0; j < len; j++) {
+            // mostly long runs of one character so the vector loops get exercised
+            buf += (std::rand() % 20 == 0) ? alphabet[std::rand() % (sizeof(alphabet) - 1)] : alphabet[rare % 6];
+        }
+        const char *first = buf.data();
+        const char *last = buf.data() + buf.size();
+        for (const lightconf::scan_kernels *k : all) {
+            if (!k) continue;
+            ASSERT_EQ(scalar.find_string_special(first, last), k->find_string_special(first, last)) << k->name;
+            ASSERT_EQ(scalar.find_identifier_end(first, last), k->find_identifier_end(first, last)) << k->name;
+            ASSERT_EQ(scalar.find_whitespace_end(first, last), k->find_whitespace_end(first, last)) << k->name;
+        }
+    }
+}
+
+TEST_F(ScannerTest, ClassifyBlockMatchesScalar) {
+    std::vector<const lightconf::scan_kernels *> all = {
+        lightconf::sse2_scan_kernels(), lightconf::avx2_scan_kernels()
+    };
+    const char alphabet[] = "a0\"\\{}[]:,/ \t\x01\x7f\x80\xe2=.";
+
+    std::srand(4321);
+    for (int i = 0; i < 2000; i++) {
+        char block[64];
+        for (char& c : block) {
+            c = alphabet[std::rand() % (sizeof(alphabet) - 1)];
+        }
+        lightconf::block_masks expected, actual;
+        lightconf::scalar_scan_kernels().classify_block(block, &expected);
+        for (const lightconf::scan_kernels *k : all) {
+            if (!k) continue;
+            k->classify_block(block, &actual);
+            ASSERT_EQ(expected.quote, actual.quote) << k->name;
+            ASSERT_EQ(expected.backslash, actual.backslash) << k->name;
+            ASSERT_EQ(expected.op, actual.op) << k->name;
+            ASSERT_EQ(expected.whitespace, actual.whitespace) << k->name;
+            ASSERT_EQ(expected.slash, actual.slash) << k->name;
+            ASSERT_EQ(expected.high, actual.high) << k->name;
+        }
+    }
+}
+
+TEST_F(ScannerTest, StructuralIndex) {
+    // the second string is long enough that its escaped quote straddles two blocks
+    std::string src = "{ \"a\": [1, -2.5,true], \"b\": \"" + std::string(47, 'x') + "\\\"{,]\" }";
+    lightconf::structural_index index;
+    ASSERT_TRUE(index.build(src.data(), src.size()));
+    std::string starts;
+    for (uint32_t pos : index) {
+        starts += src[pos];
+    }
+    EXPECT_EQ("{\":[1,-,t],\":\"}", starts);
+
+    EXPECT_FALSE(index.build("{ // comment\n}", 14));
+    EXPECT_TRUE(index.build("{ \"//\": 1 }", 12));
+}
+
+TEST_F(ScannerTest, StructuralIndexValidatesUTF8) {
+    lightconf::structural_index index;
+    std::string valid = std::string(60, ' ') + u8"\"\u00e9\u2603\U0001F600\"";
+    index.build(valid.data(), valid.size(), true);
+    EXPECT_EQ(size_t(lightconf::structural_index::npos), index.utf8_error());
+
+    const char *invalid[] = { "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x98", "\x80", "\xff" };
+    for (const char *bytes : invalid) {
+        std::string src = std::string(62, ' ') + "\"" + bytes + "\"";
+        index.build(src.data(), src.size(), true);
+        EXPECT_EQ(63u, index.utf8_error()) << src;
+    }
+}
+
+TEST_F(ScannerTest, ScanLongTokens) {
+    std::string ident(100, 'x');
+    std::string str(70, 'y');
+    sc.scan(ident + std::string(40, ' ') + "\"" + str + "\\n" + str + "\"");
+    EXPECT_EQ(ident, sc.expect_identifier());
+    EXPECT_EQ(str + "\n" + str, sc.expect_string());
+}